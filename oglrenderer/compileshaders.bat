@@ -22,4 +22,14 @@
 %cd%/shaderc/glslc.exe %cd%/shaders/precomputeirradiance.frag -o %cd%/spv/precomputeirradiancefrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
 %cd%/shaderc/glslc.exe %cd%/shaders/sceneobject.vert -o %cd%/spv/sceneobjvert.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
 %cd%/shaderc/glslc.exe %cd%/shaders/sceneobject.frag -o %cd%/spv/sceneobjfrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
-%cd%/shaderc/glslc.exe %cd%/shaders/prefilterenvironment.frag -o %cd%/spv/prefilterenvironmentfrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
\ No newline at end of file
+%cd%/shaderc/glslc.exe %cd%/shaders/prefilterenvironment.frag -o %cd%/spv/prefilterenvironmentfrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/precomputehosek.comp -o %cd%/spv/precomputehosek.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/precomputeskyview.comp -o %cd%/spv/precomputeskyview.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/precomputecloudbrick.comp -o %cd%/spv/precomputecloudbrick.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/precomputecloudlight.comp -o %cd%/spv/precomputecloudlight.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/temporalreconstruct.frag -o %cd%/spv/temporalreconstructfrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/scenedepth.frag -o %cd%/spv/scenedepthfrag.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/cloudtile.comp -o %cd%/spv/cloudtile.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/cloudstats.comp -o %cd%/spv/cloudstats.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/precomputecloudscatter.comp -o %cd%/spv/precomputecloudscatter.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
+%cd%/shaderc/glslc.exe %cd%/shaders/fftstockham.comp -o %cd%/spv/fftstockham.spv --target-env=opengl -std=450core -I "%cd%/" -I "%cd%/shaders"
\ No newline at end of file
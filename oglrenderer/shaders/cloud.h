@@ -1,10 +1,13 @@
 #ifndef CLOUD_H
 #define CLOUD_H
 
+#include "deviceconstants.h"
 #include "fbm.h"
 #include "perlin.h"
 #include "worley.h"
 
+#include "cpuglslbegin.h"
+
 
 float remap(
     const float x,
@@ -17,6 +20,101 @@ float remap(
 }
 
 
+float phase(
+    const float cosTheta, 
+    const float g)
+{
+    return (1.0f - g * g) / (pow(1.0f + g * g - 2.0f * g * cosTheta, 1.5f) * 4.0f * PI);
+}
+
+
+// four octaves of henyey-greenstein phase and sun transmittance, each halving the
+// scattering, the extinction and the anisotropy. scales the sun luminance of a sample
+float cloudMultiScatter(
+    const float cosTheta,
+    const float opticalDepth,
+    const float g)
+{
+    float scattering = 0.0f;
+    float octave = 1.0f;
+    for (int j = 0; j < 4; ++j)
+    {
+        scattering += octave * phase(cosTheta, octave * g) * exp(-octave * opticalDepth);
+        octave *= 0.5f;
+    }
+    return scattering;
+}
+
+
+// lookup of cloudMultiScatter in the scattering lut, kept off the border texels
+vec2 cloudScatterUV(
+    const float cosTheta,
+    const float opticalDepth)
+{
+    const vec2 uv = vec2(cosTheta * 0.5f + 0.5f, 1.0f - exp(-opticalDepth * CLOUD_SCATTER_DEPTH_SCALE));
+    const vec2 halfTexel = 0.5f / vec2(CLOUD_SCATTER_LUT_WIDTH, CLOUD_SCATTER_LUT_HEIGHT);
+    return clamp(uv, halfTexel, 1.0f - halfTexel);
+}
+
+
+// the two channels of the base shape volume, x: perlin worley y: low frequency worley fbm
+vec2 cloudShape(
+    const vec4 noise)
+{
+    return vec2(noise.x, noise.y * 0.625f + noise.z * 0.25f + noise.w * 0.125f);
+}
+
+
+// cloud density of a base shape sample before the density scale
+float cloudBaseDensity(
+    const vec2  shape,
+    const float coverage)
+{
+    float base = remap(shape.x, 1.0f - coverage, 1.0f, 0.0f, 1.0f) * coverage;
+    base = remap(base, (shape.y - 1.0f) * 0.64f, 1.0f, 0.0f, 1.0f);
+    return max(0.0f, base);
+}
+
+
+// cloudBaseDensity without the fbm erosion, for samples whose footprint is larger than the erosion detail.
+// it is zero for shape <= 1 - coverage, which every empty brick already guarantees
+float cloudBaseDensityFar(
+    const float shape,
+    const float coverage)
+{
+    return max(0.0f, remap(shape, 1.0f - coverage, 1.0f, 0.0f, 1.0f) * coverage);
+}
+
+
+// the density in raymarchCloud is zero whenever this is <= 0.36 - coverage. it is linear in the
+// shape channels, so its max over a brick bounds every filtered sample taken inside that brick
+float cloudDensityBound(
+    const vec2 shape)
+{
+    return shape.x - 0.64f * shape.y;
+}
+
+
+// vertical density profile of a weather map column at height fraction h of the layer,
+// stratus fade in and out softly, cumulus have a hard base and a rounded top
+float cloudHeightProfile(
+    const float h,
+    const vec4  weather)
+{
+    const float base = weather.z;
+    const float top = weather.w;
+    if (top <= base)
+    {
+        return 0.0f;
+    }
+
+    const float x = (h - base) / (top - base);
+    const float bottom = smoothstep(0.0f, mix(0.3f, 0.1f, weather.y), x);
+    const float fade = 1.0f - smoothstep(mix(0.5f, 0.7f, weather.y), 1.0f, x);
+    return bottom * fade;
+}
+
+
 float worleyFBM(
     const vec3  st,
     const float time,
@@ -25,8 +123,8 @@ float worleyFBM(
 {
     const float noise =
         worley3D(st * freq, time * freq, invert) * 0.625f +
-        worley3D(st * 2 * freq, time * 2 * freq, invert) * 0.25f +
-        worley3D(st * 4 * freq, time * 4 * freq, invert) * 0.125f;
+        worley3D(st * 2.0f * freq, time * 2.0f * freq, invert) * 0.25f +
+        worley3D(st * 4.0f * freq, time * 4.0f * freq, invert) * 0.125f;
     return noise;
 }
 
@@ -69,8 +167,7 @@ float perlinWorley3D(
     const vec3  st,
     const float time,
     float       freq,
-    const int   octaves,
-    const bool  invert)
+    const int   octaves)
 {
     const float perlinNoise = perlinFBM(st, time, freq, octaves);
     const float worleyNoise =
@@ -97,7 +194,7 @@ vec2 hash22(vec2 p)
 {
     uvec2 q = uvec2(ivec2(p)) * uvec2(1597334673U, 3812015801U);
     q = (q.x ^ q.y) * uvec2(1597334673U, 3812015801U);
-    return vec2(q) * (1.0 / float(0xffffffffU));
+    return vec2(q) * (1.0f / float(0xffffffffU));
 }
 
 
@@ -115,10 +212,10 @@ struct Ray
 };
 
 bool intersect(
-    const in Box b,
-    const in Ray r,
-    out float minDist,
-    out float maxDist)
+    const Box b,
+    const Ray r,
+    OUT_FLOAT minDist,
+    OUT_FLOAT maxDist)
 {
     minDist = -1.0f;
     maxDist = -1.0f;
@@ -179,4 +276,26 @@ bool intersect(
 }
 
 
+// the cloud layer for a layer height, centered above the origin
+Box cloudLayerBox(
+    const float height)
+{
+    const float width = CLOUD_LAYER_HALF_WIDTH;
+    Box b;
+    b.mMin = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(-width, 0, -width);
+    b.mMax = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(width, height, width);
+    return b;
+}
+
+
+// offset of the baked noise lookup after time seconds at the given cloud speed
+vec3 cloudWindScroll(
+    const float time,
+    const float speed)
+{
+    return CLOUD_WIND_DIRECTION * (time * speed * CLOUD_WIND_SCALE);
+}
+
+#include "cpuglslend.h"
+
 #endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#ifndef CLOUDPASS_H
+#define CLOUDPASS_H
+
+#include "raymarch.h"
+
+// cloud pass shared by the fragment (TEMPORAL_QUAD_SHADER) and the tiled compute
+// (CLOUD_TILE_SHADER) paths, the includer declares the params and QUAD_* samplers
+
+Box cloudLayer()
+{
+    return cloudLayerBox(renderParams.mCloudSettings.w);
+}
+
+
+// interval of the ray inside the cloud layer, clamped against the opaque scene.
+// false when there is nothing to march for this pixel
+bool cloudInterval(
+    const in Ray  r,
+    const in Box  b,
+    const in vec2 pixelUV,
+    out float     tMin,
+    out float     tMax)
+{
+    tMin = 0.0f;
+    tMax = 0.0f;
+    bool foundIntersection = r.mDir.y > 0 && intersect(b, r, tMin, tMax);
+
+    // only the heights some column of the weather map has clouds at
+    if (renderParams.mWeather.x != 0.0f)
+    {
+        const float height = b.mMax.y - b.mMin.y;
+        Box slab = b;
+        slab.mMin.y = b.mMin.y + height * renderParams.mWeather.y;
+        slab.mMax.y = b.mMin.y + height * renderParams.mWeather.z;
+
+        float slabMin = 0.0f;
+        float slabMax = 0.0f;
+        foundIntersection = foundIntersection &&
+                            (slab.mMax.y > slab.mMin.y) &&
+                            intersect(slab, r, slabMin, slabMax);
+        tMin = max(tMin, slabMin);
+        tMax = min(tMax, slabMax);
+    }
+
+    // distance to the opaque geometry around this pixel, the scene depth has the cloud resolution.
+    // the farthest of the gathered texels wins so pixels along silhouettes still march, zero
+    // means nothing was drawn there
+    const vec4 sceneDepth = textureGather(sceneDepthTexture, pixelUV, 0);
+    const vec4 openDepth = mix(sceneDepth, vec4(1e30f), equal(sceneDepth, vec4(0.0f)));
+    const float sceneDistance = max(max(openDepth.x, openDepth.y), max(openDepth.z, openDepth.w));
+
+    // geometry in front of the layer hides the clouds, inside it the march stops at the geometry
+    foundIntersection = foundIntersection && (tMin < sceneDistance);
+    tMax = min(tMax, sceneDistance);
+    return foundIntersection;
+}
+
+
+// per pixel cost of this frame at the full rate position of the pixel,
+// w marks the pixels the cloud pass ran for
+void storeCloudCost(
+    const in vec2 pixelUV)
+{
+    if (renderParams.mCloudStats.x != 0)
+    {
+        const ivec2 texel = ivec2(pixelUV * vec2(imageSize(cloudCostTexture)));
+        imageStore(cloudCostTexture, texel, vec4(float(cloudPrimarySteps), float(cloudShadowSteps), cloudEarlyExit ? 1.0f : 0.0f, 1.0f));
+    }
+}
+
+
+vec4 shadeCloudPixel(
+    const in Ray  r,
+    const in Box  b,
+    const in vec2 pixelUV,
+    const in vec2 oldUV,
+    const bool    foundIntersection,
+    const float   tMin,
+    const float   tMax)
+{
+    vec3 sky = (skyParams.mPrecomputeSettings.y == SKYVIEW_SKY) ?
+               sampleSkyView(skyViewTexture, r.mDir.xyz) :
+               textureLod(environmentTexture, r.mDir.xyz, 0.0f).xyz;
+
+    vec3 sunPos = skyParams.mSunSetting.xyz * CLOUD_SUN_DISTANCE;
+    const float height = b.mMax.y - b.mMin.y;
+
+    bool hasClouds = false;
+    vec4 cloudColor = vec4(0.0f);
+    float transmittance = 1.0f;
+
+    if(foundIntersection)
+    {
+        float offset = textureLod(noiseTexture, pixelUV * renderParams.mScreenSettings.xy / BLUENOISE_RESOLUTION, 0.0f).x;
+        offset = fract(offset + renderParams.mScreenSettings.z * 1.61803398875f);
+        raymarchCloud(
+            r, 
+            b,
+            offset,
+            height,
+            renderParams.mCloudSettings.z,
+            renderParams.mCloudMapping.xy, 
+            renderParams.mSteps.x, 
+            renderParams.mSteps.y, 
+            tMin, 
+            tMax, 
+            sunPos, 
+            skyParams.mSunLuminance,
+            hasClouds, 
+            cloudColor, 
+            transmittance);
+    }
+
+    transmittance = clamp(transmittance, 0.0f, 1.0f);
+    if(transmittance < 1.0f)
+    {
+        hasClouds = true;
+    }
+
+    if(!foundIntersection || !hasClouds)
+    {
+        return vec4(sky, 1.0f);
+    }
+
+    vec4 c = vec4(sky.xyz * transmittance + cloudColor.xyz * (1 - transmittance), 1.0f);
+
+    // temporal reprojection + taa, the amortized mode does this in TEMPORAL_RECONSTRUCT_SHADER
+    if (renderParams.mTemporalSettings.x <= 1 &&
+        renderParams.mScreenSettings.z > 1 &&
+        oldUV.x >= 0.0f && oldUV.x <= 1.0f &&
+        oldUV.y >= 0.0f && oldUV.y <= 1.0f)
+    {
+        const vec3 prevFrame1 = textureLod(prevMainTexture, oldUV, 0.0f).xyz;
+        const vec3 prevFrame2 = textureLod(prevMainTexture, oldUV + vec2(1 / renderParams.mScreenSettings.x, 0.0f), 0.0f).xyz;
+        const vec3 prevFrame3 = textureLod(prevMainTexture, oldUV + vec2(0.0f, 1 / renderParams.mScreenSettings.y), 0.0f).xyz;
+        const vec3 prevFrame4 = textureLod(prevMainTexture, oldUV - vec2(1 / renderParams.mScreenSettings.x, 0.0f), 0.0f).xyz;
+        const vec3 prevFrame5 = textureLod(prevMainTexture, oldUV - vec2(0.0f, 1 / renderParams.mScreenSettings.y), 0.0f).xyz;
+
+        const vec3 prevFrame = (prevFrame1 * 2 + prevFrame2 + prevFrame3 + prevFrame4 + prevFrame5) / 6;
+
+        c = vec4(mix(prevFrame.xyz, c.xyz, 0.5f), 1.0f);
+    }
+    return c;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// no include guard, every dual compiled header includes this after its own includes and
+// cpuglslend.h at its end. on the cpu the glsl names map onto glm, the same way nishita.h does
+
+#ifndef GLSL_SHADER
+# include <math.h>
+# include <stdint.h>
+# include "glm/glm.hpp"
+# define OUT_FLOAT        float &
+# define abs              glm::abs
+# define clamp            glm::clamp
+# define dot              glm::dot
+# define floatBitsToUint  glm::floatBitsToUint
+# define floor            glm::floor
+# define fract            glm::fract
+# define length           glm::length
+# define max              glm::max
+# define min              glm::min
+# define mix              glm::mix
+# define mod              glm::mod
+# define normalize        glm::normalize
+# define sin              glm::sin
+# define smoothstep       glm::smoothstep
+# define step             glm::step
+# define uintBitsToFloat  glm::uintBitsToFloat
+# define uint             uint32_t
+# define vec2             glm::vec2
+# define vec3             glm::vec3
+# define vec4             glm::vec4
+# define ivec2            glm::ivec2
+# define ivec3            glm::ivec3
+# define uvec2            glm::uvec2
+# define uvec3            glm::uvec3
+# define uvec4            glm::uvec4
+#else
+# define OUT_FLOAT        out float
+#endif
@@ -0,0 +1,30 @@
+// counterpart of cpuglslbegin.h, no include guard
+
+#undef OUT_FLOAT
+#ifndef GLSL_SHADER
+# undef abs
+# undef clamp
+# undef dot
+# undef floatBitsToUint
+# undef floor
+# undef fract
+# undef length
+# undef max
+# undef min
+# undef mix
+# undef mod
+# undef normalize
+# undef sin
+# undef smoothstep
+# undef step
+# undef uintBitsToFloat
+# undef uint
+# undef vec2
+# undef vec3
+# undef vec4
+# undef ivec2
+# undef ivec3
+# undef uvec2
+# undef uvec3
+# undef uvec4
+#endif
@@ -35,11 +35,22 @@
 # define SCENE_OBJECT_SHADER          16
 # define PRECOMP_FRESNEL_SHADER       17
 # define PREFILTER_ENVIRONMENT_SHADER 18
-# define SHADER_COUNT              (PREFILTER_ENVIRONMENT_SHADER + 1)
+# define PRECOMP_HOSEK_SHADER         19
+# define PRECOMP_SKYVIEW_SHADER       20
+# define PRECOMP_CLOUD_BRICK_SHADER   21
+# define PRECOMP_CLOUD_LIGHT_SHADER   22
+# define TEMPORAL_RECONSTRUCT_SHADER  23
+# define SCENE_DEPTH_SHADER           24
+# define CLOUD_TILE_SHADER            25
+# define CLOUD_STATS_SHADER           26
+# define PRECOMP_CLOUD_SCATTER_SHADER 27
+# define FFT_STOCKHAM_SHADER          28
+# define SHADER_COUNT              (FFT_STOCKHAM_SHADER + 1)
 
 // sky models
 # define NISHITA_SKY 0
 # define HOSEK_SKY   1
+# define SKYVIEW_SKY 2
 
 // uniform binding points
 # define ORTHO_MATRIX        0
@@ -58,14 +69,27 @@
 # define BUTTERFLY_INDICES   0
 # define SCENE_MODEL_MATRIX  1
 # define SCENE_MATERIAL      2
+# define HOSEK_SKY_PARAMS    3
+# define CLOUD_STATS_BUFFER  4
 
 // texture resolution
 # define CLOUD_RESOLUTION             128
+# define CLOUD_BRICK_SIZE             8
+# define CLOUD_BRICK_RESOLUTION       (CLOUD_RESOLUTION / CLOUD_BRICK_SIZE)
+# define CLOUD_LIGHT_RESOLUTION_XZ    CLOUD_RESOLUTION
+# define CLOUD_LIGHT_RESOLUTION_Y     64
 # define ENVIRONMENT_RESOLUTION       128
 # define BLUENOISE_RESOLUTION         512
 # define IRRADIANCE_RESOLUTION        16
 # define FRESNEL_RESOLUTION           512
 # define PREFILTER_CUBEMAP_RESOLUTION 128
+# define NISHITA_LUT_WIDTH            256
+# define NISHITA_LUT_HEIGHT           64
+# define SKYVIEW_LUT_WIDTH            192
+# define SKYVIEW_LUT_HEIGHT           108
+# define WEATHER_MAP_RESOLUTION       256
+# define CLOUD_SCATTER_LUT_WIDTH      256
+# define CLOUD_SCATTER_LUT_HEIGHT     64
 
 // ocean resolution
 # define OCEAN_RESOLUTION_1 256
@@ -79,9 +103,38 @@
 # define PRECOMPUTE_CLOUD_LOCAL_SIZE       4
 # define PRECOMPUTE_OCEAN_WAVES_LOCAL_SIZE 16
 # define PRECOMPUTE_FRESNEL_LOCAL_SIZE     4
+# define PRECOMPUTE_HOSEK_LOCAL_SIZE       8
+# define PRECOMPUTE_SKYVIEW_LOCAL_SIZE     8
+# define PRECOMPUTE_CLOUD_BRICK_LOCAL_SIZE 4
+# define PRECOMPUTE_CLOUD_LIGHT_LOCAL_SIZE 4
+# define CLOUD_TILE_SIZE                   8
+# define CLOUD_STATS_LOCAL_SIZE            8
+# define PRECOMPUTE_CLOUD_SCATTER_LOCAL_SIZE 8
+# define FFT_STOCKHAM_LOCAL_SIZE           64
+
+// largest row the shared memory fft holds, N / 4 butterflies over FFT_STOCKHAM_LOCAL_SIZE invocations
+# define FFT_STOCKHAM_MAX_SIZE 1024
+
+// primary step histogram of the cloud cost reduction, the last bin holds everything above
+# define CLOUD_STATS_BINS 1024
 
 # define PI (3.1415926f)
 
+// cloud layer box and sun distance used by the cloud raymarch
+# define CLOUD_LAYER_HALF_WIDTH 80000.0f
+# define CLOUD_LAYER_BOTTOM     2000.0f
+# define CLOUD_SUN_DISTANCE     800000.0f
+
+// scroll of the baked cloud noise in tiles per second at cloud speed 1, see cloudWindScroll()
+# define CLOUD_WIND_DIRECTION   vec3(0.894f, 0.0f, 0.447f)
+# define CLOUD_WIND_SCALE       0.01f
+
+// mip of the base shape volume used by the shadow samples
+# define CLOUD_SHADOW_LOD       1.0f
+
+// v of the cloud scattering lut is 1 - exp(-optical depth * scale)
+# define CLOUD_SCATTER_DEPTH_SCALE 0.125f
+
 // BSDF
 # define SAMPLE_COUNT 300
 
@@ -91,6 +144,12 @@
 # define BUTTERFLY_INPUT_TEX     0
 # define BUTTERFLY_PINGPONG_TEX0 1
 # define BUTTERFLY_PINGPONG_TEX1 2
+# define BUTTERFLY_PINGPONG_TEX2 3
+# define BUTTERFLY_PINGPONG_TEX3 4
+
+// shared memory stockham fft, transformed in place
+# define FFT_STOCKHAM_XY_TEX 1
+# define FFT_STOCKHAM_Z_TEX  2
 
 // cloud noise frag
 # define CLOUD_NOISE_CLOUD_TEX 1
@@ -99,6 +158,8 @@
 # define INVERSION_PINGPONG_TEX0 0
 # define INVERSION_PINGPONG_TEX1 1
 # define INVERSION_OUTPUT_TEX    2
+# define INVERSION_PINGPONG_TEX2 3
+# define INVERSION_PINGPONG_TEX3 4
 
 // ocean normal shader
 # define OCEAN_NOMRAL_INPUT_TEX 0
@@ -108,16 +169,41 @@
 # define PRECOMPUTE_BUTTERFLY_OUTPUT 1
 
 // precompute cloud shader
-# define PRECOMPUTE_CLOUD_CLOUD_TEX 1
+# define PRECOMPUTE_CLOUD_CLOUD_TEX  1
+# define PRECOMPUTE_CLOUD_DETAIL_TEX 2
+
+// precompute cloud brick shader
+# define PRECOMPUTE_CLOUD_BRICK_CLOUD_TEX 1
+# define PRECOMPUTE_CLOUD_BRICK_TEX       2
+
+// precompute cloud light shader
+# define PRECOMPUTE_CLOUD_LIGHT_CLOUD_TEX 1
+# define PRECOMPUTE_CLOUD_LIGHT_TEX       2
 
 // precompute environment shader
 # define PRECOMPUTE_ENVIRONMENT_CLOUD_TEX 1
 # define PRECOMPUTE_ENVIRONMENT_NOISE_TEX 2
 # define PRECOMPUTE_ENVIRONMENT_SKY_TEX   3
+# define PRECOMPUTE_ENVIRONMENT_BRICK_TEX 4
+# define PRECOMPUTE_ENVIRONMENT_LIGHT_TEX 5
+# define PRECOMPUTE_ENVIRONMENT_WEATHER_TEX       6
+# define PRECOMPUTE_ENVIRONMENT_WEATHER_BOUND_TEX 7
+# define PRECOMPUTE_ENVIRONMENT_SCATTER_TEX       8
 
 // precompute fresnel shader
 # define PRECOMPUTE_FRESNEL_TEX 1
 
+// precompute hosek shader
+# define PRECOMPUTE_HOSEK_SKY_TEX 1
+
+// precompute sky shader
+# define PRECOMPUTE_SKY_TRANSMITTANCE_TEX 1
+# define PRECOMPUTE_SKY_SKYVIEW_TEX       2
+
+// precompute sky-view shader
+# define PRECOMPUTE_SKYVIEW_LUT_TEX           1
+# define PRECOMPUTE_SKYVIEW_TRANSMITTANCE_TEX 2
+
 // precompute irradiance shader
 # define PRECOMPUTE_IRRADIANCE_SKY_TEX    1
 
@@ -130,15 +216,38 @@
 
 // ocean height final shader
 # define OCEAN_HEIGHT_FINAL_H0K 3
-# define OCEAN_HEIGHT_FINAL_H_X 4
-# define OCEAN_HEIGHT_FINAL_H_Y 5
-# define OCEAN_HEIGHT_FINAL_H_Z 6
+# define OCEAN_HEIGHT_FINAL_H_XY 4
+# define OCEAN_HEIGHT_FINAL_H_Z  5
 
 // quad.frag
 # define QUAD_CLOUD_TEX       1
 # define QUAD_ENV_TEX         2
 # define QUAD_NOISE_TEX       3
 # define QUAD_PREV_SCREEN_TEX 4
+# define QUAD_SKYVIEW_TEX     5
+# define QUAD_CLOUD_BRICK_TEX 6
+# define QUAD_CLOUD_LIGHT_TEX 7
+# define QUAD_SCENE_DEPTH_TEX 8
+# define QUAD_WEATHER_TEX       9
+# define QUAD_WEATHER_BOUND_TEX 10
+# define QUAD_CLOUD_SCATTER_TEX 11
+
+// cloudtile.comp, samples the QUAD_* textures
+# define CLOUD_TILE_OUTPUT_TEX 0
+
+// per pixel cloud cost image, written by temporalquad.frag and cloudtile.comp
+# define QUAD_CLOUD_COST_TEX   1
+
+// precomputecloudscatter.comp
+# define PRECOMPUTE_CLOUD_SCATTER_TEX 1
+
+// cloudstats.comp
+# define CLOUD_STATS_COST_TEX    0
+# define CLOUD_STATS_HEATMAP_TEX 1
+
+// temporalreconstruct.frag
+# define RECONSTRUCT_SPARSE_TEX      1
+# define RECONSTRUCT_PREV_SCREEN_TEX 2
 
 // scene object shader
 # define SCENE_OBJECT_IRRADIANCE      1
@@ -146,6 +255,7 @@
 # define SCENE_OBJECT_PRECOMPUTED_GGX 3
 # define SCENE_OBJECT_SKY             4
 # define SCENE_OBJECT_DIFFUSE         5
+# define SCENE_OBJECT_SKYVIEW         6
 
 // texturedQuad.frag
 # define SCREEN_QUAD_TEX 1
@@ -159,5 +269,6 @@
 # define WATER_PREFILTER_ENV     6
 # define WATER_PRECOMPUTED_GGX   7
 # define WATER_IRRADIANCE        8
+# define WATER_SKYVIEW_TEX       9
 
 #endif
\ No newline at end of file
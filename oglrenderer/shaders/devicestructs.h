@@ -20,6 +20,17 @@ struct CameraParams
 };
 
 
+// ArHosekSkyModelState xyz coefficients for the gpu evaluation
+struct HosekSkyParams
+{
+    // x, y, z: normalized sun direction w: empty
+    vec4  mSunDir;
+    // 9 configuration values per channel
+    float mConfigs[27];
+    float mRadiances[3];
+};
+
+
 struct Material
 {
     // x: diffuse y: specular z: roughness w: metallic
@@ -46,7 +57,7 @@ struct OceanParams
 {
     // x: N, y: L, z: empty, w: empty
     ivec4 mHeightSettings;
-    // x: ping pong, y: stage, z: direction, w: dX, dY, or dZ (0, 1, 2)
+    // x: ping pong, y: stage, z: direction, w: empty
     ivec4 mPingPong;
     // x: amplitude, y: wind speed z & w: wind direction
     vec4 mWaveSettings;
@@ -74,8 +85,31 @@ struct RendererParams
     vec4 mCloudAbsorption;
     // x = horizontal width, y = vertical width, z = frame count, w = mDrawCall index
     ivec4 mScreenSettings;
-    // x = max steps, y = shadow max steps, z = empty, w = empty;
+    // x = max steps, y = shadow max steps, z = empty space skipping, w = cached light volume;
     ivec4 mSteps;
+    // x = bayer block size (1 = every pixel), y = frames since history reset, z, w = bayer pixel of this frame;
+    ivec4 mTemporalSettings;
+    // x = lod cone angle in radians (0 = off), y = lod bias, z = distance without fbm erosion (0 = never), w = empty;
+    vec4 mCloudLod;
+    // x = write the per pixel cost image, y, z, w = empty;
+    ivec4 mCloudStats;
+    // x = use the weather map, y = lowest cloud base, z = highest cloud top as fractions of the layer height, w = empty;
+    vec4 mWeather;
+};
+
+
+// reduction of the per pixel cloud cost, the step sums are split in a low and high word
+struct CloudStats
+{
+    uint mPixels;
+    uint mEarlyExits;
+    uint mMaxSteps;
+    uint mMaxShadowSteps;
+    uint mPrimaryStepsLo;
+    uint mPrimaryStepsHi;
+    uint mShadowStepsLo;
+    uint mShadowStepsHi;
+    uint mHistogram[CLOUD_STATS_BINS];
 };
 
 
@@ -92,11 +126,11 @@ struct SkyParams
     vec4 mSunSetting;
     // x, y, z: luminance w: empty
     vec4 mSunLuminance;
-    // x: rayleigh intensity, y: mie intensity
+    // x: rayleigh intensity, y: mie intensity, z: use transmittance lut
     vec4 mNishitaSetting;
     // x: min fog dist, y: max fog dist, z,w: empty
     vec4 mFogSettings;
-    // x: i-th cubemap texture, y: active model z: empty w: empty
+    // x: i-th cubemap texture, y: active model (nishita, hosek, sky-view lut) z: empty w: empty
     ivec4 mPrecomputeSettings;
     // x: roughness y: roughness test z: ior test w: metallic test
     vec4 mPrecomputeGGXSettings;
@@ -4,9 +4,11 @@
 #include "random.h"
 #include "worley.h"
 
+#include "cpuglslbegin.h"
+
 // Based on Morgan McGuire @morgan3d
 // https://www.shadertoy.com/view/4dS3Wd
-float noise(in vec2 st) 
+float noise(vec2 st) 
 {
     vec2 i = floor(st);
     vec2 f = fract(st);
@@ -17,7 +19,7 @@ float noise(in vec2 st)
     float c = random(i + vec2(0.0, 1.0));
     float d = random(i + vec2(1.0, 1.0));
 
-    vec2 u = f * f * (3.0 - 2.0 * f);
+    vec2 u = f * f * (3.0f - 2.0f * f);
 
     return mix(a, b, u.x) +
         (c - a) * u.y * (1.0 - u.x) +
@@ -32,10 +34,9 @@ float fbm(
     // Initial values
     float value = 0.0;
     float amplitude = .5;
-    float frequency = 0.;
     //
     // Loop of octaves
-    for (int i = 0; i < octaves; i++)
+    for (uint i = 0; i < octaves; i++)
     {
         value += amplitude * noise(st);
         st *= 2.;
@@ -54,10 +55,9 @@ float fbmWorley(
     // Initial values
     float value = 0.0;
     float amplitude = .5;
-    float frequency = 0.;
     //
     // Loop of octaves
-    for (int i = 0; i < octaves; i++)
+    for (uint i = 0; i < octaves; i++)
     {
         value += amplitude * worley(st, time, invert);
         st *= 2.;
@@ -66,5 +66,6 @@ float fbmWorley(
     return value;
 }
 
+#include "cpuglslend.h"
 
 #endif
\ No newline at end of file
@@ -5,9 +5,12 @@
 # include "glm/glm.hpp"
 # include "GL/glew.h"
 # define INOUT_VEC3 vec3 &
+# define abs        glm::abs
+# define clamp      glm::clamp
 # define mat4       glm::mat4
 # define min        glm::min
 # define max        glm::max
+# define sign       glm::sign
 # define vec4       glm::vec4
 # define vec3       glm::vec3
 # define vec2       glm::vec2
@@ -17,6 +20,18 @@
 # define INOUT_VEC3 inout vec3
 #endif
 
+# define NISHITA_EARTH_RADIUS      6360e3f // Radius of the earth
+# define NISHITA_ATMOSPHERE_RADIUS 6420e3f // Radius of the atmosphere
+# define NISHITA_RAYLEIGH_HEIGHT   7994.0f // Rayleigh scale height
+# define NISHITA_MIE_HEIGHT        1200.0f // Mie scale height
+# define NISHITA_MIE_ANISOTROPY    0.76f   // Anisotropy term for Mie scattering
+# define NISHITA_RAYLEIGH_BETA_R   3.8e-6f // Rayleigh scattering coefficients
+# define NISHITA_RAYLEIGH_BETA_G   13.5e-6f
+# define NISHITA_RAYLEIGH_BETA_B   33.1e-6f
+# define NISHITA_MIE_BETA          21e-6f  // Mie scattering coefficient
+# define NISHITA_VIEW_SAMPLES      32      // Samples along the view ray
+# define NISHITA_SUN_SAMPLES       8       // Samples towards the sun
+
 struct linesample
 {
 	bool mHasSolutions;
@@ -125,27 +140,139 @@ vec3 lmax(
 }
 
 
-void nishitaSky(
-	float      altitude         /*= 1*/,
-	float      rayleighIntensity/*= 20*/,
-	float      mieIntensity     /*= 20*/,
-	vec3       sunDirFromOrigin /*= vec3(0.0f, 0.0f,1.0f)*/,
-	vec3       rayDir           /*= vec3(0.0f, 1.0f, 0.0f)*/,
+// rayleigh (x) and mie (y) optical depth from Px towards the sun, z is 0 when the sun ray
+// hits the ground and the sample does not contribute
+vec3 nishitaSunDepth(
+	vec3 Px,
+	vec3 SunDirection)
+{
+	float Re = NISHITA_EARTH_RADIUS;
+	float Ra = NISHITA_ATMOSPHERE_RADIUS;
+	float Hr = NISHITA_RAYLEIGH_HEIGHT;
+	float Hm = NISHITA_MIE_HEIGHT;
+	int numSamplesL = NISHITA_SUN_SAMPLES;
+
+	//Get light depth to sun at this sample.
+	float opticalDepthLR = 0;
+	float opticalDepthLM = 0;
+
+	linesample atmosphereline_sample;
+	atmosphereline_sample.mHasSolutions = has_solutions(Px, SunDirection, Ra);
+	atmosphereline_sample.mType = linetype(Px, SunDirection, Ra);
+	atmosphereline_sample.mMin = lmin(Px, SunDirection, Ra);
+	atmosphereline_sample.mMax = lmax(Px, SunDirection, Ra);
+
+	linesample groundline_sample;
+	groundline_sample.mHasSolutions = has_solutions(Px, SunDirection, Re);
+	groundline_sample.mType = linetype(Px, SunDirection, Re);
+	groundline_sample.mMin = lmin(Px, SunDirection, Re);
+	groundline_sample.mMax = lmax(Px, SunDirection, Re);
+
+	vec3 Ps = atmosphereline_sample.mMax;
+	int j = 0;
+	if (groundline_sample.mHasSolutions && groundline_sample.mType == 0)
+	{
+		//Light is below horizon from this point. No sample needed.
+		opticalDepthLR += 0;
+		opticalDepthLM += 0;
+	}
+	else
+	{
+		float segmentLengthL = length(Px - Ps) / numSamplesL;
+
+		for (j = 0; j < numSamplesL; j++)
+		{
+			vec3 Pl = Px + segmentLengthL * SunDirection * float(j + 0.5);
+			float sampleHeightL = length(Pl) - Re;
+			if (sampleHeightL < 0) break;
+			// ignore sampleheights < 0 they're inside the planet...
+			float Hlr_sample = exp(-sampleHeightL / Hr) * segmentLengthL;
+			float Hlm_sample = exp(-sampleHeightL / Hm) * segmentLengthL;
+
+			opticalDepthLR += Hlr_sample;
+			opticalDepthLM += Hlm_sample;
+		}
+	}
+
+	// Only include a sample if we reached j (so not if we hit the break clause for rays that hit the ground in finding the sun)
+	return vec3(opticalDepthLR, opticalDepthLM, (j == numSamplesL) ? 1.0f : 0.0f);
+}
+
+
+// transmittance lut parameterization, u: signed sqrt of the cosine of the sun zenith angle
+// and v: sqrt of the altitude, so the horizon and the lower atmosphere get most of the texels
+vec2 nishitaLutUV(
+	float sampleHeight,
+	float cosZenith)
+{
+	float u = clamp(sign(cosZenith) * sqrt(abs(cosZenith)) * 0.5f + 0.5f, 0.0f, 1.0f);
+	float v = sqrt(clamp(sampleHeight / (NISHITA_ATMOSPHERE_RADIUS - NISHITA_EARTH_RADIUS), 0.0f, 1.0f));
+
+	// keep lookups on texel centers at the borders
+	vec2 lutSize = vec2(NISHITA_LUT_WIDTH, NISHITA_LUT_HEIGHT);
+	return (vec2(u, v) * (lutSize - vec2(1.0f)) + vec2(0.5f)) / lutSize;
+}
+
+
+// inverse of nishitaLutUV for texel x, y, used by the lut generator
+void nishitaLutParams(
+	int        x,
+	int        y,
+	INOUT_VEC3 samplePoint,
+	INOUT_VEC3 sunDirection)
+{
+	float u = float(x) / float(NISHITA_LUT_WIDTH - 1);
+	float v = float(y) / float(NISHITA_LUT_HEIGHT - 1);
+
+	float cosZenith = u * 2.0f - 1.0f;
+	cosZenith = cosZenith * abs(cosZenith);
+	float sampleHeight = v * v * (NISHITA_ATMOSPHERE_RADIUS - NISHITA_EARTH_RADIUS);
+
+	samplePoint = vec3(0.0f, NISHITA_EARTH_RADIUS + sampleHeight, 0.0f);
+	sunDirection = vec3(sqrt(max(1.0f - cosZenith * cosZenith, 0.0f)), cosZenith, 0.0f);
+}
+
+
+#ifdef NISHITA_LUT_SAMPLER
+vec3 nishitaSunDepthLUT(
+	vec3 Px,
+	vec3 SunDirection)
+{
+	float r = length(Px);
+	vec3 lightDepth = vec3(texture(NISHITA_LUT_SAMPLER, nishitaLutUV(r - NISHITA_EARTH_RADIUS, dot(Px / r, SunDirection))));
+	lightDepth.z = lightDepth.z > 0.5f ? 1.0f : 0.0f;
+	return lightDepth;
+}
+#endif
+
+
+void nishitaSkyImpl(
+	float      altitude,
+	float      rayleighIntensity,
+	float      mieIntensity,
+	vec3       sunDirFromOrigin,
+	vec3       rayDir,
+	bool       useLUT,
 	INOUT_VEC3 rayleigh,
 	INOUT_VEC3 mie,
 	INOUT_VEC3 sky)
 {
+#if !defined(NISHITA_LUT_SAMPLER) && !defined(GLSL_SHADER)
+	// the cpu builds always integrate the sun depth
+	(void)useLUT;
+#endif
+
 	//Variables:
-	float Re = 6360e3f; // Radius of the earth
-	float Ra = 6420e3f; // Radius of the atmosphere
-	float Hr = 7994.0f; // Rayleigh scale height
-	float Hm = 1200.0f; // Mie scale height
-	float g = 0.76f;    // Anisotropy term for Mie scattering.
+	float Re = NISHITA_EARTH_RADIUS;
+	float Ra = NISHITA_ATMOSPHERE_RADIUS;
+	float Hr = NISHITA_RAYLEIGH_HEIGHT;
+	float Hm = NISHITA_MIE_HEIGHT;
+	float g = NISHITA_MIE_ANISOTROPY;
 
-    const vec3 BetaR = vec3(3.8e-6, 13.5e-6, 33.1e-6);
+    const vec3 BetaR = vec3(NISHITA_RAYLEIGH_BETA_R, NISHITA_RAYLEIGH_BETA_G, NISHITA_RAYLEIGH_BETA_B);
 	vec3 BetaM_max = vec3(9.73e-6);
 	vec3 BetaM_min = vec3(13.28e-6);
-	vec3 BetaM = vec3(21e-6);
+	vec3 BetaM = vec3(NISHITA_MIE_BETA);
 
 	//Clean up inputs:
 	vec3 SunDirection = normalize(sunDirFromOrigin);
@@ -196,8 +323,7 @@ void nishitaSky(
 	}
 
 	// Create samples along view ray.
-	int numSamples = 32;
-	int numSamplesL = 8;
+	int numSamples = NISHITA_VIEW_SAMPLES;
 
 	float segmentLength = length(Pu - Pv) / numSamples;
 	float opticalDepthR = 0;
@@ -215,51 +341,17 @@ void nishitaSky(
 		opticalDepthR += Hr_sample;
 		opticalDepthM += Hm_sample;
 
-		//Get light depth to sun at this sample.
-		float opticalDepthLR = 0;
-		float opticalDepthLM = 0;
-
-		linesample atmosphereline_sample;
-		atmosphereline_sample.mHasSolutions = has_solutions(Px, SunDirection, Ra);
-		atmosphereline_sample.mType = linetype(Px, SunDirection, Ra);
-		atmosphereline_sample.mMin = lmin(Px, SunDirection, Ra);
-		atmosphereline_sample.mMax = lmax(Px, SunDirection, Ra);
-
-		linesample groundline_sample;
-		groundline_sample.mHasSolutions = has_solutions(Px, SunDirection, Re);
-		groundline_sample.mType = linetype(Px, SunDirection, Re);
-		groundline_sample.mMin = lmin(Px, SunDirection, Re);
-		groundline_sample.mMax = lmax(Px, SunDirection, Re);
-
-		vec3 Ps = atmosphereline_sample.mMax;
-		int j = 0;
-		if (groundline_sample.mHasSolutions && groundline_sample.mType == 0)
-		{
-			//Light is below horizon from this point. No sample needed.
-			opticalDepthLR += 0;
-			opticalDepthLM += 0;
-		}
-		else
-		{
-			float segmentLengthL = length(Px - Ps) / numSamplesL;
-
-			for (j = 0; j < numSamplesL; j++)
-			{
-				vec3 Pl = Px + segmentLengthL * SunDirection * float(j + 0.5);
-				float sampleHeightL = length(Pl) - Re;
-				if (sampleHeightL < 0) break;
-				// ignore sampleheights < 0 they're inside the planet...
-				float Hlr_sample = exp(-sampleHeightL / Hr) * segmentLengthL;
-				float Hlm_sample = exp(-sampleHeightL / Hm) * segmentLengthL;
-
-				opticalDepthLR += Hlr_sample;
-				opticalDepthLM += Hlm_sample;
-			}
-		}
+		//Get light depth to sun at this sample, either integrated or from the transmittance lut.
+#ifdef NISHITA_LUT_SAMPLER
+		vec3 lightDepth = useLUT ? nishitaSunDepthLUT(Px, SunDirection) : nishitaSunDepth(Px, SunDirection);
+#else
+		vec3 lightDepth = nishitaSunDepth(Px, SunDirection);
+#endif
+		float opticalDepthLR = lightDepth.x;
+		float opticalDepthLM = lightDepth.y;
 
 		// With our light samples done we can calculate the attenuation.
-		// Only include a sample if we reached j (so not if we hit the break clause for rays that hit the ground in finding the sun)
-		if (j == numSamplesL)
+		if (lightDepth.z > 0.5f)
 		{
 			vec3 tauR = BetaR * (opticalDepthR + opticalDepthLR);
 			vec3 tauM = BetaM * 1.1f * (opticalDepthM + opticalDepthLM);
@@ -279,11 +371,45 @@ void nishitaSky(
 }
 
 
+void nishitaSky(
+	float      altitude         /*= 1*/,
+	float      rayleighIntensity/*= 20*/,
+	float      mieIntensity     /*= 20*/,
+	vec3       sunDirFromOrigin /*= vec3(0.0f, 0.0f,1.0f)*/,
+	vec3       rayDir           /*= vec3(0.0f, 1.0f, 0.0f)*/,
+	INOUT_VEC3 rayleigh,
+	INOUT_VEC3 mie,
+	INOUT_VEC3 sky)
+{
+	nishitaSkyImpl(altitude, rayleighIntensity, mieIntensity, sunDirFromOrigin, rayDir, false, rayleigh, mie, sky);
+}
+
+
+#ifdef NISHITA_LUT_SAMPLER
+// single loop over the view ray, sun optical depth comes from the transmittance lut
+void nishitaSkyLUT(
+	float      altitude,
+	float      rayleighIntensity,
+	float      mieIntensity,
+	vec3       sunDirFromOrigin,
+	vec3       rayDir,
+	INOUT_VEC3 rayleigh,
+	INOUT_VEC3 mie,
+	INOUT_VEC3 sky)
+{
+	nishitaSkyImpl(altitude, rayleighIntensity, mieIntensity, sunDirFromOrigin, rayDir, true, rayleigh, mie, sky);
+}
+#endif
+
+
 #ifndef GLSL_SHADER
 # undef INOUT_VEC3 inout vec3
+# undef abs
+# undef clamp
 # undef mat4
 # undef min
 # undef max
+# undef sign
 # undef vec4
 # undef vec3
 # undef vec2
@@ -3,6 +3,8 @@
 
 #include "deviceconstants.h"
 
+#include "cpuglslbegin.h"
+
 
 vec4 permute(vec4 x) 
 { 
@@ -43,12 +45,14 @@ vec3 hash33(vec3 p)
 #define UI1 3812015801U
 #define UI2 uvec2(UI0, UI1)
 #define UI3 uvec3(UI0, UI1, 2798796415U)
-#define UIF (1.0 / float(0xffffffffU))
+#define UIF (1.0f / float(0xffffffffU))
     uvec3 q = uvec3(ivec3(p)) * UI3;
     q = (q.x ^ q.y ^ q.z) * UI3;
-    return -1. + 2. * vec3(q) * UIF;
+    return -1.0f + 2.0f * vec3(q) * UIF;
 }
 
+// the swizzles keep these two glsl only
+#ifdef GLSL_SHADER
 float perlin2D(vec2 P) 
 {
     vec4 Pi = floor(P.xyxy) + vec4(0.0f, 0.0f, 1.0f, 1.0f);
@@ -153,6 +157,7 @@ float perlin3D(vec3 P)
     float n_xyz = mix(n_yz.x, n_yz.y, fade_xyz.x); 
     return 2.2f * n_xyz;
 }
+#endif
 
 
 // 3D Gradient noise by iq.
@@ -183,7 +188,7 @@ float gradientNoise(vec3 x, float freq)
     vec3 w = fract(x);
     
     // quintic interpolant
-    vec3 u = w * w * w * (w * (w * 6. - 15.) + 10.);
+    vec3 u = w * w * w * (w * (w * 6.0f - 15.0f) + 10.0f);
 
     
     // gradients
@@ -217,4 +222,6 @@ float gradientNoise(vec3 x, float freq)
            u.x * u.y * u.z * (-va + vb + vc - vd + ve - vf - vg + vh);
 }
 
+#include "cpuglslend.h"
+
 #endif
\ No newline at end of file
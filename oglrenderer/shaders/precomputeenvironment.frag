@@ -26,6 +26,11 @@ layout(std430, binding = SKY_PARAMS) uniform SkyParamsUniform
 layout (binding = PRECOMPUTE_ENVIRONMENT_CLOUD_TEX) uniform sampler3D cloudTexture;
 layout (binding = PRECOMPUTE_ENVIRONMENT_NOISE_TEX) uniform sampler2D noiseTexture;
 layout (binding = PRECOMPUTE_ENVIRONMENT_SKY_TEX)   uniform samplerCube skyTexture;
+layout (binding = PRECOMPUTE_ENVIRONMENT_BRICK_TEX) uniform sampler3D cloudBrickTexture;
+layout (binding = PRECOMPUTE_ENVIRONMENT_LIGHT_TEX) uniform sampler3D cloudLightTexture;
+layout (binding = PRECOMPUTE_ENVIRONMENT_WEATHER_TEX) uniform sampler2D weatherTexture;
+layout (binding = PRECOMPUTE_ENVIRONMENT_WEATHER_BOUND_TEX) uniform sampler2D weatherBoundTexture;
+layout (binding = PRECOMPUTE_ENVIRONMENT_SCATTER_TEX) uniform sampler2D cloudScatterTexture;
 
 layout(location = 0) out vec4 c;
 
@@ -74,16 +79,16 @@ void main()
     r.mDir = rayDir; 
 
     Box b; 
-    float width = 80000.0f;
+    float width = CLOUD_LAYER_HALF_WIDTH;
     float height = renderParams.mCloudSettings.w;
-    b.mMin = vec3(0.0f, 2000.0f, 0.0f) + vec3(-width, 0, -width);
-    b.mMax = vec3(0.0f, 2000.0f, 0.0f) + vec3(width, height, width);
+    b.mMin = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(-width, 0, -width);
+    b.mMax = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(width, height, width);
 
     float tMin = 0.0f;
     float tMax = 0.0f;
     const bool foundIntersection = intersect(b, r, tMin, tMax);
     
-    vec3 sunPos = skyParams.mSunSetting.xyz * 800000.0f;
+    vec3 sunPos = skyParams.mSunSetting.xyz * CLOUD_SUN_DISTANCE;
     
     bool hasClouds = false;
     vec4 cloudColor = vec4(0.0f);
@@ -5,7 +5,13 @@
 #include "cloud.h"
 #include "deviceconstants.h"
 #include "devicestructs.h"
+
+layout(binding = PRECOMPUTE_SKY_TRANSMITTANCE_TEX) uniform sampler2D transmittanceLut;
+layout(binding = PRECOMPUTE_SKY_SKYVIEW_TEX) uniform sampler2D skyViewLut;
+
+#define NISHITA_LUT_SAMPLER transmittanceLut
 #include "nishita.h"
+#include "skyview.h"
 
 layout(location = 1) in vec2 uv;
 
@@ -65,6 +71,18 @@ void main()
 	vec3 rayleigh;
 	vec3 mie;
 	vec3 sky;
-	nishitaSky(0.001f, skyParams.mNishitaSetting.x, skyParams.mNishitaSetting.y, sunDir, rayDir.xyz,  rayleigh, mie, sky);
+	if (skyParams.mPrecomputeSettings.y == SKYVIEW_SKY)
+	{
+		// resample the sky-view lut, only needed for the image based lighting passes
+		sky = sampleSkyView(skyViewLut, rayDir);
+	}
+	else if (skyParams.mNishitaSetting.z > 0.5f)
+	{
+		nishitaSkyLUT(0.001f, skyParams.mNishitaSetting.x, skyParams.mNishitaSetting.y, sunDir, rayDir.xyz, rayleigh, mie, sky);
+	}
+	else
+	{
+		nishitaSky(0.001f, skyParams.mNishitaSetting.x, skyParams.mNishitaSetting.y, sunDir, rayDir.xyz,  rayleigh, mie, sky);
+	}
 	c = vec4(sky, 1.0f);
 }
\ No newline at end of file
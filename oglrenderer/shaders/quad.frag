@@ -23,6 +23,11 @@ layout(std430, binding = SKY_PARAMS) uniform SkyParamsUniform
 layout (binding = QUAD_CLOUD_TEX) uniform sampler3D cloudTexture;
 layout (binding = QUAD_ENV_TEX) uniform samplerCube environmentTexture;
 layout (binding = QUAD_NOISE_TEX) uniform sampler2D noiseTexture;
+layout (binding = QUAD_CLOUD_BRICK_TEX) uniform sampler3D cloudBrickTexture;
+layout (binding = QUAD_CLOUD_LIGHT_TEX) uniform sampler3D cloudLightTexture;
+layout (binding = QUAD_WEATHER_TEX) uniform sampler2D weatherTexture;
+layout (binding = QUAD_WEATHER_BOUND_TEX) uniform sampler2D weatherBoundTexture;
+layout (binding = QUAD_CLOUD_SCATTER_TEX) uniform sampler2D cloudScatterTexture;
 layout (binding = QUAD_PREV_SCREEN_TEX) uniform sampler2D prevMainTexture;
 
 layout(location = 0) out vec4 c;
@@ -40,16 +45,16 @@ void main()
     vec3 sky = texture(environmentTexture, r.mDir.xyz).xyz;
     
     Box b; 
-    float width = 80000.0f;
+    float width = CLOUD_LAYER_HALF_WIDTH;
     float height = renderParams.mCloudSettings.w;
-    b.mMin = vec3(0.0f, 2000.0f, 0.0f) + vec3(-width, 0, -width);
-    b.mMax = vec3(0.0f, 2000.0f, 0.0f) + vec3(width, height, width);
+    b.mMin = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(-width, 0, -width);
+    b.mMax = vec3(0.0f, CLOUD_LAYER_BOTTOM, 0.0f) + vec3(width, height, width);
 
     float tMin = 0.0f;
     float tMax = 0.0f;
     const bool foundIntersection = r.mDir.y > 0 && intersect(b, r, tMin, tMax);
     
-    vec3 sunPos = skyParams.mSunSetting.xyz * 800000.0f;
+    vec3 sunPos = skyParams.mSunSetting.xyz * CLOUD_SUN_DISTANCE;
     
     bool hasClouds = false;
     vec4 cloudColor = vec4(0.0f);
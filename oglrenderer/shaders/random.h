@@ -1,9 +1,11 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
+#include "cpuglslbegin.h"
+
 float random1(const vec2 st)
 {
-    return fract(sin(dot(st.xy,
+    return fract(sin(dot(st,
         vec2(12.9898, 78.233))) *
         43758.5453123);
 }
@@ -80,4 +82,6 @@ vec2 hammersley(
     return vec2(float(i) / float(N), vanDerCorput(i));
 }
 
+#include "cpuglslend.h"
+
 #endif
\ No newline at end of file
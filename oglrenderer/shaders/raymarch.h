@@ -3,12 +3,11 @@
 
 #include "cloud.h"
 
-float phase(
-    const float cosTheta, 
-    const float g)
-{
-    return (1.0f - g * g) / (pow(1. + g * g - 2.0f * g * cosTheta, 1.5f) * 4.0f * PI);
-}
+// cost of the last raymarchCloud call, stored per pixel when renderParams.mCloudStats.x is set.
+// a cached light volume lookup counts as one shadow step
+uint cloudPrimarySteps = 0;
+uint cloudShadowSteps = 0;
+bool cloudEarlyExit = false;
 
 
 void raymarchCloud(
@@ -28,23 +27,116 @@ void raymarchCloud(
     inout vec4  cloudColor,
     inout float transmittance)
 {
+    cloudPrimarySteps = 0;
+    cloudShadowSteps = 0;
+    cloudEarlyExit = false;
+
     const float stepLength = ((tMax - tMin) / float(maxSteps));
     r.mOrigin = r.mOrigin + r.mDir * (tMin + stepLength * offset);
+    float t = tMin + stepLength * offset;
+
+    // distance lod, the step grows with the cone footprint and the mip follows it. the bricks
+    // are built from mip 0, at higher mips skipping only trims blur leaking into empty bricks
+    const float coneAngle = renderParams.mCloudLod.x;
+    const float farDistance = renderParams.mCloudLod.z;
+    const vec3 voxelSize = (b.mMax - b.mMin) / (vec3(uv.x, 1.0f, uv.y) * float(CLOUD_RESOLUTION));
+    const float maxVoxelSize = max(voxelSize.x, max(voxelSize.y, voxelSize.z));
+    const float maxLod = log2(float(CLOUD_RESOLUTION));
 
     float densityScale = density * 0.001f;
+
+    // the baked noise is static, the wind scrolls the lookup through the tile
+    const vec3 cloudScroll = cloudWindScroll(renderParams.mSettings.x, renderParams.mCloudSettings.y);
+
+    // empty bricks have a density bound at or below this for the largest coverage hash12 can produce
+    const float emptyBound = 0.36f - (0.1f + (renderParams.mCloudMapping.z * .5 + .5));
+    vec3 brickDir = r.mDir / (b.mMax - b.mMin);
+    brickDir.xz *= uv;
+    brickDir *= float(CLOUD_BRICK_RESOLUTION);
+
+    // weather map columns, texels per unit t in xz and layer fraction per unit t in y
+    const bool useWeather = renderParams.mWeather.x != 0.0f;
+    const vec3 layerDir = r.mDir / (b.mMax - b.mMin);
+    const vec2 weatherDir = layerDir.xz * float(WEATHER_MAP_RESOLUTION);
+
     if (tMin > 0 && tMax > tMin)
     {
         for (int i = 0; i < maxSteps; ++i)
         {
-            vec3 uvw = (r.mOrigin - b.mMin) / (b.mMax - b.mMin);
+            if (t > tMax)
+            {
+                break;
+            }
+
+            const float footprint = t * coneAngle;
+            const float currentStep = max(stepLength, footprint);
+            const float lod = (coneAngle > 0.0f) ? clamp(log2(max(footprint, 1e-3f) / maxVoxelSize) + renderParams.mCloudLod.y, 0.0f, maxLod) : 0.0f;
+
+            const vec3 layerUVW = (r.mOrigin - b.mMin) / (b.mMax - b.mMin);
+            vec3 uvw = layerUVW;
             uvw.xz *= uv;
+            uvw += cloudScroll;
 
-            vec4 noise = texture(cloudTexture, uvw);
-            const float coverage = hash12(uvw.xz) * 0.1 + (renderParams.mCloudMapping.z * .5 + .5);
-            float lowFreqFBM = noise.y * 0.625f + noise.z * 0.25f + noise.w * 0.125f;
-            float base = remap(noise.x, 1.0f - coverage, 1.0f, 0.0f, 1.0f) * coverage;
-            base = remap(base, (lowFreqFBM - 1.0f) * 0.64f, 1.0f, 0.0f, 1.0f);
-            base = max(0.0f, base);
+            if (useWeather)
+            {
+                // columns without coverage, or with the ray above or below their clouds
+                // for the whole texel, are skipped to the first step past the texel
+                const vec2 cell = layerUVW.xz * float(WEATHER_MAP_RESOLUTION);
+                const ivec2 cellIdx = clamp(ivec2(floor(cell)), ivec2(0), ivec2(WEATHER_MAP_RESOLUTION - 1));
+                const vec3 bound = texelFetch(weatherBoundTexture, cellIdx, 0).xyz;
+
+                const vec2 exitPlane = floor(cell) + step(vec2(0.0f), weatherDir);
+                const vec2 tExit = abs((exitPlane - cell) / weatherDir);
+                const float tCell = min(tExit.x, tExit.y);
+                const float exitHeight = layerUVW.y + layerDir.y * tCell;
+                if (bound.x <= 0.0f ||
+                    max(layerUVW.y, exitHeight) < bound.y ||
+                    min(layerUVW.y, exitHeight) > bound.z)
+                {
+                    const int skipSteps = int(min(floor(tCell / currentStep), float(maxSteps))) + 1;
+
+                    r.mOrigin = r.mOrigin + r.mDir * (currentStep * float(skipSteps));
+                    t += currentStep * float(skipSteps);
+                    i += skipSteps - 1;
+                    continue;
+                }
+            }
+
+            if (renderParams.mSteps.z != 0)
+            {
+                const vec3 brick = uvw * float(CLOUD_BRICK_RESOLUTION);
+                const ivec3 brickIdx = ivec3(mod(floor(brick), float(CLOUD_BRICK_RESOLUTION)));
+                if (texelFetch(cloudBrickTexture, brickIdx, 0).x <= emptyBound)
+                {
+                    // jump to the first step past the brick, all steps before it sample zero density
+                    const vec3 exitPlane = floor(brick) + step(vec3(0.0f), brickDir);
+                    const vec3 tExit = abs((exitPlane - brick) / brickDir);
+                    const float tBrick = min(tExit.x, min(tExit.y, tExit.z));
+                    const int skipSteps = int(min(floor(tBrick / currentStep), float(maxSteps))) + 1;
+
+                    r.mOrigin = r.mOrigin + r.mDir * (currentStep * float(skipSteps));
+                    t += currentStep * float(skipSteps);
+                    i += skipSteps - 1;
+                    continue;
+                }
+            }
+
+            ++cloudPrimarySteps;
+            const vec2 shape = textureLod(cloudTexture, uvw, lod).xy;
+            const vec4 weather = useWeather ? textureLod(weatherTexture, layerUVW.xz, 0.0f) : vec4(1.0f);
+            const float coverage = (hash12(uvw.xz) * 0.1 + (renderParams.mCloudMapping.z * .5 + .5)) * weather.x;
+
+            // far away the fbm erosion is skipped, blended over a quarter of the distance
+            const float farWeight = (farDistance > 0.0f) ? smoothstep(farDistance, farDistance * 1.25f, t) : 0.0f;
+            float base = cloudBaseDensityFar(shape.x, coverage);
+            if (farWeight < 1.0f)
+            {
+                base = mix(cloudBaseDensity(shape, coverage), base, farWeight);
+            }
+            if (useWeather)
+            {
+                base *= cloudHeightProfile(layerUVW.y, weather);
+            }
 
             Ray shadowRay;
             shadowRay.mOrigin = r.mOrigin;
@@ -55,7 +147,17 @@ void raymarchCloud(
 
             // only do light marching if transmittance is less than 1
             const float shadowStepLength = (height * 0.5f / float(shadowMaxSteps));
-            if (transmittance < 1.0f)
+            // the volume covers one noise tile and cannot hold the weather map, which spans the
+            // whole layer, so with the map on the shadow is always marched
+            if (transmittance < 1.0f && renderParams.mSteps.w != 0 && !useWeather)
+            {
+                // one lookup into the cached sun march, y is kept off the wrapped border
+                vec3 lightUVW = uvw;
+                lightUVW.y = clamp(lightUVW.y, 0.5f / float(CLOUD_LIGHT_RESOLUTION_Y), 1.0f - 0.5f / float(CLOUD_LIGHT_RESOLUTION_Y));
+                lightRayDensity = texture(cloudLightTexture, lightUVW).x;
+                ++cloudShadowSteps;
+            }
+            else if (transmittance < 1.0f)
             {
                 for (int j = 0; j < shadowMaxSteps; ++j)
                 {
@@ -64,15 +166,20 @@ void raymarchCloud(
                     const bool foundIntersection = intersect(b, shadowRay, shadowtMin, shadowtMax);
                     if (foundIntersection)
                     {
-                        vec3 shadowUVW = (shadowRay.mOrigin - b.mMin) / (b.mMax - b.mMin);
+                        ++cloudShadowSteps;
+                        const vec3 shadowLayerUVW = (shadowRay.mOrigin - b.mMin) / (b.mMax - b.mMin);
+                        vec3 shadowUVW = shadowLayerUVW;
                         shadowUVW.xz *= uv;
-
-                        vec4 noise = texture(cloudTexture, shadowUVW);
-                        const float coverage = hash12(uvw.xz) * 0.1 + (renderParams.mCloudMapping.z * .5 + .5);
-                        float lowFreqFBM = noise.y * 0.625f + noise.z * 0.25f + noise.w * 0.125f;
-                        float base = remap(noise.x, 1.0f - coverage, 1.0f, 0.0f, 1.0f) * coverage;
-                        base = remap(base, (lowFreqFBM - 1.0f) * 0.64f, 1.0f, 0.0f, 1.0f);
-                        base = max(0.0f, base);
+                        shadowUVW += cloudScroll;
+
+                        const vec2 shape = textureLod(cloudTexture, shadowUVW, max(CLOUD_SHADOW_LOD, lod)).xy;
+                        const vec4 shadowWeather = useWeather ? textureLod(weatherTexture, shadowLayerUVW.xz, 0.0f) : vec4(1.0f);
+                        const float coverage = (hash12(uvw.xz) * 0.1 + (renderParams.mCloudMapping.z * .5 + .5)) * shadowWeather.x;
+                        float base = cloudBaseDensity(shape, coverage);
+                        if (useWeather)
+                        {
+                            base *= cloudHeightProfile(shadowLayerUVW.y, shadowWeather);
+                        }
                         lightTransmittance *= exp(-shadowStepLength * base * densityScale * renderParams.mCloudAbsorption.x);
                         lightRayDensity += base * densityScale;
                     }
@@ -89,29 +196,24 @@ void raymarchCloud(
                 }
             }
 
-            vec4 luminance = vec4(0.0f);
-            for (int j = 0; j < 4; ++j)
-            {
-                float a = pow(0.5f, j);
-                float b = pow(0.5f, j);
-                float c = pow(0.5f, j);
-
-                const float stepTransmittance = exp(-a * shadowStepLength * lightRayDensity * renderParams.mCloudAbsorption.x);
-                luminance += b* sunLuminance* phase(dot(shadowRay.mDir, r.mDir), c * renderParams.mCloudSettings.x)* stepTransmittance;
-            }
+            // the octaves of cloudMultiScatter, baked by PRECOMP_CLOUD_SCATTER_SHADER
+            const float opticalDepth = shadowStepLength * lightRayDensity * renderParams.mCloudAbsorption.x;
+            vec4 luminance = sunLuminance * textureLod(cloudScatterTexture, cloudScatterUV(dot(shadowRay.mDir, r.mDir), opticalDepth), 0.0f).x;
             luminance *= base;
 
-            float rayTransmittance = exp(-stepLength * base * densityScale * renderParams.mCloudAbsorption.x);
+            float rayTransmittance = exp(-currentStep * base * densityScale * renderParams.mCloudAbsorption.x);
             vec4 integralScattering = (luminance - luminance * rayTransmittance) / max(0.01f, base * renderParams.mCloudAbsorption.x);
             cloudColor += (integralScattering * transmittance);
             transmittance *= rayTransmittance;
 
             if (length(transmittance) < 0.1f)
             {
+                cloudEarlyExit = true;
                 break;
             }
 
-            r.mOrigin = r.mOrigin + r.mDir * stepLength;
+            r.mOrigin = r.mOrigin + r.mDir * currentStep;
+            t += currentStep;
         }
     }
 }
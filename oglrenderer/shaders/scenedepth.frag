@@ -0,0 +1,23 @@
+#version 450 core
+#define GLSL_SHADER
+#extension GL_EXT_scalar_block_layout : require
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+layout(std430, binding = CAMERA_PARAMS) uniform CameraParamsUniform
+{
+	CameraParams camParams;
+};
+
+layout(location = 0) out vec4 c;
+
+// distance from the camera to the opaque geometry, the cloud pass ends its rays there
+void main()
+{
+    c = vec4(length(position - camParams.mEye.xyz), 0.0f, 0.0f, 1.0f);
+}
@@ -4,6 +4,7 @@
 
 #include "deviceconstants.h"
 #include "devicestructs.h"
+#include "skyview.h"
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -35,6 +36,7 @@ layout(binding = SCENE_OBJECT_PREFILTER_ENV) uniform samplerCube prefilterTex;
 layout(binding = SCENE_OBJECT_PRECOMPUTED_GGX) uniform sampler2D precomputedGGXTex;
 layout(binding = SCENE_OBJECT_SKY) uniform samplerCube skyTex;
 layout(binding = SCENE_OBJECT_DIFFUSE) uniform sampler2D diffuseTex;
+layout(binding = SCENE_OBJECT_SKYVIEW) uniform sampler2D skyViewTex;
 
 layout(location = 0) out vec4 c;
 
@@ -52,6 +54,8 @@ void main()
 	const vec3 sunDir = normalize(skyParams.mSunSetting.xyz);
 	const vec3 sunColor = (skyParams.mPrecomputeSettings.y == NISHITA_SKY) ? 
 						  texture(skyTex, sunDir).xyz : 
+						  (skyParams.mPrecomputeSettings.y == SKYVIEW_SKY) ?
+						  sampleSkyView(skyViewTex, sunDir) :
 						  vec3(1.0f);
 	vec3 directDiffuse = sunColor * albedo * max(0.0f, dot(normal, sunDir));
 
@@ -0,0 +1,70 @@
+#ifndef SKYVIEW_H
+#define SKYVIEW_H
+
+#ifndef GLSL_SHADER
+# include "glm/glm.hpp"
+# define asin  glm::asin
+# define atan  glm::atan
+# define clamp glm::clamp
+# define cos   glm::cos
+# define sin   glm::sin
+# define sqrt  glm::sqrt
+# define vec3  glm::vec3
+# define vec2  glm::vec2
+#endif
+
+// sky-view lut parameterization (hillaire 2020), u: azimuth and v: square root of the
+// elevation. only the upper hemisphere is stored since the nishita integral clamps rays
+// below the horizon, the square root puts most texels close to the horizon
+vec2 skyViewUV(
+    vec3 dir)
+{
+    float azimuth = atan(dir.z, dir.x);
+    float elevation = asin(clamp(dir.y, 0.0f, 1.0f));
+
+    float u = azimuth / (2.0f * PI) + 0.5f;
+    float v = sqrt(elevation / (0.5f * PI));
+    return vec2(u, v);
+}
+
+
+// inverse of skyViewUV for texel x, y, used by the lut generator
+vec3 skyViewDir(
+    int x,
+    int y)
+{
+    float u = (float(x) + 0.5f) / float(SKYVIEW_LUT_WIDTH);
+    float v = (float(y) + 0.5f) / float(SKYVIEW_LUT_HEIGHT);
+
+    float azimuth = (u - 0.5f) * 2.0f * PI;
+    float elevation = v * v * 0.5f * PI;
+    return vec3(cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth));
+}
+
+
+#ifdef GLSL_SHADER
+// u wraps with the texture, v is kept on texel centers so the horizon and zenith rows do not bleed
+vec3 sampleSkyView(
+    sampler2D lut,
+    vec3      dir)
+{
+    vec2 uv = skyViewUV(dir);
+    uv.y = clamp(uv.y, 0.5f / float(SKYVIEW_LUT_HEIGHT), 1.0f - 0.5f / float(SKYVIEW_LUT_HEIGHT));
+    return texture(lut, uv).xyz;
+}
+#endif
+
+
+#ifndef GLSL_SHADER
+# undef asin
+# undef atan
+# undef clamp
+# undef cos
+# undef sin
+# undef sqrt
+# undef vec3
+# undef vec2
+#endif
+
+
+#endif
@@ -6,6 +6,7 @@
 #include "deviceconstants.h"
 #include "devicestructs.h"
 #include "nishita.h"
+#include "skyview.h"
 
 layout(location = 1) in vec2 uv;
 layout(location = 2) in vec4 near;
@@ -24,88 +25,49 @@ layout(std430, binding = SKY_PARAMS) uniform SkyParamsUniform
 layout (binding = QUAD_CLOUD_TEX) uniform sampler3D cloudTexture;
 layout (binding = QUAD_ENV_TEX) uniform samplerCube environmentTexture;
 layout (binding = QUAD_NOISE_TEX) uniform sampler2D noiseTexture;
+layout (binding = QUAD_CLOUD_BRICK_TEX) uniform sampler3D cloudBrickTexture;
+layout (binding = QUAD_CLOUD_LIGHT_TEX) uniform sampler3D cloudLightTexture;
+layout (binding = QUAD_WEATHER_TEX) uniform sampler2D weatherTexture;
+layout (binding = QUAD_WEATHER_BOUND_TEX) uniform sampler2D weatherBoundTexture;
+layout (binding = QUAD_CLOUD_SCATTER_TEX) uniform sampler2D cloudScatterTexture;
 layout (binding = QUAD_PREV_SCREEN_TEX) uniform sampler2D prevMainTexture;
+layout (binding = QUAD_SKYVIEW_TEX) uniform sampler2D skyViewTexture;
+layout (binding = QUAD_SCENE_DEPTH_TEX) uniform sampler2D sceneDepthTexture;
+layout (binding = QUAD_CLOUD_COST_TEX, rgba32f) uniform writeonly image2D cloudCostTexture;
 
 layout(location = 0) out vec4 c;
 
-#include "raymarch.h"
+#include "cloudpass.h"
 
 
 void main()
 {	
-    Ray r;
-    r.mOrigin = near.xyz / near.w;
-    r.mDir = normalize((far.xyz / far.w) - r.mOrigin); 
-
-    vec3 sunDir = length(skyParams.mSunSetting.xyz) > 0 ? normalize(skyParams.mSunSetting.xyz) : vec3(0, 1, 0);
-    vec3 sky = texture(environmentTexture, r.mDir.xyz).xyz;
-    
-    Box b; 
-    float width = 80000.0f;
-    float height = renderParams.mCloudSettings.w;
-    b.mMin = vec3(0.0f, 2000.0f, 0.0f) + vec3(-width, 0, -width);
-    b.mMax = vec3(0.0f, 2000.0f, 0.0f) + vec3(width, height, width);
-
-    float tMin = 0.0f;
-    float tMax = 0.0f;
-    const bool foundIntersection = r.mDir.y > 0 && intersect(b, r, tMin, tMax);
-    
-    vec3 sunPos = skyParams.mSunSetting.xyz * 800000.0f;
-    
-    bool hasClouds = false;
-    vec4 cloudColor = vec4(0.0f);
-    float transmittance = 1.0f;
-
-    if(foundIntersection)
-    {
-        float offset = texture(noiseTexture, uv * renderParams.mScreenSettings.xy / BLUENOISE_RESOLUTION).x;
-        offset = fract(offset + renderParams.mScreenSettings.z * 1.61803398875f);
-        raymarchCloud(
-            r, 
-            b,
-            offset,
-            height,
-            renderParams.mCloudSettings.z,
-            renderParams.mCloudMapping.xy, 
-            renderParams.mSteps.x, 
-            renderParams.mSteps.y, 
-            tMin, 
-            tMax, 
-            sunPos, 
-            skyParams.mSunLuminance,
-            hasClouds, 
-            cloudColor, 
-            transmittance);
-    }
+    vec4 nearPos = near;
+    vec4 farPos = far;
+    vec2 pixelUV = uv;
 
-    transmittance = clamp(transmittance, 0.0f, 1.0f);
-    if(transmittance < 1.0f)
+    // amortized mode renders one pixel per bayer block into the sparse target,
+    // move the ray from the block center onto this frame's pixel of the block
+    const int blockSize = renderParams.mTemporalSettings.x;
+    if (blockSize > 1)
     {
-        hasClouds = true;
+        const vec2 screenSize = vec2(textureSize(prevMainTexture, 0));
+        const vec2 pixel = vec2(ivec2(gl_FragCoord.xy) * blockSize + renderParams.mTemporalSettings.zw) + 0.5f;
+        const vec2 shift = (pixel / screenSize - uv) / vec2(dFdx(uv).x, dFdy(uv).y);
+        nearPos += dFdx(near) * shift.x + dFdy(near) * shift.y;
+        farPos += dFdx(far) * shift.x + dFdy(far) * shift.y;
+        pixelUV = pixel / screenSize;
     }
 
-    if(foundIntersection && hasClouds)
-    {
-        c = vec4(sky.xyz * transmittance + cloudColor.xyz * (1 - transmittance), 1.0f);
-
-        // temporal reprojection + taa
-        if (renderParams.mScreenSettings.z > 1 &&
-            oldUV.x >= 0.0f && oldUV.x <= 1.0f &&
-            oldUV.y >= 0.0f && oldUV.y <= 1.0f)
-        {
-            const vec3 prevFrame1 = texture(prevMainTexture, oldUV).xyz;
-            const vec3 prevFrame2 = texture(prevMainTexture, oldUV + vec2(1 / renderParams.mScreenSettings.x, 0.0f)).xyz;
-            const vec3 prevFrame3 = texture(prevMainTexture, oldUV + vec2(0.0f, 1 / renderParams.mScreenSettings.y)).xyz;
-            const vec3 prevFrame4 = texture(prevMainTexture, oldUV - vec2(1 / renderParams.mScreenSettings.x, 0.0f)).xyz;
-            const vec3 prevFrame5 = texture(prevMainTexture, oldUV - vec2(0.0f, 1 / renderParams.mScreenSettings.y)).xyz;
+    Ray r;
+    r.mOrigin = nearPos.xyz / nearPos.w;
+    r.mDir = normalize((farPos.xyz / farPos.w) - r.mOrigin); 
 
-            const vec3 prevFrame = (prevFrame1 * 2 + prevFrame2 + prevFrame3 + prevFrame4 + prevFrame5) / 6;
+    const Box b = cloudLayer();
+    float tMin;
+    float tMax;
+    const bool foundIntersection = cloudInterval(r, b, pixelUV, tMin, tMax);
 
-            c = vec4(mix(prevFrame.xyz, c.xyz, 0.5f), 1.0f);
-        }
-    }
-    else
-    {
-        c = vec4(sky, 1.0f);
-    }
+    c = shadeCloudPixel(r, b, pixelUV, oldUV, foundIntersection, tMin, tMax);
+    storeCloudCost(pixelUV);
 }
\ No newline at end of file
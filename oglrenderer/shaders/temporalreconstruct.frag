@@ -0,0 +1,70 @@
+#version 450 core
+#define GLSL_SHADER
+#extension GL_EXT_scalar_block_layout : require
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 near;
+layout(location = 3) in vec4 far;
+layout(location = 4) in vec2 oldUV;
+
+layout(std430, binding = RENDERER_PARAMS) uniform RendererParamsUniform
+{
+	RendererParams renderParams;
+};
+layout (binding = RECONSTRUCT_SPARSE_TEX) uniform sampler2D sparseTexture;
+layout (binding = RECONSTRUCT_PREV_SCREEN_TEX) uniform sampler2D prevMainTexture;
+
+layout(location = 0) out vec4 c;
+
+
+// rebuilds the full low res image from the 1-in-n pixels raymarched this frame. the pixel
+// rendered this frame is taken as is (blended with history), the others reproject the history
+// and clamp it to the neighborhood of this frame's samples. alpha stores whether the pixel
+// holds valid history, pixels without it are filled spatially until their own sample comes in
+void main()
+{
+    const int blockSize = renderParams.mTemporalSettings.x;
+    const ivec2 pixel = ivec2(gl_FragCoord.xy);
+    const ivec2 block = pixel / blockSize;
+    const ivec2 sparseSize = textureSize(sparseTexture, 0);
+    const vec3 fresh = texelFetch(sparseTexture, min(block, sparseSize - 1), 0).xyz;
+    const bool rendered = all(equal(pixel - block * blockSize, renderParams.mTemporalSettings.zw));
+
+    // color box of this frame's samples around the block
+    vec3 minColor = fresh;
+    vec3 maxColor = fresh;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            const vec3 neighbor = texelFetch(sparseTexture, clamp(block + ivec2(x, y), ivec2(0), sparseSize - 1), 0).xyz;
+            minColor = min(minColor, neighbor);
+            maxColor = max(maxColor, neighbor);
+        }
+    }
+
+    // history is only trusted once every pixel of the block was rendered since the last reset,
+    // the bilinear alpha is below one as soon as one of the four history pixels was invalid
+    const bool onScreen = oldUV.x >= 0.0f && oldUV.x <= 1.0f && oldUV.y >= 0.0f && oldUV.y <= 1.0f;
+    const vec4 history = onScreen ? texture(prevMainTexture, oldUV) : vec4(0.0f);
+    const bool historyValid = onScreen &&
+                              history.w > 0.99f &&
+                              renderParams.mTemporalSettings.y >= blockSize * blockSize;
+    const vec3 clampedHistory = clamp(history.xyz, minColor, maxColor);
+
+    if (rendered)
+    {
+        c = vec4(historyValid ? mix(clampedHistory, fresh, 0.5f) : fresh, 1.0f);
+    }
+    else if (historyValid)
+    {
+        c = vec4(clampedHistory, 1.0f);
+    }
+    else
+    {
+        c = vec4(texture(sparseTexture, uv).xyz, 0.0f);
+    }
+}
@@ -5,6 +5,7 @@
 #include "bsdf.h"
 #include "deviceconstants.h"
 #include "devicestructs.h"
+#include "skyview.h"
 
 layout(location = 1) in vec3 position;
 layout(location = 2) in vec2 uv;
@@ -36,6 +37,7 @@ layout(binding = WATER_FOAM_TEX) uniform sampler2D foamTex;
 layout(binding = WATER_IRRADIANCE) uniform samplerCube irradianceTex;
 layout(binding = WATER_PREFILTER_ENV) uniform samplerCube prefilterTex;
 layout(binding = WATER_PRECOMPUTED_GGX) uniform sampler2D precomputedGGXTex;
+layout(binding = WATER_SKYVIEW_TEX) uniform sampler2D skyViewTex;
 
 layout(location = 0) out vec4 c;
 
@@ -99,6 +101,8 @@ void main()
 	// direct specular and indirect specular components
 	const vec3 sunColor = (skyParams.mPrecomputeSettings.y == NISHITA_SKY) ? 
 						  texture(environmentTex, skyParams.mSunSetting.xyz).xyz : 
+						  (skyParams.mPrecomputeSettings.y == SKYVIEW_SKY) ?
+						  sampleSkyView(skyViewTex, skyParams.mSunSetting.xyz) :
 						  vec3(1.0f);
 	vec3 indirectReflection;
 
@@ -126,7 +130,11 @@ void main()
 	//else
 	{	
 		//indirectReflection = max(texture(environmentTex, rayDir).xyz, 0.0f);
-		radiance += mix(transmission, oceanParams.mReflection.xyz * max(texture(environmentTex, rayDir).xyz, 0.0f), ggx.z);
+		// the environment cubemap pass reflects the sky-view lut directly, the final pass keeps the cubemap with clouds
+		const vec3 reflection = (skyParams.mPrecomputeSettings.y == SKYVIEW_SKY && renderParams.mSettings.z != 0) ?
+								sampleSkyView(skyViewTex, rayDir) :
+								texture(environmentTex, rayDir).xyz;
+		radiance += mix(transmission, oceanParams.mReflection.xyz * max(reflection, 0.0f), ggx.z);
 	}
 
 	if(jacobian < oceanParams.mFoamSettings.y)
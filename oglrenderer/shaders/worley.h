@@ -3,6 +3,8 @@
 
 #include "random.h"
 
+#include "cpuglslbegin.h"
+
 float worley(
     const vec2  uv,
     const float time,
@@ -23,7 +25,7 @@ float worley(
             vec2 point = random2(iUV + neighbor);
 
             // Animate the point
-            point = 0.5 + 0.5 * sin(time + 6.2831 * point);
+            point = 0.5f + 0.5f * sin(time + 6.2831f * point);
 
             // Vector between the pixel and the point
             const vec2 diff = neighbor + point - fUV;
@@ -68,7 +70,7 @@ float worley3D(
                 vec3 point = random3(iUV + neighbor);
 
                 // Animate the point
-                point = 0.5 + 0.5 * sin(time + 6.2831 * point);
+                point = 0.5f + 0.5f * sin(time + 6.2831f * point);
 
                 // Vector between the pixel and the point
                 const vec3 diff = neighbor + point - fUV;
@@ -89,4 +91,6 @@ float worley3D(
     return minDist;
 }
 
+#include "cpuglslend.h"
+
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+# include <direct.h>
+# define CLOUD_NOISE_CACHE_MKDIR(path) _mkdir(path)
+#else
+# include <sys/stat.h>
+# define CLOUD_NOISE_CACHE_MKDIR(path) mkdir(path, 0755)
+#endif
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+
+#define CLOUD_NOISE_CACHE_DIRECTORY  "./resources/cloudcache"
+#define CLOUD_NOISE_CACHE_MAGIC      0x4E444C43
+#define CLOUD_NOISE_CACHE_VERSION    3
+// frames the noise parameters have to stay unchanged before a bake is written to disk
+#define CLOUD_NOISE_CACHE_SAVE_DELAY 60
+
+// the cpu bake only matches the compute shader to rounding, so its files are kept apart
+enum CloudNoiseSource
+{
+    CLOUD_NOISE_GPU = 0,
+    CLOUD_NOISE_CPU = 1
+};
+
+
+struct CloudNoiseKey
+{
+    uint32_t mResolution;
+    uint32_t mOctaves;
+    // bit pattern of the perlin frequency
+    uint32_t mFrequency;
+    // CloudNoiseSource that baked the file
+    uint32_t mSource;
+
+    bool operator==(const CloudNoiseKey &rhs) const
+    {
+        return memcmp(this, &rhs, sizeof(CloudNoiseKey)) == 0;
+    }
+};
+
+
+// baked cloud noise on disk, one file per set of noise parameters. a file holds the rgba8
+// detail channels followed by the rg8 base shape, both at the top mip level
+class CloudNoiseCache
+{
+public:
+
+    // only the parameters precomputecloud.comp reads go into the key
+    static CloudNoiseKey makeKey(
+        const NoiseParams      &perlinParams,
+        const CloudNoiseSource  source = CLOUD_NOISE_GPU)
+    {
+        CloudNoiseKey key;
+        memset(&key, 0, sizeof(CloudNoiseKey));
+        key.mResolution = CLOUD_RESOLUTION;
+        key.mOctaves = uint32_t(perlinParams.mNoiseOctaves);
+        memcpy(&key.mFrequency, &perlinParams.mSettings.z, sizeof(float));
+        key.mSource = uint32_t(source);
+        return key;
+    }
+
+
+    static bool load(
+        const CloudNoiseKey  &key,
+        std::vector<uint8_t> &detail,
+        std::vector<uint8_t> &shape)
+    {
+        FILE* file = fopen(fileName(key).c_str(), "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        const uint32_t voxelCount = key.mResolution * key.mResolution * key.mResolution;
+        uint32_t header[3] = { 0, 0, 0 };
+        CloudNoiseKey storedKey;
+        bool valid = (fread(header, sizeof(header), 1, file) == 1) &&
+                     (fread(&storedKey, sizeof(CloudNoiseKey), 1, file) == 1) &&
+                     (header[0] == CLOUD_NOISE_CACHE_MAGIC) &&
+                     (header[1] == CLOUD_NOISE_CACHE_VERSION) &&
+                     (header[2] == voxelCount) &&
+                     (storedKey == key);
+
+        if (valid)
+        {
+            detail.resize(size_t(voxelCount) * 4);
+            shape.resize(size_t(voxelCount) * 2);
+            valid = (fread(detail.data(), 1, detail.size(), file) == detail.size()) &&
+                    (fread(shape.data(), 1, shape.size(), file) == shape.size());
+        }
+        fclose(file);
+
+        return valid;
+    }
+
+
+    static bool save(
+        const CloudNoiseKey        &key,
+        const std::vector<uint8_t> &detail,
+        const std::vector<uint8_t> &shape)
+    {
+        CLOUD_NOISE_CACHE_MKDIR(CLOUD_NOISE_CACHE_DIRECTORY);
+        FILE* file = fopen(fileName(key).c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        const uint32_t header[3] = { CLOUD_NOISE_CACHE_MAGIC, CLOUD_NOISE_CACHE_VERSION, uint32_t(detail.size() / 4) };
+        bool written = (fwrite(header, sizeof(header), 1, file) == 1) &&
+                       (fwrite(&key, sizeof(CloudNoiseKey), 1, file) == 1) &&
+                       (fwrite(detail.data(), 1, detail.size(), file) == detail.size()) &&
+                       (fwrite(shape.data(), 1, shape.size(), file) == shape.size());
+        fclose(file);
+
+        return written;
+    }
+
+private:
+
+    static std::string fileName(
+        const CloudNoiseKey &key)
+    {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s/%u_%u_%08x%s.noise", CLOUD_NOISE_CACHE_DIRECTORY, key.mResolution, key.mOctaves, key.mFrequency,
+            (key.mSource == CLOUD_NOISE_CPU) ? "_cpu" : "");
+        return std::string(buf);
+    }
+};
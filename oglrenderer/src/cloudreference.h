@@ -0,0 +1,397 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "FreeImage/FreeImage.h"
+#include "glm/glm.hpp"
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+#include "threadpool.h"
+#include "weathermap.h"
+
+#include "cloud.h"
+
+// cloud.h defines non-inline functions, only include this from renderer.cpp
+
+// pixels per side of a thread pool job
+#define CLOUD_REFERENCE_TILE_SIZE 16
+
+// everything the cloud pass reads from the renderer, sky and camera uniforms
+struct CloudReferenceParams
+{
+    RendererParams mRenderParams;
+    glm::mat4      mInvViewProjection;
+    glm::vec3      mSunDir;
+    glm::vec4      mSunLuminance;
+    // primary and shadow step counts are mRenderParams.mSteps times this
+    int            mStepScale;
+};
+
+
+// cpu port of cloudInterval() and raymarchCloud() on top of the shared cloud.h code. it is the
+// unoptimized march: no empty space or weather skipping, no light volume, no scattering lut,
+// no distance lod and no early exit, so the gpu shortcuts can be measured against it
+class CloudReference
+{
+public:
+    CloudReference(
+        ThreadPool &threadPool)
+        : mThreadPool(threadPool)
+        , mLastTime(0.0f)
+        , mLastSamples(0)
+        , mLastThreads(1)
+    {
+    }
+
+
+    // rg8 base shape as PRECOMP_CLOUD_SHADER writes it, the second mip is box filtered like glGenerateMipmap
+    void setShape(
+        const std::vector<uint8_t> &shape)
+    {
+        const int size = CLOUD_RESOLUTION;
+        mShape[0].resize(size_t(size) * size * size);
+        for (size_t i = 0; i < mShape[0].size(); ++i)
+        {
+            mShape[0][i] = glm::vec2(shape[i * 2 + 0], shape[i * 2 + 1]) / 255.0f;
+        }
+
+        const int half = size / 2;
+        mShape[1].assign(size_t(half) * half * half, glm::vec2(0.0f));
+        for (int z = 0; z < half; ++z)
+        {
+            for (int y = 0; y < half; ++y)
+            {
+                for (int x = 0; x < half; ++x)
+                {
+                    glm::vec2 sum(0.0f);
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        sum += mShape[0][((z * 2 + (i >> 2)) * size + (y * 2 + ((i >> 1) & 1))) * size + (x * 2 + (i & 1))];
+                    }
+                    mShape[1][(z * half + y) * half + x] = sum * 0.125f;
+                }
+            }
+        }
+    }
+
+
+    void setWeather(
+        const WeatherMap &weatherMap)
+    {
+        const uint8_t* texels = weatherMap.texels();
+        mWeather.resize(WEATHER_MAP_RESOLUTION * WEATHER_MAP_RESOLUTION);
+        for (size_t i = 0; i < mWeather.size(); ++i)
+        {
+            mWeather[i] = glm::vec4(texels[i * 4 + 0], texels[i * 4 + 1], texels[i * 4 + 2], texels[i * 4 + 3]) / 255.0f;
+        }
+    }
+
+
+    // same ray as temporalquad.vert for the center of pixel (x, y), row 0 is the bottom row
+    static Ray cameraRay(
+        const glm::mat4 &invViewProjection,
+        const int        x,
+        const int        y,
+        const int        width,
+        const int        height)
+    {
+        const glm::vec2 ndc = glm::vec2((x + 0.5f) / width, (y + 0.5f) / height) * 2.0f - 1.0f;
+        const glm::vec4 nearPos = invViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+        const glm::vec4 farPos = invViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+
+        Ray r;
+        r.mOrigin = glm::vec3(nearPos) / nearPos.w;
+        r.mDir = glm::normalize(glm::vec3(farPos) / farPos.w - r.mOrigin);
+        return r;
+    }
+
+
+    // rgb: in-scattered cloud radiance, w: transmittance. every tile of
+    // CLOUD_REFERENCE_TILE_SIZE pixels is a thread pool job, row 0 is the bottom row
+    std::vector<glm::vec4> render(
+        const CloudReferenceParams &params,
+        const int                   width,
+        const int                   height)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::vector<glm::vec4> image(size_t(width) * height);
+        const int tilesX = (width + CLOUD_REFERENCE_TILE_SIZE - 1) / CLOUD_REFERENCE_TILE_SIZE;
+        const int tilesY = (height + CLOUD_REFERENCE_TILE_SIZE - 1) / CLOUD_REFERENCE_TILE_SIZE;
+        std::atomic<uint64_t> samples(0);
+        mThreadPool.parallelFor(tilesX * tilesY, [&](uint32_t tile)
+        {
+            const int x0 = int(tile % tilesX) * CLOUD_REFERENCE_TILE_SIZE;
+            const int y0 = int(tile / tilesX) * CLOUD_REFERENCE_TILE_SIZE;
+            const int x1 = glm::min(x0 + CLOUD_REFERENCE_TILE_SIZE, width);
+            const int y1 = glm::min(y0 + CLOUD_REFERENCE_TILE_SIZE, height);
+
+            uint64_t tileSamples = 0;
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    image[size_t(y) * width + x] = shade(params, cameraRay(params.mInvViewProjection, x, y, width, height), tileSamples);
+                }
+            }
+            samples += tileSamples;
+        });
+
+        mLastTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        mLastSamples = samples;
+        mLastThreads = mThreadPool.threadCount();
+        return image;
+    }
+
+
+    // the composite of shadeCloudPixel() without the temporal blend
+    static glm::vec3 composite(
+        const glm::vec3 &sky,
+        const glm::vec4 &cloud)
+    {
+        return sky * cloud.w + glm::vec3(cloud) * (1.0f - cloud.w);
+    }
+
+
+    // duration of the last render in ms
+    float lastTime() const
+    {
+        return mLastTime;
+    }
+
+
+    // density lookups of the last render, primary and shadow
+    uint64_t lastSamples() const
+    {
+        return mLastSamples;
+    }
+
+
+    float samplesPerSecondPerCore() const
+    {
+        return (mLastTime > 0.0f) ? float(double(mLastSamples) / (double(mLastTime) * 0.001) / double(mLastThreads)) : 0.0f;
+    }
+
+
+    // float rgba exr, row 0 is the bottom row like freeimage and gl readbacks
+    static bool save(
+        const std::string            &fileName,
+        const std::vector<glm::vec4> &image,
+        const int                     width,
+        const int                     height)
+    {
+        FIBITMAP* dib = FreeImage_AllocateT(FIT_RGBAF, width, height);
+        if (dib == nullptr)
+        {
+            return false;
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            FIRGBAF* line = (FIRGBAF*)FreeImage_GetScanLine(dib, y);
+            for (int x = 0; x < width; ++x)
+            {
+                const glm::vec4& texel = image[size_t(y) * width + x];
+                line[x].red = texel.x;
+                line[x].green = texel.y;
+                line[x].blue = texel.z;
+                line[x].alpha = texel.w;
+            }
+        }
+
+        const bool result = FreeImage_Save(FIF_EXR, dib, fileName.c_str(), EXR_FLOAT) != 0;
+        FreeImage_Unload(dib);
+        return result;
+    }
+
+private:
+
+    // trilinear lookup with repeat wrapping, what textureLod does at an integral lod
+    glm::vec2 sampleShape(
+        const glm::vec3 &uvw,
+        const int        mip) const
+    {
+        const int size = CLOUD_RESOLUTION >> mip;
+        const std::vector<glm::vec2>& texels = mShape[mip];
+
+        const glm::vec3 p = uvw * float(size) - 0.5f;
+        const glm::vec3 p0 = glm::floor(p);
+        const glm::vec3 f = p - p0;
+        const glm::ivec3 i0 = glm::ivec3(p0);
+
+        glm::vec2 result(0.0f);
+        for (int i = 0; i < 8; ++i)
+        {
+            const glm::ivec3 corner = i0 + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2);
+            const glm::ivec3 wrapped = ((corner % size) + size) % size;
+            const glm::vec3 w = glm::mix(1.0f - f, f, glm::vec3(glm::ivec3(i & 1, (i >> 1) & 1, i >> 2)));
+            result += texels[(size_t(wrapped.z) * size + wrapped.y) * size + wrapped.x] * (w.x * w.y * w.z);
+        }
+        return result;
+    }
+
+
+    glm::vec4 sampleWeather(
+        const glm::vec2 &uv) const
+    {
+        const int size = WEATHER_MAP_RESOLUTION;
+        const glm::vec2 p = uv * float(size) - 0.5f;
+        const glm::vec2 p0 = glm::floor(p);
+        const glm::vec2 f = p - p0;
+        const glm::ivec2 i0 = glm::ivec2(p0);
+
+        glm::vec4 result(0.0f);
+        for (int i = 0; i < 4; ++i)
+        {
+            const glm::ivec2 corner = i0 + glm::ivec2(i & 1, i >> 1);
+            const glm::ivec2 wrapped = ((corner % size) + size) % size;
+            const glm::vec2 w = glm::mix(1.0f - f, f, glm::vec2(glm::ivec2(i & 1, i >> 1)));
+            result += mWeather[wrapped.y * size + wrapped.x] * (w.x * w.y);
+        }
+        return result;
+    }
+
+
+    // cloud density at a position of the march, the layer relative position goes in
+    float density(
+        const RendererParams &renderParams,
+        const glm::vec3      &layerUVW,
+        const glm::vec2      &coverageUV,
+        const glm::vec3      &scroll,
+        const int             mip) const
+    {
+        glm::vec3 uvw = layerUVW;
+        uvw.x *= renderParams.mCloudMapping.x;
+        uvw.z *= renderParams.mCloudMapping.y;
+        uvw += scroll;
+
+        const bool useWeather = renderParams.mWeather.x != 0.0f;
+        const glm::vec4 weather = useWeather ? sampleWeather(glm::vec2(layerUVW.x, layerUVW.z)) : glm::vec4(1.0f);
+        const float coverage = (hash12(coverageUV) * 0.1f + (renderParams.mCloudMapping.z * 0.5f + 0.5f)) * weather.x;
+        float base = cloudBaseDensity(sampleShape(uvw, mip), coverage);
+        if (useWeather)
+        {
+            base *= cloudHeightProfile(layerUVW.y, weather);
+        }
+        return base;
+    }
+
+
+    glm::vec4 shade(
+        const CloudReferenceParams &params,
+        Ray                         r,
+        uint64_t                   &samples) const
+    {
+        const RendererParams& renderParams = params.mRenderParams;
+
+        const Box b = cloudLayerBox(renderParams.mCloudSettings.w);
+        const glm::vec3 layerSize = b.mMax - b.mMin;
+        const float height = layerSize.y;
+
+        float tMin = 0.0f;
+        float tMax = 0.0f;
+        bool foundIntersection = r.mDir.y > 0.0f && intersect(b, r, tMin, tMax);
+        if (renderParams.mWeather.x != 0.0f)
+        {
+            Box slab = b;
+            slab.mMin.y = b.mMin.y + height * renderParams.mWeather.y;
+            slab.mMax.y = b.mMin.y + height * renderParams.mWeather.z;
+
+            float slabMin = 0.0f;
+            float slabMax = 0.0f;
+            foundIntersection = foundIntersection &&
+                                (slab.mMax.y > slab.mMin.y) &&
+                                intersect(slab, r, slabMin, slabMax);
+            tMin = glm::max(tMin, slabMin);
+            tMax = glm::min(tMax, slabMax);
+        }
+
+        glm::vec4 cloudColor(0.0f);
+        float transmittance = 1.0f;
+        if (!foundIntersection || tMin <= 0.0f || tMax <= tMin)
+        {
+            return glm::vec4(glm::vec3(cloudColor), transmittance);
+        }
+
+        const int maxSteps = renderParams.mSteps.x * params.mStepScale;
+        const int shadowMaxSteps = renderParams.mSteps.y * params.mStepScale;
+        const float densityScale = renderParams.mCloudSettings.z * 0.001f;
+        const float absorption = renderParams.mCloudAbsorption.x;
+        const glm::vec3 sunPos = params.mSunDir * CLOUD_SUN_DISTANCE;
+
+        // the deterministic half step offset replaces the blue noise
+        const glm::vec3 scroll = cloudWindScroll(renderParams.mSettings.x, renderParams.mCloudSettings.y);
+        const float stepLength = (tMax - tMin) / float(maxSteps);
+        const float shadowStepLength = height * 0.5f / float(shadowMaxSteps);
+        r.mOrigin = r.mOrigin + r.mDir * (tMin + stepLength * 0.5f);
+        float t = tMin + stepLength * 0.5f;
+
+        for (int i = 0; i < maxSteps && t <= tMax; ++i)
+        {
+            const glm::vec3 layerUVW = (r.mOrigin - b.mMin) / layerSize;
+
+            // raymarchCloud hashes the scrolled primary position for every coverage lookup
+            glm::vec3 uvw = layerUVW;
+            uvw.x *= renderParams.mCloudMapping.x;
+            uvw.z *= renderParams.mCloudMapping.y;
+            uvw += scroll;
+            const glm::vec2 coverageUV = glm::vec2(uvw.x, uvw.z);
+
+            ++samples;
+            const float base = density(renderParams, layerUVW, coverageUV, scroll, 0);
+
+            Ray shadowRay;
+            shadowRay.mOrigin = r.mOrigin;
+            shadowRay.mDir = glm::normalize(sunPos - shadowRay.mOrigin);
+
+            float lightRayDensity = 0.0f;
+            if (transmittance < 1.0f)
+            {
+                for (int j = 0; j < shadowMaxSteps; ++j)
+                {
+                    float shadowtMin = 0.0f;
+                    float shadowtMax = 0.0f;
+                    if (!intersect(b, shadowRay, shadowtMin, shadowtMax))
+                    {
+                        break;
+                    }
+
+                    ++samples;
+                    const glm::vec3 shadowLayerUVW = (shadowRay.mOrigin - b.mMin) / layerSize;
+                    lightRayDensity += density(renderParams, shadowLayerUVW, coverageUV, scroll, int(CLOUD_SHADOW_LOD)) * densityScale;
+                    shadowRay.mOrigin = shadowRay.mOrigin + shadowStepLength * shadowRay.mDir;
+                }
+            }
+
+            // the octaves are evaluated directly instead of through the scattering lut
+            const float opticalDepth = shadowStepLength * lightRayDensity * absorption;
+            const glm::vec4 luminance = params.mSunLuminance * cloudMultiScatter(glm::dot(shadowRay.mDir, r.mDir), opticalDepth, renderParams.mCloudSettings.x) * base;
+
+            const float rayTransmittance = exp(-stepLength * base * densityScale * absorption);
+            const glm::vec4 integralScattering = (luminance - luminance * rayTransmittance) / glm::max(0.01f, base * absorption);
+            cloudColor += integralScattering * transmittance;
+            transmittance *= rayTransmittance;
+
+            r.mOrigin = r.mOrigin + r.mDir * stepLength;
+            t += stepLength;
+        }
+
+        return glm::vec4(glm::vec3(cloudColor), glm::clamp(transmittance, 0.0f, 1.0f));
+    }
+
+
+    ThreadPool &mThreadPool;
+
+    // base shape at mip 0 and CLOUD_SHADOW_LOD
+    std::vector<glm::vec2> mShape[2];
+    std::vector<glm::vec4> mWeather;
+
+    float mLastTime;
+    uint64_t mLastSamples;
+    uint32_t mLastThreads;
+};
@@ -1,24 +1,72 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include "HosekSky/ArHosekSkyModel.h"
 
 #include "glm/glm.hpp"
+#include "deviceconstants.h"
+#include "devicestructs.h"
+#include "hosekbatch.h"
 #include "texture.h"
+#include "threadpool.h"
+
+// number of persistently mapped staging buffers, each holds all six faces
+#define HOSEK_PBO_RING_SIZE 2
+
+// max abs difference per channel between the gpu and cpu evaluation
+#define HOSEK_PARITY_TOLERANCE 1e-3f
+
+// max relative error of hosekRadianceBatch against the double precision arhosek evaluation
+#define HOSEK_BATCH_TOLERANCE 2e-5f
+
+// share of the hardware threads the background regeneration runs on, it has its own pool so
+// parallel loops on the render thread never wait for a bake
+#define HOSEK_JOB_THREAD_DIVISOR 2
 
 class Hosek
 {
 public:
     Hosek(
+        ThreadPool      &threadPool,
         const glm::vec3 sunDir,
         const uint32_t  textureSize)
-        : mSunDir(sunDir)
+        : mThreadPool(&threadPool)
+        , mJobPool(glm::max(std::thread::hardware_concurrency() / HOSEK_JOB_THREAD_DIVISOR, 1u))
+        , mState(nullptr)
+        , mSunDir(sunDir)
         , mTexSize(textureSize)
-        , mCubemap(textureSize)
-        , mDataR(nullptr)
-        , mDataG(nullptr)
-        , mDataB(nullptr)
+        , mFrontIdx(0)
+        , mJobDone(false)
+        , mJobCancel(false)
+        , mJobRunning(false)
+        , mJobSlot(0)
+        , mUpdatePending(false)
+        , mPendingSunDir(sunDir)
+        , mPendingKeep(false)
+        , mSwapPending(false)
+        , mSwapSlot(0)
     {
-        mSkyBoxData.resize(6);
+        mSkyBoxData.resize(6 * mTexSize * mTexSize);
+        mCubemaps[0] = std::make_unique<TextureCubemap>(textureSize);
+        mCubemaps[1] = std::make_unique<TextureCubemap>(textureSize);
+
+        // staging ring the background job writes into directly
+        const GLsizeiptr slotSize = GLsizeiptr(mSkyBoxData.size() * sizeof(glm::vec4));
+        const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(HOSEK_PBO_RING_SIZE, mPbos);
+        for (int i = 0; i < HOSEK_PBO_RING_SIZE; ++i)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbos[i]);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotSize, nullptr, mapFlags);
+            mMappedPbos[i] = (glm::vec4*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotSize, mapFlags);
+            mFences[i] = nullptr;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
         precompute();
     }
@@ -26,71 +74,437 @@ public:
 
     ~Hosek()
     {
-        arhosekskymodelstate_free(mDataR);
-        arhosekskymodelstate_free(mDataG);
-        arhosekskymodelstate_free(mDataB);
+        wait();
+
+        for (int i = 0; i < HOSEK_PBO_RING_SIZE; ++i)
+        {
+            if (mFences[i] != nullptr)
+            {
+                glDeleteSync(mFences[i]);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbos[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(HOSEK_PBO_RING_SIZE, mPbos);
+
+        if (mState != nullptr)
+        {
+            arhosekskymodelstate_free(mState);
+        }
     }
 
 
+    // synchronous compute and upload into the cubemap being sampled
     void precompute()
     {
-        if (mDataR != nullptr) { arhosekskymodelstate_free(mDataR); mDataR = nullptr;}
-        if (mDataG != nullptr) { arhosekskymodelstate_free(mDataG); mDataG = nullptr;}
-        if (mDataB != nullptr) { arhosekskymodelstate_free(mDataB); mDataB = nullptr;}
+        wait();
+        compute();
+        upload();
+    }
 
-        mSunDir.y = glm::clamp(mSunDir.y, 0.0f, 1.0f);
-        mSunDir = glm::normalize(mSunDir);
-        float thetaS = angleBetween(mSunDir, glm::vec3(0.0f, 1.0f, 0.0f));
-        float elevation = PI / 2.0f - thetaS;
-        
-        mDataR = arhosek_xyz_skymodelstate_alloc_init(2.0f, 0.5f, elevation);
-        mDataG = arhosek_xyz_skymodelstate_alloc_init(2.0f, 0.5f, elevation);
-        mDataB = arhosek_xyz_skymodelstate_alloc_init(2.0f, 0.5f, elevation);
+
+    // fills the six faces on the cpu, one job per cubemap row spread over the thread pool
+    // threadCount = 0 uses the whole pool
+    // target holds the faces back to back, nullptr writes into mSkyBoxData
+    void compute(
+        const uint32_t threadCount = 0,
+        glm::vec4*     target      = nullptr)
+    {
+        updateState();
+
+        glm::vec4* faces = (target != nullptr) ? target : mSkyBoxData.data();
+        mThreadPool->parallelFor(6 * mTexSize, [this, faces](uint32_t job)
+        {
+            computeRow(job / mTexSize, job % mTexSize, mSunDir, mCoefficients, faces, nullptr);
+        }, threadCount);
+    }
+
+
+    void upload()
+    {
         for (int s = 0; s < 6; s++)
         {
-            if (mSkyBoxData[s].size() != mTexSize * mTexSize)
+            mCubemaps[mFrontIdx]->upload(s, &mSkyBoxData[s * mTexSize * mTexSize]);
+        }
+    }
+
+
+    // returns texels per second of compute() averaged over a few iterations
+    float benchmark(
+        const uint32_t threadCount,
+        const int      iterations = 4)
+    {
+        wait();
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            compute(threadCount);
+        }
+        const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+        return float(iterations) * 6.0f * float(mTexSize) * float(mTexSize) / elapsed.count();
+    }
+
+    
+    // queues a regeneration on a background job, the previous cubemap stays bound until
+    // the new faces are uploaded. only the latest request is kept while a job is in flight.
+    // cachedFaces skips the evaluation and only streams the given faces, keepFaces has the job
+    // hand out a copy of what it evaluated through fetchComputed()
+    void update(
+        const glm::vec3                               sunDir,
+        std::shared_ptr<const std::vector<glm::vec4>> cachedFaces = nullptr,
+        const bool                                    keepFaces   = true)
+    {
+        mPendingSunDir = sunDir;
+        mPendingFaces = cachedFaces;
+        mPendingKeep = keepFaces;
+        mUpdatePending = true;
+        poll();
+    }
+
+
+    // returns the faces evaluated by the last finished job (not the cached ones) once
+    std::shared_ptr<const std::vector<glm::vec4>> fetchComputed(
+        glm::vec3 &sunDir)
+    {
+        sunDir = mComputedSunDir;
+        std::shared_ptr<const std::vector<glm::vec4>> faces = mComputedFaces;
+        mComputedFaces = nullptr;
+        return faces;
+    }
+
+
+    // called once per frame on the render thread to advance the background regeneration
+    void poll()
+    {
+        // 1. swap once the gpu has consumed the staging buffer
+        if (mSwapPending && isSignaled(mFences[mSwapSlot]))
+        {
+            mFrontIdx = 1 - mFrontIdx;
+            mSwapPending = false;
+        }
+
+        // 2. stream finished faces from the staging buffer into the back cubemap
+        if (mJobRunning && mJobDone && !mSwapPending)
+        {
+            mJob.join();
+            mJobRunning = false;
+            if (mJobFaces != nullptr)
+            {
+                mComputedSunDir = mJobSunDir;
+                mComputedFaces = mJobFaces;
+            }
+
+            const uint32_t backIdx = 1 - mFrontIdx;
+            const size_t faceSize = size_t(mTexSize) * mTexSize * sizeof(glm::vec4);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbos[mJobSlot]);
+            for (int s = 0; s < 6; s++)
+            {
+                mCubemaps[backIdx]->uploadSubImage(s, (void*)(s * faceSize));
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            if (mFences[mJobSlot] != nullptr)
+            {
+                glDeleteSync(mFences[mJobSlot]);
+            }
+            mFences[mJobSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            mSwapSlot = mJobSlot;
+            mSwapPending = true;
+            mJobSlot = (mJobSlot + 1) % HOSEK_PBO_RING_SIZE;
+        }
+
+        // 3. kick off the next job once its staging buffer is no longer read by the gpu
+        if (mUpdatePending && !mJobRunning && isSignaled(mFences[mJobSlot]))
+        {
+            mJobSunDir = mPendingSunDir;
+            mUpdatePending = false;
+            mJobDone = false;
+            mJobCancel = false;
+            mJobRunning = true;
+
+            glm::vec4* target = mMappedPbos[mJobSlot];
+            std::shared_ptr<const std::vector<glm::vec4>> cachedFaces = mPendingFaces;
+            mPendingFaces = nullptr;
+            mJobFaces = nullptr;
+            if ((cachedFaces == nullptr) && mPendingKeep)
+            {
+                mJobFaces = std::make_shared<std::vector<glm::vec4>>(mSkyBoxData.size());
+            }
+
+            // the job only reads what it is handed here, the members stay with the render thread
+            const glm::vec3 sunDir = mJobSunDir;
+            glm::vec4* copy = (mJobFaces != nullptr) ? mJobFaces->data() : nullptr;
+            mJob = std::thread([this, sunDir, target, copy, cachedFaces]()
+            {
+                if (cachedFaces != nullptr)
+                {
+                    memcpy(target, cachedFaces->data(), cachedFaces->size() * sizeof(glm::vec4));
+                }
+                else
+                {
+                    glm::vec3 jobSunDir = sunDir;
+                    ArHosekSkyModelState* state = allocState(jobSunDir);
+                    const HosekCoefficients coefficients = hosekCoefficients(state);
+                    arhosekskymodelstate_free(state);
+
+                    // rows go straight into the mapped staging slot, a cancel skips the rest
+                    mJobPool.parallelFor(6 * mTexSize, [this, &jobSunDir, &coefficients, target, copy](uint32_t job)
+                    {
+                        if (!mJobCancel)
+                        {
+                            computeRow(job / mTexSize, job % mTexSize, jobSunDir, coefficients, target, copy);
+                        }
+                    });
+                }
+                mJobDone = true;
+            });
+        }
+    }
+
+
+    // coefficients for PRECOMP_HOSEK_SHADER, cpu work in flight is dropped since the
+    // caller writes the result straight into cubemap()
+    HosekSkyParams prepareGPU(
+        const glm::vec3 sunDir)
+    {
+        cancel();
+        mSunDir = sunDir;
+        updateState();
+
+        HosekSkyParams params;
+        params.mSunDir = glm::vec4(mSunDir, 0.0f);
+        memcpy(params.mConfigs, mCoefficients.mConfigs, sizeof(params.mConfigs));
+        memcpy(params.mRadiances, mCoefficients.mRadiances, sizeof(params.mRadiances));
+        return params;
+    }
+
+
+    // max relative error of the batched float kernel against the double precision
+    // arhosek_tristim_skymodel_radiance for every cubemap texel and xyz channel
+    float batchError(
+        const glm::vec3 sunDir)
+    {
+        cancel();
+        mSunDir = sunDir;
+        updateState();
+
+        std::vector<float> rowErrors(6 * mTexSize, 0.0f);
+        mThreadPool->parallelFor(6 * mTexSize, [this, &rowErrors](uint32_t job)
+        {
+            const int s = job / mTexSize;
+            const int y = job % mTexSize;
+            std::vector<float> scratch(mTexSize * 5);
+            float* cosTheta = &scratch[0];
+            float* cosGamma = &scratch[mTexSize];
+            float* radiance[3] = { &scratch[mTexSize * 2], &scratch[mTexSize * 3], &scratch[mTexSize * 4] };
+            for (uint32_t x = 0; x < mTexSize; x++)
             {
-                mSkyBoxData[s].resize(mTexSize * mTexSize);
+                const glm::vec3 dir = xyToRayDir(x, y, s, mTexSize, mTexSize);
+                cosTheta[x] = dir.y;
+                cosGamma[x] = glm::dot(dir, mSunDir);
             }
+            hosekRadianceBatch(mCoefficients, cosTheta, cosGamma, radiance[0], radiance[1], radiance[2], mTexSize);
 
-            for (int y = 0; y < mTexSize; y++)
+            double maxError = 0.0;
+            for (uint32_t x = 0; x < mTexSize; x++)
             {
-                for (int x = 0; x < mTexSize; x++)
+                const glm::dvec3 reference = referenceRadiance(cosTheta[x], cosGamma[x]);
+                for (int channel = 0; channel < 3; ++channel)
                 {
-                    glm::vec3 dir = xyToRayDir(x, y, s, mTexSize, mTexSize);
-                    glm::vec3 radiance = sampleSky(dir);
-                    int idx = (y * mTexSize) + x;
-                    mSkyBoxData[s][idx] = glm::vec4(glm::normalize(radiance), 1.0f);
+                    const double error = glm::abs(double(radiance[channel][x]) - reference[channel]) / glm::max(glm::abs(reference[channel]), 1e-12);
+                    maxError = glm::max(maxError, error);
                 }
             }
+            rowErrors[job] = float(maxError);
+        });
 
-            mCubemap.upload(s, mSkyBoxData[s].data());
+        float maxError = 0.0f;
+        for (const float error : rowErrors)
+        {
+            maxError = glm::max(maxError, error);
         }
+        return maxError;
     }
 
-    
-    void update(
+
+    // synchronous double precision arhosek evaluation of every texel, the reference for the
+    // gpu and the batched path. slow, only for the parity checks
+    const std::vector<glm::vec4>& computeReference(
         const glm::vec3 sunDir)
     {
+        cancel();
         mSunDir = sunDir;
-        precompute();
+        updateState();
+
+        mThreadPool->parallelFor(6 * mTexSize, [this](uint32_t job)
+        {
+            const int s = job / mTexSize;
+            const int y = job % mTexSize;
+            glm::vec4* row = &mSkyBoxData[(s * mTexSize + y) * mTexSize];
+            for (uint32_t x = 0; x < mTexSize; x++)
+            {
+                const glm::vec3 dir = xyToRayDir(x, y, s, mTexSize, mTexSize);
+                const glm::vec3 radiance = glm::vec3(referenceRadiance(dir.y, glm::dot(dir, mSunDir)));
+                row[x] = glm::vec4(glm::normalize(xyzToRGB(radiance)), 1.0f);
+            }
+        });
+        return mSkyBoxData;
+    }
+
+
+    // stops the background job after the rows in flight and drops every queued update
+    void cancel()
+    {
+        if (mJobRunning)
+        {
+            mJobCancel = true;
+            mJob.join();
+            mJobRunning = false;
+        }
+        mUpdatePending = false;
+        mPendingFaces = nullptr;
+        mSwapPending = false;
+    }
+
+
+    // stops the background job after the rows in flight and queues its sun direction again
+    void wait()
+    {
+        if (mJobRunning)
+        {
+            mJobCancel = true;
+            mJob.join();
+            mJobRunning = false;
+            mUpdatePending = true;
+        }
+    }
+
+
+    bool busy() const
+    {
+        return mJobRunning || mUpdatePending || mSwapPending;
+    }
+
+
+    uint32_t size() const
+    {
+        return mTexSize;
     }
 
 
     uint32_t texId() const
     {
-        return mCubemap.texId();
+        return mCubemaps[mFrontIdx]->texId();
+    }
+
+
+    TextureCubemap& cubemap()
+    {
+        return *mCubemaps[mFrontIdx];
     }
 
 
     void bind(
         const uint32_t texUnit)
     {
-        mCubemap.bindTexture(texUnit);
+        mCubemaps[mFrontIdx]->bindTexture(texUnit);
     }
 
 private:
 
+    // render thread only, the background job builds its own state
+    void updateState()
+    {
+        if (mState != nullptr) { arhosekskymodelstate_free(mState); mState = nullptr; }
+
+        mState = allocState(mSunDir);
+        mCoefficients = hosekCoefficients(mState);
+    }
+
+
+    // clamps sunDir above the horizon, the caller frees the state
+    static ArHosekSkyModelState* allocState(
+        glm::vec3 &sunDir)
+    {
+        sunDir.y = glm::clamp(sunDir.y, 0.0f, 1.0f);
+        sunDir = glm::normalize(sunDir);
+        float thetaS = angleBetween(sunDir, glm::vec3(0.0f, 1.0f, 0.0f));
+        float elevation = PI / 2.0f - thetaS;
+
+        // all three tristimulus channels live in the same state
+        return arhosek_xyz_skymodelstate_alloc_init(2.0f, 0.5f, elevation);
+    }
+
+
+    static bool isSignaled(
+        GLsync fence)
+    {
+        if (fence == nullptr)
+        {
+            return true;
+        }
+        const GLenum result = glClientWaitSync(fence, 0, 0);
+        return (result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED);
+    }
+
+
+    // copy, when given, receives the same row as faces
+    void computeRow(
+        const int                s,
+        const int                y,
+        const glm::vec3         &sunDir,
+        const HosekCoefficients &coefficients,
+        glm::vec4*               faces,
+        glm::vec4*               copy) const
+    {
+        // structure-of-arrays scratch per worker thread
+        thread_local std::vector<float> scratch;
+        scratch.resize(mTexSize * 5);
+        float* cosTheta = &scratch[0];
+        float* cosGamma = &scratch[mTexSize];
+        float* radianceX = &scratch[mTexSize * 2];
+        float* radianceY = &scratch[mTexSize * 3];
+        float* radianceZ = &scratch[mTexSize * 4];
+
+        for (uint32_t x = 0; x < mTexSize; x++)
+        {
+            const glm::vec3 dir = xyToRayDir(x, y, s, mTexSize, mTexSize);
+            cosTheta[x] = dir.y;
+            cosGamma[x] = glm::dot(dir, sunDir);
+        }
+
+        hosekRadianceBatch(coefficients, cosTheta, cosGamma, radianceX, radianceY, radianceZ, mTexSize);
+
+        // faces may be write combined memory, so the copy is stored alongside instead of read back
+        const size_t rowOffset = size_t(s * mTexSize + y) * mTexSize;
+        glm::vec4* row = &faces[rowOffset];
+        glm::vec4* copyRow = (copy != nullptr) ? &copy[rowOffset] : nullptr;
+        for (uint32_t x = 0; x < mTexSize; x++)
+        {
+            const glm::vec4 rgb = glm::vec4(glm::normalize(xyzToRGB(glm::vec3(radianceX[x], radianceY[x], radianceZ[x]))), 1.0f);
+            row[x] = rgb;
+            if (copyRow != nullptr)
+            {
+                copyRow[x] = rgb;
+            }
+        }
+    }
+
+
+    static glm::vec3 xyzToRGB(
+        const glm::vec3 &radiance)
+    {
+        glm::vec3 rgb;
+        rgb.x =  3.2404542f*radiance.x - 1.5371385f*radiance.y - 0.4985314f*radiance.z;
+        rgb.y = -0.9692660f*radiance.x + 1.8760108f*radiance.y + 0.0415560f*radiance.z;
+        rgb.z =  0.0556434f*radiance.x - 0.2040259f*radiance.y + 1.0572252f*radiance.z;
+
+        return rgb * 2.0f * PI / 683.0f;
+    }
+
+
     static glm::vec3 xyToRayDir(
         const int x,
         const int y,
@@ -129,7 +543,7 @@ private:
         return dir;
     }
 
-    float angleBetween(
+    static float angleBetween(
         const glm::vec3 &dir0, 
         const glm::vec3 &dir1)
     {
@@ -137,33 +551,56 @@ private:
     }
 
 
-    glm::vec3 sampleSky(
-        const glm::vec3 dir)
+    // scalar double precision xyz radiance for the same cosines and clamps the batched path
+    // gets, the angles are taken in double so only the kernel itself is compared
+    glm::dvec3 referenceRadiance(
+        const float cosTheta,
+        const float cosGamma) const
     {
-        const float gamma = angleBetween(dir, mSunDir);
-        const float theta = angleBetween(dir, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        glm::vec3 radiance;
+        const double theta = acos(glm::clamp(double(cosTheta), 0.00001, 1.0));
+        const double gamma = acos(glm::clamp(double(cosGamma), 0.00001, 1.0));
 
-        radiance.x = float(arhosek_tristim_skymodel_radiance(mDataR, theta, gamma, 0));
-        radiance.y = float(arhosek_tristim_skymodel_radiance(mDataG, theta, gamma, 1));
-        radiance.z = float(arhosek_tristim_skymodel_radiance(mDataB, theta, gamma, 2));
-
-        glm::vec3 rgb;
-        rgb.x =  3.2404542f*radiance.x - 1.5371385f*radiance.y - 0.4985314f*radiance.z;
-        rgb.y = -0.9692660f*radiance.x + 1.8760108f*radiance.y + 0.0415560f*radiance.z;
-        rgb.z =  0.0556434f*radiance.x - 0.2040259f*radiance.y + 1.0572252f*radiance.z;
-
-        return rgb * 2.0f * PI / 683.0f;
+        glm::dvec3 radiance;
+        radiance.x = arhosek_tristim_skymodel_radiance(mState, theta, gamma, 0);
+        radiance.y = arhosek_tristim_skymodel_radiance(mState, theta, gamma, 1);
+        radiance.z = arhosek_tristim_skymodel_radiance(mState, theta, gamma, 2);
+        return radiance;
     }
 
 
-    ArHosekSkyModelState* mDataR;
-    ArHosekSkyModelState* mDataG;
-    ArHosekSkyModelState* mDataB;
+    ThreadPool* mThreadPool;
+    ThreadPool mJobPool;
+    ArHosekSkyModelState* mState;
+    HosekCoefficients mCoefficients;
     glm::vec3 mSunDir;
     uint32_t mTexSize;
-    std::vector<std::vector<glm::vec4>> mSkyBoxData;
+    std::vector<glm::vec4> mSkyBoxData;
+
+    // front cubemap is sampled, the back one receives the streamed faces
+    std::unique_ptr<TextureCubemap> mCubemaps[2];
+    uint32_t mFrontIdx;
+
+    // background regeneration
+    std::thread mJob;
+    std::atomic<bool> mJobDone;
+    std::atomic<bool> mJobCancel;
+    bool mJobRunning;
+    uint32_t mJobSlot;
+    bool mUpdatePending;
+    glm::vec3 mPendingSunDir;
+    std::shared_ptr<const std::vector<glm::vec4>> mPendingFaces;
+    bool mPendingKeep;
+
+    // faces evaluated by the current job, handed out through fetchComputed()
+    std::shared_ptr<std::vector<glm::vec4>> mJobFaces;
+    glm::vec3 mJobSunDir;
+    std::shared_ptr<const std::vector<glm::vec4>> mComputedFaces;
+    glm::vec3 mComputedSunDir;
 
-    TextureCubemap mCubemap;
+    // pbo ring
+    GLuint mPbos[HOSEK_PBO_RING_SIZE];
+    glm::vec4* mMappedPbos[HOSEK_PBO_RING_SIZE];
+    GLsync mFences[HOSEK_PBO_RING_SIZE];
+    bool mSwapPending;
+    uint32_t mSwapSlot;
 };
\ No newline at end of file
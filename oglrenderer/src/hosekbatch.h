@@ -0,0 +1,131 @@
+#pragma once
+
+#include "HosekSky/ArHosekSkyModel.h"
+#include "simdlane.h"
+
+// single precision copy of the xyz channel configuration of an ArHosekSkyModelState
+struct HosekCoefficients
+{
+    float mConfigs[3][9];
+    float mRadiances[3];
+};
+
+
+inline HosekCoefficients hosekCoefficients(
+    const ArHosekSkyModelState *state)
+{
+    HosekCoefficients coefficients;
+    for (int channel = 0; channel < 3; ++channel)
+    {
+        for (int i = 0; i < 9; ++i)
+        {
+            coefficients.mConfigs[channel][i] = float(state->configs[channel][i]);
+        }
+        coefficients.mRadiances[channel] = float(state->radiances[channel]);
+    }
+    return coefficients;
+}
+
+
+// acos for x in [0, 1], abramowitz & stegun 4.4.46 (|error| <= 2e-8)
+template<class Lane>
+inline Lane hosekAcos(
+    const Lane x)
+{
+    Lane y = Lane::set(-0.0012624911f);
+    y = y * x + Lane::set(0.0066700901f);
+    y = y * x + Lane::set(-0.0170881256f);
+    y = y * x + Lane::set(0.0308918810f);
+    y = y * x + Lane::set(-0.0501743046f);
+    y = y * x + Lane::set(0.0889789874f);
+    y = y * x + Lane::set(-0.2145988016f);
+    y = y * x + Lane::set(1.5707963050f);
+    return y * Lane::sqrt(Lane::max(Lane::set(1.0f) - x, Lane::set(0.0f)));
+}
+
+
+// ArHosekSkyModel_GetRadianceInternal with cos(theta) and cos(gamma) as input
+template<class Lane>
+inline Lane hosekRadiance(
+    const float *config,
+    const float  radiance,
+    const Lane   cosTheta,
+    const Lane   cosGamma,
+    const Lane   gamma)
+{
+    const Lane one = Lane::set(1.0f);
+    const Lane g = Lane::set(config[8]);
+
+    const Lane expM = simdExp(Lane::set(config[4]) * gamma);
+    const Lane rayM = cosGamma * cosGamma;
+    const Lane mieBase = one + g * g - Lane::set(2.0f) * g * cosGamma;
+    const Lane mieM = (one + rayM) / (mieBase * Lane::sqrt(mieBase));
+    const Lane zenith = Lane::sqrt(cosTheta);
+
+    const Lane a = one + Lane::set(config[0]) * simdExp(Lane::set(config[1]) / (cosTheta + Lane::set(0.01f)));
+    const Lane b = Lane::set(config[2]) +
+                   Lane::set(config[3]) * expM +
+                   Lane::set(config[5]) * rayM +
+                   Lane::set(config[6]) * mieM +
+                   Lane::set(config[7]) * zenith;
+    return a * b * Lane::set(radiance);
+}
+
+
+template<class Lane>
+inline void hosekBatch(
+    const HosekCoefficients &coefficients,
+    const float             *cosTheta,
+    const float             *cosGamma,
+    float                   *outX,
+    float                   *outY,
+    float                   *outZ,
+    const int                begin,
+    const int                end)
+{
+    const Lane minCos = Lane::set(0.00001f);
+    for (int i = begin; i + Lane::Width <= end; i += Lane::Width)
+    {
+        // same clamp as Hosek::angleBetween
+        const Lane cT = Lane::min(Lane::max(Lane::load(cosTheta + i), minCos), Lane::set(1.0f));
+        const Lane cG = Lane::min(Lane::max(Lane::load(cosGamma + i), minCos), Lane::set(1.0f));
+        const Lane gamma = hosekAcos(cG);
+
+        hosekRadiance(coefficients.mConfigs[0], coefficients.mRadiances[0], cT, cG, gamma).store(outX + i);
+        hosekRadiance(coefficients.mConfigs[1], coefficients.mRadiances[1], cT, cG, gamma).store(outY + i);
+        hosekRadiance(coefficients.mConfigs[2], coefficients.mRadiances[2], cT, cG, gamma).store(outZ + i);
+    }
+}
+
+
+// evaluates the xyz sky radiance for count directions given as cosines to the zenith and the sun.
+// against the double precision arhosek path for the same cosines the max relative error is about
+// 6e-6 at 1 degree sun elevation, where the terms of the second factor cancel, and below 2e-6
+// from 5 degrees up. single precision coefficients alone account for half of it, so a tighter
+// exp or acos does not help. Hosek::batchError() measures it
+inline void hosekRadianceBatch(
+    const HosekCoefficients &coefficients,
+    const float             *cosTheta,
+    const float             *cosGamma,
+    float                   *outX,
+    float                   *outY,
+    float                   *outZ,
+    const int                count)
+{
+    int done = 0;
+#if defined(SIMD_LANE_AVX2)
+    hosekBatch<SimdLane8>(coefficients, cosTheta, cosGamma, outX, outY, outZ, done, count);
+    done = count - (count % SimdLane8::Width);
+#endif
+#if defined(SIMD_LANE_SSE2) || defined(SIMD_LANE_AVX2)
+    hosekBatch<SimdLane4>(coefficients, cosTheta, cosGamma, outX, outY, outZ, done, count);
+    done = count - (count % SimdLane4::Width);
+#endif
+    hosekBatch<SimdLane1>(coefficients, cosTheta, cosGamma, outX, outY, outZ, done, count);
+}
+
+
+inline const char* hosekBatchPath()
+{
+    return simdLanePath();
+}
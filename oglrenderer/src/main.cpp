@@ -240,6 +240,22 @@ int main(
     int     argc, 
     char**  argv)
 {
+    // oglrenderer --cloud-still <file.exr> [width height] renders the clouds on the cpu, no window or gpu needed
+    if ((argc >= 3) && (std::string(argv[1]) == "--cloud-still"))
+    {
+        const int width = (argc >= 5) ? std::stoi(argv[3]) : 1600;
+        const int height = (argc >= 5) ? std::stoi(argv[4]) : 900;
+        return Renderer::renderCloudStill(argv[2], width, height) ? 0 : 1;
+    }
+
+    // oglrenderer --ocean-still <file.exr> [N seconds] writes the ocean displacement from the cpu fft
+    if ((argc >= 3) && (std::string(argv[1]) == "--ocean-still"))
+    {
+        const int N = (argc >= 5) ? std::stoi(argv[3]) : OCEAN_RESOLUTION_1;
+        const float time = (argc >= 5) ? std::stof(argv[4]) : 0.0f;
+        return Renderer::renderOceanStill(argv[2], N, time) ? 0 : 1;
+    }
+
     // init GLUT and create Window
     glutInit(&argc, argv);
     glutInitContextVersion(4, 6);
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "FreeImage/FreeImage.h"
+
+#include "deviceconstants.h"
+#include "nishita.h"
+#include "simdlane.h"
+#include "threadpool.h"
+
+// nishita.h defines non-inline functions, only include this from renderer.cpp
+
+// relative error allowed between the batched evaluator, nishitaSky() and the golden images
+#define NISHITA_GOLDEN_TOLERANCE 1e-3f
+#define NISHITA_GOLDEN_DIRECTORY "./resources/golden"
+
+struct NishitaBatchParams
+{
+    float     mAltitude;
+    float     mRayleighIntensity;
+    float     mMieIntensity;
+    glm::vec3 mSunDir;
+};
+
+
+// nishitaSkyImpl without the transmittance lut, one ray per lane. the camera sits inside the
+// atmosphere and rays are clamped to the upper hemisphere, so the view ray always leaves through
+// the atmosphere and never hits the ground, which is the only branch of the view line kept here
+template<class Lane>
+inline void nishitaBatch(
+    const NishitaBatchParams &params,
+    const float              *dirX,
+    const float              *dirY,
+    const float              *dirZ,
+    float                    *outR,
+    float                    *outG,
+    float                    *outB,
+    const int                 begin,
+    const int                 end)
+{
+    const float Re = NISHITA_EARTH_RADIUS;
+    const float Ra = NISHITA_ATMOSPHERE_RADIUS;
+    const float g = NISHITA_MIE_ANISOTROPY;
+    const int numSamples = NISHITA_VIEW_SAMPLES;
+    const int numSamplesL = NISHITA_SUN_SAMPLES;
+
+    const Lane zero = Lane::set(0.0f);
+    const Lane one = Lane::set(1.0f);
+    const Lane half = Lane::set(0.5f);
+    const Lane trueMask = Lane::lessEqual(zero, zero);
+    const Lane invHr = Lane::set(-1.0f / NISHITA_RAYLEIGH_HEIGHT);
+    const Lane invHm = Lane::set(-1.0f / NISHITA_MIE_HEIGHT);
+    const Lane betaR[3] = { Lane::set(NISHITA_RAYLEIGH_BETA_R), Lane::set(NISHITA_RAYLEIGH_BETA_G), Lane::set(NISHITA_RAYLEIGH_BETA_B) };
+    const Lane betaM = Lane::set(NISHITA_MIE_BETA);
+
+    const glm::vec3 sun = glm::normalize(params.mSunDir);
+    const Lane sunX = Lane::set(sun.x);
+    const Lane sunY = Lane::set(sun.y);
+    const Lane sunZ = Lane::set(sun.z);
+
+    const float camY = Re + params.mAltitude;
+    const Lane cy = Lane::set(camY);
+    const Lane cAtmosphere = Lane::set(camY * camY - Ra * Ra);
+
+    for (int i = begin; i + Lane::Width <= end; i += Lane::Width)
+    {
+        Lane dx = Lane::load(dirX + i);
+        Lane dy = Lane::max(Lane::load(dirY + i), zero);
+        Lane dz = Lane::load(dirZ + i);
+        const Lane invLength = one / Lane::sqrt(dx * dx + dy * dy + dz * dz);
+        dx = dx * invLength;
+        dy = dy * invLength;
+        dz = dz * invLength;
+
+        // phase functions
+        const Lane mu = dx * sunX + dy * sunY + dz * sunZ;
+        const Lane phaseR = Lane::set(3.0f / (16.0f * PI)) * (one + mu * mu);
+        const Lane mieBase = Lane::set(1.0f + g * g) - Lane::set(2.0f * g) * mu;
+        const Lane phaseM = Lane::set(3.0f / (8.0f * PI)) * Lane::set(1.0f - g * g) * (one + mu * mu) /
+                            (Lane::set(2.0f + g * g) * mieBase * Lane::sqrt(mieBase));
+
+        // far root of the atmosphere sphere
+        const Lane b = Lane::set(2.0f) * dy * cy;
+        const Lane tEnd = (Lane::sqrt(b * b - Lane::set(4.0f) * cAtmosphere) - b) * half;
+        const Lane segmentLength = tEnd * Lane::set(1.0f / float(numSamples));
+
+        Lane opticalDepthR = zero;
+        Lane opticalDepthM = zero;
+        Lane sumR[3] = { zero, zero, zero };
+        Lane sumM[3] = { zero, zero, zero };
+        for (int s = 0; s < numSamples; ++s)
+        {
+            const Lane t = segmentLength * Lane::set(float(s) + 0.5f);
+            const Lane px = dx * t;
+            const Lane py = cy + dy * t;
+            const Lane pz = dz * t;
+            const Lane r2 = px * px + py * py + pz * pz;
+            const Lane sampleHeight = Lane::sqrt(r2) - Lane::set(Re);
+
+            const Lane hrSample = simdExp(sampleHeight * invHr) * segmentLength;
+            const Lane hmSample = simdExp(sampleHeight * invHm) * segmentLength;
+            opticalDepthR = opticalDepthR + hrSample;
+            opticalDepthM = opticalDepthM + hmSample;
+
+            // sun ray, nishitaSunDepth
+            const Lane bL = Lane::set(2.0f) * (px * sunX + py * sunY + pz * sunZ);
+            const Lane sqrtA = Lane::sqrt(Lane::max(bL * bL - Lane::set(4.0f) * (r2 - Lane::set(Ra * Ra)), zero));
+            const Lane segmentLengthL = (sqrtA - bL) * half * Lane::set(1.0f / float(numSamplesL));
+
+            // both ground roots in front of the sample, the sun is below the horizon
+            const Lane discG = bL * bL - Lane::set(4.0f) * (r2 - Lane::set(Re * Re));
+            const Lane sqrtG = Lane::sqrt(Lane::max(discG, zero));
+            const Lane blocked = Lane::less(zero, discG) &
+                                 Lane::lessEqual(zero, (sqrtG - bL) * half) &
+                                 Lane::lessEqual(zero, (zero - sqrtG - bL) * half);
+            Lane reached = Lane::select(blocked, zero, trueMask);
+
+            Lane opticalDepthLR = zero;
+            Lane opticalDepthLM = zero;
+            for (int j = 0; j < numSamplesL; ++j)
+            {
+                const Lane tL = segmentLengthL * Lane::set(float(j) + 0.5f);
+                const Lane lx = px + sunX * tL;
+                const Lane ly = py + sunY * tL;
+                const Lane lz = pz + sunZ * tL;
+                const Lane sampleHeightL = Lane::sqrt(lx * lx + ly * ly + lz * lz) - Lane::set(Re);
+
+                // a sample inside the planet ends the march, the whole sample is dropped
+                reached = reached & Lane::lessEqual(zero, sampleHeightL);
+                opticalDepthLR = opticalDepthLR + simdExp(sampleHeightL * invHr) * segmentLengthL;
+                opticalDepthLM = opticalDepthLM + simdExp(sampleHeightL * invHm) * segmentLengthL;
+            }
+
+            if (!Lane::any(reached))
+            {
+                continue;
+            }
+
+            const Lane tauM = betaM * Lane::set(1.1f) * (opticalDepthM + opticalDepthLM);
+            for (int c = 0; c < 3; ++c)
+            {
+                const Lane tauR = betaR[c] * (opticalDepthR + opticalDepthLR);
+                const Lane attenuation = simdExp(zero - (tauR + tauM));
+                sumR[c] = Lane::select(reached, sumR[c] + hrSample * attenuation, sumR[c]);
+                sumM[c] = Lane::select(reached, sumM[c] + hmSample * attenuation, sumM[c]);
+            }
+        }
+
+        float* out[3] = { outR, outG, outB };
+        const Lane rayleighScale = phaseR * Lane::set(params.mRayleighIntensity);
+        const Lane mieScale = phaseM * betaM * Lane::set(params.mMieIntensity);
+        for (int c = 0; c < 3; ++c)
+        {
+            (sumR[c] * rayleighScale * betaR[c] + sumM[c] * mieScale).store(out[c] + i);
+        }
+    }
+}
+
+
+// evaluates the nishita sky radiance for count directions given in structure of arrays layout
+inline void nishitaRadianceBatch(
+    const NishitaBatchParams &params,
+    const float              *dirX,
+    const float              *dirY,
+    const float              *dirZ,
+    float                    *outR,
+    float                    *outG,
+    float                    *outB,
+    const int                 count)
+{
+    const int done = count - (count % SimdLaneWide::Width);
+    nishitaBatch<SimdLaneWide>(params, dirX, dirY, dirZ, outR, outG, outB, 0, done);
+    nishitaBatch<SimdLane1>(params, dirX, dirY, dirZ, outR, outG, outB, done, count);
+}
+
+
+// same face orientation and texel placement as precomputesky.frag
+inline glm::vec3 nishitaCubemapDir(
+    const int face,
+    const int x,
+    const int y,
+    const int size)
+{
+    const float u = ((x + 0.5f) / size) * 2.0f - 1.0f;
+    const float v = ((y + 0.5f) / size) * 2.0f - 1.0f;
+
+    // +x, -x, +y, -y, +z, -z
+    switch (face)
+    {
+        case 0:  return glm::normalize(glm::vec3(1.0f, -v, -u));
+        case 1:  return glm::normalize(glm::vec3(-1.0f, -v, u));
+        case 2:  return glm::normalize(glm::vec3(u, 1.0f, v));
+        case 3:  return glm::normalize(glm::vec3(u, -1.0f, -v));
+        case 4:  return glm::normalize(glm::vec3(u, -v, 1.0f));
+        default: return glm::normalize(glm::vec3(-u, -v, -1.0f));
+    }
+}
+
+
+// equirectangular image, row 0 is the zenith and the azimuth matches skyview.h
+inline glm::vec3 nishitaLatLongDir(
+    const int x,
+    const int y,
+    const int width,
+    const int height)
+{
+    const float azimuth = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+    const float elevation = (0.5f - (y + 0.5f) / height) * PI;
+    return glm::vec3(cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth));
+}
+
+
+// cpu nishita sky, every image row is a thread pool job evaluated in simd batches.
+// reference() runs the scalar nishitaSky() from the shared shader header for comparison
+class NishitaCPU
+{
+public:
+    NishitaCPU(
+        ThreadPool               &threadPool,
+        const NishitaBatchParams &params)
+        : mThreadPool(threadPool)
+        , mParams(params)
+        , mLastTime(0.0f)
+    {
+    }
+
+
+    // six faces back to back, rgb radiance and w = 1
+    std::vector<glm::vec4> cubemap(
+        const int      size,
+        const uint32_t threadCount = 0)
+    {
+        return evaluate(size, 6 * size, threadCount, false, [size](int x, int row)
+        {
+            return nishitaCubemapDir(row / size, x, row % size, size);
+        });
+    }
+
+
+    std::vector<glm::vec4> latLong(
+        const int      width,
+        const int      height,
+        const uint32_t threadCount = 0)
+    {
+        return evaluate(width, height, threadCount, false, [width, height](int x, int y)
+        {
+            return nishitaLatLongDir(x, y, width, height);
+        });
+    }
+
+
+    std::vector<glm::vec4> latLongReference(
+        const int      width,
+        const int      height,
+        const uint32_t threadCount = 0)
+    {
+        return evaluate(width, height, threadCount, true, [width, height](int x, int y)
+        {
+            return nishitaLatLongDir(x, y, width, height);
+        });
+    }
+
+
+    // duration of the last evaluation in ms
+    float lastTime() const
+    {
+        return mLastTime;
+    }
+
+
+    // max error relative to the reference, absolute below 1e-4 so black texels do not blow up
+    static float maxRelativeError(
+        const std::vector<glm::vec4> &image,
+        const std::vector<glm::vec4> &reference)
+    {
+        assert(image.size() == reference.size());
+        float maxError = 0.0f;
+        for (size_t i = 0; i < image.size(); ++i)
+        {
+            const glm::vec3 diff = glm::abs(glm::vec3(image[i]) - glm::vec3(reference[i]));
+            const glm::vec3 scale = glm::max(glm::abs(glm::vec3(reference[i])), glm::vec3(1e-4f));
+            const glm::vec3 error = diff / scale;
+            maxError = glm::max(maxError, glm::max(error.x, glm::max(error.y, error.z)));
+        }
+        return maxError;
+    }
+
+
+    // float rgb image, the format follows the extension (.exr or .pfm), row 0 is the top row
+    static bool save(
+        const std::string            &fileName,
+        const std::vector<glm::vec4> &image,
+        const int                     width,
+        const int                     height)
+    {
+        const FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+        if (fif == FIF_PFM)
+        {
+            return savePFM(fileName, image, width, height);
+        }
+        if (fif != FIF_EXR)
+        {
+            std::cout << "unsupported sky image format: " << fileName << std::endl;
+            return false;
+        }
+
+        FIBITMAP* dib = FreeImage_AllocateT(FIT_RGBF, width, height);
+        if (dib == nullptr)
+        {
+            return false;
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            // freeimage stores the bottom row first
+            FIRGBF* line = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
+            for (int x = 0; x < width; ++x)
+            {
+                const glm::vec4& texel = image[y * width + x];
+                line[x].red = texel.x;
+                line[x].green = texel.y;
+                line[x].blue = texel.z;
+            }
+        }
+
+        const bool result = FreeImage_Save(fif, dib, fileName.c_str(), fif == FIF_EXR ? EXR_FLOAT : 0) != 0;
+        FreeImage_Unload(dib);
+        return result;
+    }
+
+
+    static bool load(
+        const std::string      &fileName,
+        std::vector<glm::vec4> &image,
+        const int               width,
+        const int               height)
+    {
+        const FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+        if (fif == FIF_PFM)
+        {
+            return loadPFM(fileName, image, width, height);
+        }
+
+        FIBITMAP* dib = FreeImage_Load(fif, fileName.c_str());
+        if (dib == nullptr)
+        {
+            return false;
+        }
+
+        const bool valid = (FreeImage_GetImageType(dib) == FIT_RGBF) &&
+                           (int(FreeImage_GetWidth(dib)) == width) &&
+                           (int(FreeImage_GetHeight(dib)) == height);
+        if (valid)
+        {
+            image.resize(width * height);
+            for (int y = 0; y < height; ++y)
+            {
+                const FIRGBF* line = (const FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
+                for (int x = 0; x < width; ++x)
+                {
+                    image[y * width + x] = glm::vec4(line[x].red, line[x].green, line[x].blue, 1.0f);
+                }
+            }
+        }
+        FreeImage_Unload(dib);
+        return valid;
+    }
+
+private:
+
+    // the golden images are plain pfm written and read here, so they do not depend on how a
+    // freeimage build orders the rows. little endian rgb floats, the bottom row first
+    static bool savePFM(
+        const std::string            &fileName,
+        const std::vector<glm::vec4> &image,
+        const int                     width,
+        const int                     height)
+    {
+        FILE* file = fopen(fileName.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        bool result = fprintf(file, "PF\n%d %d\n-1.0\n", width, height) > 0;
+        std::vector<float> line(3 * width);
+        for (int y = height - 1; (y >= 0) && result; --y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const glm::vec4& texel = image[y * width + x];
+                line[3 * x + 0] = texel.x;
+                line[3 * x + 1] = texel.y;
+                line[3 * x + 2] = texel.z;
+            }
+            result = fwrite(line.data(), sizeof(float), line.size(), file) == line.size();
+        }
+        fclose(file);
+        return result;
+    }
+
+
+    static bool loadPFM(
+        const std::string      &fileName,
+        std::vector<glm::vec4> &image,
+        const int               width,
+        const int               height)
+    {
+        FILE* file = fopen(fileName.c_str(), "rb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        char magic[3] = { 0 };
+        int fileWidth = 0;
+        int fileHeight = 0;
+        float scale = 0.0f;
+        bool valid = (fscanf(file, "%2s %d %d %f", magic, &fileWidth, &fileHeight, &scale) == 4) &&
+                     (std::string(magic) == "PF") && (fileWidth == width) && (fileHeight == height) && (scale < 0.0f);
+
+        // a single whitespace character ends the header
+        valid = valid && (fgetc(file) != EOF);
+        if (valid)
+        {
+            image.resize(width * height);
+            std::vector<float> line(3 * width);
+            for (int y = height - 1; (y >= 0) && valid; --y)
+            {
+                valid = fread(line.data(), sizeof(float), line.size(), file) == line.size();
+                for (int x = 0; (x < width) && valid; ++x)
+                {
+                    image[y * width + x] = glm::vec4(line[3 * x + 0], line[3 * x + 1], line[3 * x + 2], 1.0f);
+                }
+            }
+        }
+        fclose(file);
+        return valid;
+    }
+
+
+    template<class DirFunc>
+    std::vector<glm::vec4> evaluate(
+        const int      width,
+        const int      height,
+        const uint32_t threadCount,
+        const bool     reference,
+        const DirFunc  &dirFunc)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::vector<glm::vec4> image(width * height);
+        const NishitaBatchParams& params = mParams;
+        mThreadPool.parallelFor(height, [&](uint32_t y)
+        {
+            if (reference)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    glm::vec3 rayleigh, mie, sky;
+                    nishitaSky(params.mAltitude, params.mRayleighIntensity, params.mMieIntensity, params.mSunDir, dirFunc(x, y), rayleigh, mie, sky);
+                    image[y * width + x] = glm::vec4(sky, 1.0f);
+                }
+                return;
+            }
+
+            // structure of arrays row, 6 floats per texel
+            std::vector<float> row(6 * width);
+            float* dirX = &row[0];
+            float* dirY = &row[width];
+            float* dirZ = &row[2 * width];
+            for (int x = 0; x < width; ++x)
+            {
+                const glm::vec3 dir = dirFunc(x, y);
+                dirX[x] = dir.x;
+                dirY[x] = dir.y;
+                dirZ[x] = dir.z;
+            }
+
+            nishitaRadianceBatch(params, dirX, dirY, dirZ, &row[3 * width], &row[4 * width], &row[5 * width], width);
+            for (int x = 0; x < width; ++x)
+            {
+                image[y * width + x] = glm::vec4(row[3 * width + x], row[4 * width + x], row[5 * width + x], 1.0f);
+            }
+        }, threadCount);
+
+        const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        mLastTime = elapsed.count();
+        return image;
+    }
+
+
+    ThreadPool         &mThreadPool;
+    NishitaBatchParams mParams;
+    float              mLastTime;
+};
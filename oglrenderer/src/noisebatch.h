@@ -0,0 +1,477 @@
+#pragma once
+
+#include <chrono>
+#include <math.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+#include "simdlane.h"
+#include "threadpool.h"
+
+#include "cloud.h"
+
+// cloud.h defines non-inline functions, only include this from renderer.cpp
+
+// lane versions of the noise in perlin.h, worley.h and cloud.h. every function keeps the
+// operation order of the glsl code, sin is the only approximation (simdSin)
+
+template<class Lane>
+inline Lane noiseFract(
+    const Lane a)
+{
+    return a - Lane::floor(a);
+}
+
+
+// glsl mod, x - y * floor(x / y)
+template<class Lane>
+inline Lane noiseMod(
+    const Lane  x,
+    const float y)
+{
+    return x - Lane::set(y) * Lane::floor(x / Lane::set(y));
+}
+
+
+// one component of random3 in random.h
+template<class Lane>
+inline Lane noiseRandom(
+    const Lane  px,
+    const Lane  py,
+    const Lane  pz,
+    const float ax,
+    const float ay,
+    const float az)
+{
+    const Lane d = px * Lane::set(ax) + py * Lane::set(ay) + pz * Lane::set(az);
+    return noiseFract(simdSin(d) * Lane::set(43758.5453f));
+}
+
+
+template<class Lane>
+inline Lane noiseWorley3D(
+    const Lane  x,
+    const Lane  y,
+    const Lane  z,
+    const float time,
+    const bool  invert)
+{
+    const Lane ix = Lane::floor(x);
+    const Lane iy = Lane::floor(y);
+    const Lane iz = Lane::floor(z);
+    const Lane fx = noiseFract(x);
+    const Lane fy = noiseFract(y);
+    const Lane fz = noiseFract(z);
+    const Lane half = Lane::set(0.5f);
+
+    Lane minDist = Lane::set(1.0f);
+    for (int k = -1; k <= 1; ++k)
+    {
+        for (int j = -1; j <= 1; ++j)
+        {
+            for (int i = -1; i <= 1; ++i)
+            {
+                const Lane nx = Lane::set(float(i));
+                const Lane ny = Lane::set(float(j));
+                const Lane nz = Lane::set(float(k));
+                const Lane px = ix + nx;
+                const Lane py = iy + ny;
+                const Lane pz = iz + nz;
+
+                Lane pointX = noiseRandom(px, py, pz, 12.989f, 78.233f, 37.719f);
+                Lane pointY = noiseRandom(px, py, pz, 39.346f, 11.135f, 83.155f);
+                Lane pointZ = noiseRandom(px, py, pz, 73.156f, 52.235f, 09.151f);
+
+                // animate the point
+                pointX = half + half * simdSin(Lane::set(time) + Lane::set(6.2831f) * pointX);
+                pointY = half + half * simdSin(Lane::set(time) + Lane::set(6.2831f) * pointY);
+                pointZ = half + half * simdSin(Lane::set(time) + Lane::set(6.2831f) * pointZ);
+
+                const Lane dx = nx + pointX - fx;
+                const Lane dy = ny + pointY - fy;
+                const Lane dz = nz + pointZ - fz;
+                minDist = Lane::min(minDist, Lane::sqrt(dx * dx + dy * dy + dz * dz));
+            }
+        }
+    }
+
+    if (invert)
+    {
+        minDist = Lane::max(Lane::min(Lane::set(1.0f) - minDist, Lane::set(1.0f)), Lane::set(0.0f));
+    }
+    return minDist;
+}
+
+
+// hash33 of perlin.h dotted with the offset to its corner
+template<class Lane>
+inline Lane noiseGradientCorner(
+    const Lane  px,
+    const Lane  py,
+    const Lane  pz,
+    const Lane  wx,
+    const Lane  wy,
+    const Lane  wz,
+    const float freq)
+{
+    typedef typename Lane::Int Int;
+    const Int q = (Lane::toInt(noiseMod(px, freq)) * Int::set(1597334673u)) ^
+                  (Lane::toInt(noiseMod(py, freq)) * Int::set(3812015801u)) ^
+                  (Lane::toInt(noiseMod(pz, freq)) * Int::set(2798796415u));
+
+    const Lane one = Lane::set(1.0f);
+    const Lane two = Lane::set(2.0f);
+    const Lane scale = Lane::set(1.0f / float(0xffffffffu));
+    const Lane gx = two * Lane::toFloat(q * Int::set(1597334673u)) * scale - one;
+    const Lane gy = two * Lane::toFloat(q * Int::set(3812015801u)) * scale - one;
+    const Lane gz = two * Lane::toFloat(q * Int::set(2798796415u)) * scale - one;
+    return gx * wx + gy * wy + gz * wz;
+}
+
+
+template<class Lane>
+inline Lane noiseGradient(
+    const Lane  x,
+    const Lane  y,
+    const Lane  z,
+    const float freq)
+{
+    const Lane px = Lane::floor(x);
+    const Lane py = Lane::floor(y);
+    const Lane pz = Lane::floor(z);
+    const Lane wx = noiseFract(x);
+    const Lane wy = noiseFract(y);
+    const Lane wz = noiseFract(z);
+
+    // quintic interpolant
+    const Lane six = Lane::set(6.0f);
+    const Lane fifteen = Lane::set(15.0f);
+    const Lane ten = Lane::set(10.0f);
+    const Lane ux = wx * wx * wx * (wx * (wx * six - fifteen) + ten);
+    const Lane uy = wy * wy * wy * (wy * (wy * six - fifteen) + ten);
+    const Lane uz = wz * wz * wz * (wz * (wz * six - fifteen) + ten);
+
+    const Lane one = Lane::set(1.0f);
+    const Lane va = noiseGradientCorner(px, py, pz, wx, wy, wz, freq);
+    const Lane vb = noiseGradientCorner(px + one, py, pz, wx - one, wy, wz, freq);
+    const Lane vc = noiseGradientCorner(px, py + one, pz, wx, wy - one, wz, freq);
+    const Lane vd = noiseGradientCorner(px + one, py + one, pz, wx - one, wy - one, wz, freq);
+    const Lane ve = noiseGradientCorner(px, py, pz + one, wx, wy, wz - one, freq);
+    const Lane vf = noiseGradientCorner(px + one, py, pz + one, wx - one, wy, wz - one, freq);
+    const Lane vg = noiseGradientCorner(px, py + one, pz + one, wx, wy - one, wz - one, freq);
+    const Lane vh = noiseGradientCorner(px + one, py + one, pz + one, wx - one, wy - one, wz - one, freq);
+
+    return va +
+           ux * (vb - va) +
+           uy * (vc - va) +
+           uz * (ve - va) +
+           ux * uy * (va - vb - vc + vd) +
+           uy * uz * (va - vc - ve + vg) +
+           uz * ux * (va - vb - ve + vf) +
+           ux * uy * uz * (vb - va + vc - vd + ve - vf - vg + vh);
+}
+
+
+template<class Lane>
+inline Lane noisePerlinFBM(
+    const Lane  x,
+    const Lane  y,
+    const Lane  z,
+    const float time,
+    float       freq,
+    const int   octaves)
+{
+    const float G = exp2f(-0.85f);
+    float amp = 1.0f;
+    Lane noise = Lane::set(0.0f);
+    for (int i = 0; i < octaves; ++i)
+    {
+        const Lane f = Lane::set(freq);
+        const Lane t = Lane::set(time);
+        noise = noise + Lane::set(amp) * noiseGradient(x * f + t, y * f + t, z * f + t, freq);
+        freq *= 2.0f;
+        amp *= G;
+    }
+    return noise;
+}
+
+
+// perlinWorley3D of cloud.h with the three worley octaves given
+template<class Lane>
+inline Lane noisePerlinWorley3D(
+    const Lane  worleyX,
+    const Lane  worleyY,
+    const Lane  worleyZ,
+    const Lane  x,
+    const Lane  y,
+    const Lane  z,
+    const float time,
+    const float freq,
+    const int   octaves)
+{
+    const Lane perlinNoise = noisePerlinFBM(x, y, z, time, freq, octaves);
+    const Lane worleyNoise = worleyX * Lane::set(0.625f) + worleyY * Lane::set(0.25f) + worleyZ * Lane::set(0.125f);
+
+    // remap(abs(perlin * 2 - 1), 1 - worley, 1, 0, 1)
+    const Lane one = Lane::set(1.0f);
+    const Lane p = perlinNoise * Lane::set(2.0f) - one;
+    const Lane a = one - worleyNoise;
+    const Lane noise = ((Lane::max(p, Lane::set(0.0f) - p) - a) / (one - a)) * one;
+    return one - noise;
+}
+
+
+// precomputecloud.comp for the voxels [begin, end) of one row, rgba detail channels
+// and the two base shape channels in structure of arrays layout
+template<class Lane>
+inline void noiseCloudRow(
+    const float freq,
+    const int   octaves,
+    const int   y,
+    const int   z,
+    float      *out[6],
+    const int   begin,
+    const int   end)
+{
+    const float scale = 1.0f / float(CLOUD_RESOLUTION);
+    const Lane uy = Lane::set(float(y) * scale);
+    const Lane uz = Lane::set(float(z) * scale);
+    float xs[8];
+    for (int i = begin; i < end; i += Lane::Width)
+    {
+        for (int l = 0; l < Lane::Width; ++l)
+        {
+            xs[l] = float(i + l) * scale;
+        }
+        const Lane ux = Lane::load(xs);
+
+        const Lane f1 = Lane::set(freq);
+        const Lane f2 = Lane::set(2.0f * freq);
+        const Lane f4 = Lane::set(4.0f * freq);
+        const Lane worley1 = noiseWorley3D(ux * f1, uy * f1, uz * f1, 0.0f, true);
+        const Lane worley2 = noiseWorley3D(ux * f2, uy * f2, uz * f2, 0.0f, true);
+        const Lane worley4 = noiseWorley3D(ux * f4, uy * f4, uz * f4, 0.0f, true);
+        const Lane perlinWorley = noisePerlinWorley3D(worley1, worley2, worley4, ux, uy, uz, 0.0f, freq, octaves);
+
+        perlinWorley.store(out[0] + i);
+        worley1.store(out[1] + i);
+        worley2.store(out[2] + i);
+        worley4.store(out[3] + i);
+
+        // cloudShape
+        perlinWorley.store(out[4] + i);
+        (worley1 * Lane::set(0.625f) + worley2 * Lane::set(0.25f) + worley4 * Lane::set(0.125f)).store(out[5] + i);
+    }
+}
+
+
+// cpu noise bakes, the rows of a slice or image run in simd batches and every slice or row is a
+// thread pool job. the reference variants run the shared glsl headers one voxel at a time
+class NoiseCPU
+{
+public:
+    NoiseCPU(
+        ThreadPool &threadPool)
+        : mThreadPool(threadPool)
+        , mLastTime(0.0f)
+    {
+    }
+
+
+    // precomputecloud.comp, rgba8 detail and rg8 base shape in the CloudNoiseCache layout
+    void cloudVolume(
+        const NoiseParams    &perlinParams,
+        std::vector<uint8_t> &detail,
+        std::vector<uint8_t> &shape,
+        const bool            reference = false,
+        const uint32_t        threadCount = 0)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        const int size = CLOUD_RESOLUTION;
+        detail.resize(size_t(size) * size * size * 4);
+        shape.resize(size_t(size) * size * size * 2);
+
+        const float freq = perlinParams.mSettings.z;
+        const int octaves = perlinParams.mNoiseOctaves;
+        mThreadPool.parallelFor(size, [&](uint32_t z)
+        {
+            std::vector<float> row(size * 6);
+            float* out[6];
+            for (int c = 0; c < 6; ++c)
+            {
+                out[c] = &row[c * size];
+            }
+
+            for (int y = 0; y < size; ++y)
+            {
+                if (reference)
+                {
+                    for (int x = 0; x < size; ++x)
+                    {
+                        const glm::vec3 uvw = glm::vec3(float(x), float(y), float(z)) / float(size);
+
+                        glm::vec4 color;
+                        color.y = worley3D(uvw * freq, 0.0f, true);
+                        color.z = worley3D(uvw * 2.0f * freq, 0.0f, true);
+                        color.w = worley3D(uvw * 4.0f * freq, 0.0f, true);
+                        color.x = perlinWorley3D(glm::vec3(color.y, color.z, color.w), uvw, 0.0f, freq, octaves);
+                        const glm::vec2 base = cloudShape(color);
+                        for (int c = 0; c < 4; ++c)
+                        {
+                            out[c][x] = color[c];
+                        }
+                        out[4][x] = base.x;
+                        out[5][x] = base.y;
+                    }
+                }
+                else
+                {
+                    const int done = size - (size % SimdLaneWide::Width);
+                    noiseCloudRow<SimdLaneWide>(freq, octaves, y, z, out, 0, done);
+                    noiseCloudRow<SimdLane1>(freq, octaves, y, z, out, done, size);
+                }
+
+                // rgba8 and rg8 unorm, as imageStore converts
+                const size_t voxel = (size_t(z) * size + y) * size;
+                for (int x = 0; x < size; ++x)
+                {
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        detail[(voxel + x) * 4 + c] = toUnorm(out[c][x]);
+                    }
+                    shape[(voxel + x) * 2 + 0] = toUnorm(out[4][x]);
+                    shape[(voxel + x) * 2 + 1] = toUnorm(out[5][x]);
+                }
+            }
+        }, threadCount);
+
+        mLastTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+
+    // perlinnoise.frag at time 0, row 0 is the bottom row
+    std::vector<float> perlinImage(
+        const NoiseParams &params,
+        const int          width,
+        const int          height)
+    {
+        const float freq = params.mSettings.z;
+        const int octaves = params.mNoiseOctaves;
+        return evaluate(width, height, [freq, octaves](const SimdLaneWide x, const SimdLaneWide y)
+        {
+            return noisePerlinFBM(x, y, SimdLaneWide::set(0.0f), 0.0f, freq, octaves);
+        }, [freq, octaves](const SimdLane1 x, const SimdLane1 y)
+        {
+            return noisePerlinFBM(x, y, SimdLane1::set(0.0f), 0.0f, freq, octaves);
+        });
+    }
+
+
+    // worleynoise.frag at time 0, the worleyFBM octaves of the perlin frequency
+    std::vector<float> worleyImage(
+        const NoiseParams &perlinParams,
+        const bool         invert,
+        const int          width,
+        const int          height)
+    {
+        const float freq = perlinParams.mSettings.z;
+        return evaluate(width, height, [freq, invert](const SimdLaneWide x, const SimdLaneWide y)
+        {
+            return worleyFBM(x * SimdLaneWide::set(freq), y * SimdLaneWide::set(freq), invert);
+        }, [freq, invert](const SimdLane1 x, const SimdLane1 y)
+        {
+            return worleyFBM(x * SimdLane1::set(freq), y * SimdLane1::set(freq), invert);
+        });
+    }
+
+
+    // duration of the last cloud volume in ms
+    float lastTime() const
+    {
+        return mLastTime;
+    }
+
+
+    // max difference in unorm steps and the fraction of values that differ by more than one step
+    static glm::vec2 compare(
+        const std::vector<uint8_t> &a,
+        const std::vector<uint8_t> &b)
+    {
+        assert(a.size() == b.size());
+        int maxDiff = 0;
+        size_t offCount = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            const int diff = abs(int(a[i]) - int(b[i]));
+            maxDiff = glm::max(maxDiff, diff);
+            offCount += (diff > 1) ? 1 : 0;
+        }
+        return glm::vec2(float(maxDiff), float(offCount) / float(glm::max(a.size(), size_t(1))));
+    }
+
+private:
+
+    static uint8_t toUnorm(
+        const float x)
+    {
+        return uint8_t(glm::clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+
+    // worleyFBM of cloud.h in the z = 0 plane with a frequency of one
+    template<class Lane>
+    static Lane worleyFBM(
+        const Lane x,
+        const Lane y,
+        const bool invert)
+    {
+        const Lane zero = Lane::set(0.0f);
+        const Lane two = Lane::set(2.0f);
+        const Lane four = Lane::set(4.0f);
+        return noiseWorley3D(x, y, zero, 0.0f, invert) * Lane::set(0.625f) +
+               noiseWorley3D(x * two, y * two, zero, 0.0f, invert) * Lane::set(0.25f) +
+               noiseWorley3D(x * four, y * four, zero, 0.0f, invert) * Lane::set(0.125f);
+    }
+
+
+    // one image row per job at the pixel centers the preview quads use
+    template<class WideFunc, class ScalarFunc>
+    std::vector<float> evaluate(
+        const int          width,
+        const int          height,
+        const WideFunc    &wideFunc,
+        const ScalarFunc  &scalarFunc)
+    {
+        std::vector<float> image(size_t(width) * height);
+        mThreadPool.parallelFor(height, [&](uint32_t y)
+        {
+            float* row = &image[size_t(y) * width];
+            const float v = (float(y) + 0.5f) / float(height);
+            const int done = width - (width % SimdLaneWide::Width);
+
+            float xs[8];
+            for (int i = 0; i < done; i += SimdLaneWide::Width)
+            {
+                for (int l = 0; l < SimdLaneWide::Width; ++l)
+                {
+                    xs[l] = (float(i + l) + 0.5f) / float(width);
+                }
+                wideFunc(SimdLaneWide::load(xs), SimdLaneWide::set(v)).store(row + i);
+            }
+            for (int i = done; i < width; ++i)
+            {
+                const float u = (float(i) + 0.5f) / float(width);
+                scalarFunc(SimdLane1::set(u), SimdLane1::set(v)).store(row + i);
+            }
+        });
+        return image;
+    }
+
+
+    ThreadPool &mThreadPool;
+    float mLastTime;
+};
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <assert.h>
+#include <chrono>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+#include "simdlane.h"
+#include "threadpool.h"
+
+// cpu version of the OceanFFT displacement: oceanheightfield.comp, oceanhfinal.comp, the inverse fft
+// and inversion.comp. the spectra live in structure of arrays planes, the fft runs the same stockham
+// stages as fftstockham.comp on SimdLaneWide lanes of neighboring rows or columns. no gl, so it also
+// runs headless
+class OceanCPU
+{
+public:
+    OceanCPU(
+        ThreadPool               &threadPool,
+        const int                 N,
+        const float               L,
+        const std::vector<float> &noise)
+        : mThreadPool(threadPool)
+        , mN(N)
+        , mL(L)
+        , mNoise(noise)
+        , mH0(4, std::vector<float>(size_t(N) * N, 0.0f))
+        , mSpectrum(6, std::vector<float>(size_t(N) * N, 0.0f))
+        , mDisplacement(size_t(N) * N, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))
+        , mLastTime(0.0f)
+    {
+        assert((N % SimdLaneWide::Width) == 0);
+        assert(mNoise.size() == size_t(N) * N * 4);
+
+        // radix 4 stages, one radix 2 stage first when log2(N) is odd
+        int stages = 0;
+        while ((1 << stages) < N)
+        {
+            ++stages;
+        }
+
+        int span = 1;
+        while (span < N)
+        {
+            Stage stage;
+            stage.mRadix = (stages % 2) == 1 ? 2 : 4;
+            stage.mSpan = span;
+            for (int k = 0; k < span; ++k)
+            {
+                for (int r = 1; r < stage.mRadix; ++r)
+                {
+                    const double angle = 2.0 * M_PI * double(k) * double(r) / double(span * stage.mRadix);
+                    stage.mTwiddleRe.push_back(float(cos(angle)));
+                    stage.mTwiddleIm.push_back(float(sin(angle)));
+                }
+            }
+            mStages.push_back(stage);
+
+            span *= stage.mRadix;
+            stages -= stage.mRadix == 2 ? 1 : 2;
+        }
+    }
+
+
+    // uniform random numbers for the noise texture, four per texel
+    static std::vector<float> randomNoise(
+        const int N)
+    {
+        std::vector<float> noise(size_t(N) * N * 4);
+        for (size_t i = 0; i < noise.size(); ++i)
+        {
+            noise[i] = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+        }
+        return noise;
+    }
+
+
+    // oceanheightfield.comp, h0(k) and h0(-k) of the phillips spectrum
+    void spectrum(
+        const OceanParams &oceanParams)
+    {
+        mThreadPool.parallelFor(mN, [&](uint32_t y)
+        {
+            for (int x = 0; x < mN; ++x)
+            {
+                const size_t texel = size_t(y) * mN + x;
+                const glm::vec4 noise = glm::clamp(glm::vec4(mNoise[texel * 4 + 0], mNoise[texel * 4 + 1], mNoise[texel * 4 + 2], mNoise[texel * 4 + 3]), 0.001f, 1.0f);
+                const float u0 = 2.0f * PI * noise.x;
+                const float v0 = sqrtf(-2.0f * logf(noise.y));
+                const float u1 = 2.0f * PI * noise.z;
+                const float v1 = sqrtf(-2.0f * logf(noise.w));
+
+                const glm::vec2 nm = glm::vec2(float(x), float(y)) - float(mN) / 2.0f;
+                const glm::vec2 k = glm::vec2((2.0f * PI * nm.x) / mL, (2.0f * PI * nm.y) / mL);
+                const float h0PosK = sqrtf(philipSpectrum(oceanParams, k) / 2.0f);
+                const float h0NegK = sqrtf(philipSpectrum(oceanParams, -k) / 2.0f);
+                mH0[0][texel] = v0 * cosf(u0) * h0PosK;
+                mH0[1][texel] = v0 * sinf(u0) * h0PosK;
+                mH0[2][texel] = v1 * cosf(u1) * h0NegK;
+                mH0[3][texel] = v1 * sinf(u1) * h0NegK;
+            }
+        });
+    }
+
+
+    // oceanhfinal.comp, the inverse fft and inversion.comp at time t, fills displacement()
+    void update(
+        const float time)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        mThreadPool.parallelFor(mN, [&](uint32_t y)
+        {
+            for (int x = 0; x < mN; x += SimdLaneWide::Width)
+            {
+                evolve<SimdLaneWide>(time, x, int(y));
+            }
+        });
+
+        // rows first as the gpu does, every job transforms Width neighboring lines of all three spectra
+        const int W = SimdLaneWide::Width;
+        for (int direction = 0; direction < 2; ++direction)
+        {
+            mThreadPool.parallelFor(mN / W, [&](uint32_t job)
+            {
+                std::vector<float> buffer(size_t(mN) * W * 4);
+                float* re[2] = { &buffer[0], &buffer[size_t(mN) * W] };
+                float* im[2] = { &buffer[size_t(mN) * W * 2], &buffer[size_t(mN) * W * 3] };
+                const int first = int(job) * W;
+                for (int c = 0; c < 3; ++c)
+                {
+                    float* planeRe = mSpectrum[c * 2 + 0].data();
+                    float* planeIm = mSpectrum[c * 2 + 1].data();
+                    gather(planeRe, planeIm, re[0], im[0], first, direction);
+                    const int result = transform<SimdLaneWide>(re, im);
+                    scatter(re[result], im[result], planeRe, planeIm, first, direction);
+                }
+            });
+        }
+
+        const float scale = 1.0f / float(mN * mN);
+        mThreadPool.parallelFor(mN, [&](uint32_t y)
+        {
+            for (int x = 0; x < mN; ++x)
+            {
+                const size_t texel = size_t(y) * mN + x;
+                const float perm = ((x + int(y)) % 2) == 0 ? 1.0f : -1.0f;
+                const glm::vec3 h = glm::vec3(mSpectrum[0][texel], mSpectrum[2][texel], mSpectrum[4][texel]);
+                mDisplacement[texel] = glm::vec4(perm * (h * scale), 1.0f);
+            }
+        });
+
+        mLastTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+
+    // N x N texels as in the displacement texture, row 0 first
+    const std::vector<glm::vec4>& displacement() const
+    {
+        return mDisplacement;
+    }
+
+
+    // duration of the last update in ms
+    float lastTime() const
+    {
+        return mLastTime;
+    }
+
+
+    int size() const
+    {
+        return mN;
+    }
+
+private:
+
+    struct Stage
+    {
+        int mRadix;
+        int mSpan;
+        // exp(+i 2 pi k r / (span * radix)) for r in [1, radix), k major
+        std::vector<float> mTwiddleRe;
+        std::vector<float> mTwiddleIm;
+    };
+
+
+    float philipSpectrum(
+        const OceanParams &oceanParams,
+        const glm::vec2   &k) const
+    {
+        // no wave at k = 0, normalize would return nan there
+        if (glm::length(k) < 0.00001f)
+        {
+            return 0.0f;
+        }
+        const float kLength = glm::max(glm::length(k), 0.00001f);
+
+        const float kLength2 = kLength * kLength;
+        const float kLength4 = kLength2 * kLength2;
+
+        float LSquared = (oceanParams.mWaveSettings.y * oceanParams.mWaveSettings.y) / 9.81f;
+        LSquared *= LSquared;
+
+        float kDotWindSquared = glm::dot(glm::normalize(k), glm::normalize(glm::vec2(oceanParams.mWaveSettings.z, oceanParams.mWaveSettings.w)));
+        kDotWindSquared *= kDotWindSquared;
+
+        float philip = oceanParams.mWaveSettings.x * expf((-1.0f / (kLength2 * LSquared))) / (kLength4);
+        philip *= kDotWindSquared;
+        return philip;
+    }
+
+
+    // h(k, t) of one lane of texels, dx and -dy and dz as the two gpu texel pairs hold them
+    template<class Lane>
+    void evolve(
+        const float time,
+        const int   x,
+        const int   y)
+    {
+        const size_t texel = size_t(y) * mN + x;
+        float xs[8];
+        for (int l = 0; l < Lane::Width; ++l)
+        {
+            xs[l] = float(x + l);
+        }
+
+        const Lane zero = Lane::set(0.0f);
+        const Lane twoPi = Lane::set(2.0f * PI);
+        const Lane L = Lane::set(mL);
+        const Lane kx = (twoPi * (Lane::load(xs) - Lane::set(float(mN) / 2.0f))) / L;
+        const Lane ky = (twoPi * Lane::set(float(y) - float(mN) / 2.0f)) / L;
+
+        // dispersion relation
+        const Lane kLength = Lane::max(Lane::sqrt(kx * kx + ky * ky), Lane::set(0.00001f));
+        const Lane w = Lane::sqrt(Lane::set(9.81f) * kLength);
+        Lane sinWt, cosWt;
+        simdSinCos(w * Lane::set(time), sinWt, cosWt);
+
+        // h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+        const Lane a = Lane::load(&mH0[0][texel]);
+        const Lane b = Lane::load(&mH0[1][texel]);
+        const Lane c = Lane::load(&mH0[2][texel]);
+        const Lane d = zero - Lane::load(&mH0[3][texel]);
+        const Lane sinInv = zero - sinWt;
+        const Lane hRe = (a * cosWt - b * sinWt) + (c * cosWt - d * sinInv);
+        const Lane hIm = (a * sinWt + b * cosWt) + (c * sinInv + d * cosWt);
+
+        const Lane dx = zero - kx / kLength;
+        const Lane dz = zero - ky / kLength;
+        (zero - dx * hIm).store(&mSpectrum[0][texel]);
+        (dx * hRe).store(&mSpectrum[1][texel]);
+        (zero - hRe).store(&mSpectrum[2][texel]);
+        (zero - hIm).store(&mSpectrum[3][texel]);
+        (zero - dz * hIm).store(&mSpectrum[4][texel]);
+        (dz * hRe).store(&mSpectrum[5][texel]);
+    }
+
+
+    // Width lines into a lane interleaved buffer, element e of line l at e * Width + l.
+    // direction 0 takes rows starting at first, 1 columns
+    void gather(
+        const float *planeRe,
+        const float *planeIm,
+        float       *re,
+        float       *im,
+        const int    first,
+        const int    direction) const
+    {
+        const int W = SimdLaneWide::Width;
+        for (int e = 0; e < mN; ++e)
+        {
+            for (int l = 0; l < W; ++l)
+            {
+                const size_t texel = direction == 0 ? size_t(first + l) * mN + e : size_t(e) * mN + first + l;
+                re[e * W + l] = planeRe[texel];
+                im[e * W + l] = planeIm[texel];
+            }
+        }
+    }
+
+
+    void scatter(
+        const float *re,
+        const float *im,
+        float       *planeRe,
+        float       *planeIm,
+        const int    first,
+        const int    direction) const
+    {
+        const int W = SimdLaneWide::Width;
+        for (int e = 0; e < mN; ++e)
+        {
+            for (int l = 0; l < W; ++l)
+            {
+                const size_t texel = direction == 0 ? size_t(first + l) * mN + e : size_t(e) * mN + first + l;
+                planeRe[texel] = re[e * W + l];
+                planeIm[texel] = im[e * W + l];
+            }
+        }
+    }
+
+
+    // stockham stages ping ponging between the two buffers, returns the one holding the result
+    template<class Lane>
+    int transform(
+        float *re[2],
+        float *im[2]) const
+    {
+        const int W = Lane::Width;
+        int src = 0;
+        for (const Stage &stage : mStages)
+        {
+            const int radix = stage.mRadix;
+            const int span = stage.mSpan;
+            const int count = mN / radix;
+            const float* srcRe = re[src];
+            const float* srcIm = im[src];
+            float* dstRe = re[src ^ 1];
+            float* dstIm = im[src ^ 1];
+
+            for (int j = 0; j < count; ++j)
+            {
+                const int k = j % span;
+                Lane vRe[4];
+                Lane vIm[4];
+                vRe[0] = Lane::load(srcRe + j * W);
+                vIm[0] = Lane::load(srcIm + j * W);
+                for (int r = 1; r < radix; ++r)
+                {
+                    const Lane xRe = Lane::load(srcRe + (j + r * count) * W);
+                    const Lane xIm = Lane::load(srcIm + (j + r * count) * W);
+                    const Lane wRe = Lane::set(stage.mTwiddleRe[k * (radix - 1) + r - 1]);
+                    const Lane wIm = Lane::set(stage.mTwiddleIm[k * (radix - 1) + r - 1]);
+                    vRe[r] = xRe * wRe - xIm * wIm;
+                    vIm[r] = xRe * wIm + xIm * wRe;
+                }
+
+                const int index = (j / span) * span * radix + k;
+                if (radix == 2)
+                {
+                    (vRe[0] + vRe[1]).store(dstRe + index * W);
+                    (vIm[0] + vIm[1]).store(dstIm + index * W);
+                    (vRe[0] - vRe[1]).store(dstRe + (index + span) * W);
+                    (vIm[0] - vIm[1]).store(dstIm + (index + span) * W);
+                }
+                else
+                {
+                    const Lane a0Re = vRe[0] + vRe[2];
+                    const Lane a0Im = vIm[0] + vIm[2];
+                    const Lane a1Re = vRe[0] - vRe[2];
+                    const Lane a1Im = vIm[0] - vIm[2];
+                    const Lane a2Re = vRe[1] + vRe[3];
+                    const Lane a2Im = vIm[1] + vIm[3];
+                    // (v1 - v3) * i
+                    const Lane a3Re = vIm[3] - vIm[1];
+                    const Lane a3Im = vRe[1] - vRe[3];
+                    (a0Re + a2Re).store(dstRe + index * W);
+                    (a0Im + a2Im).store(dstIm + index * W);
+                    (a1Re + a3Re).store(dstRe + (index + span) * W);
+                    (a1Im + a3Im).store(dstIm + (index + span) * W);
+                    (a0Re - a2Re).store(dstRe + (index + 2 * span) * W);
+                    (a0Im - a2Im).store(dstIm + (index + 2 * span) * W);
+                    (a1Re - a3Re).store(dstRe + (index + 3 * span) * W);
+                    (a1Im - a3Im).store(dstIm + (index + 3 * span) * W);
+                }
+            }
+            src ^= 1;
+        }
+        return src;
+    }
+
+
+    ThreadPool &mThreadPool;
+    int mN;
+    float mL;
+    std::vector<float> mNoise;
+
+    // h0(k) re, im and h0(-k) re, im
+    std::vector<std::vector<float>> mH0;
+    // dx re, im, -dy re, im and dz re, im
+    std::vector<std::vector<float>> mSpectrum;
+    std::vector<glm::vec4> mDisplacement;
+    std::vector<Stage> mStages;
+    float mLastTime;
+};
@@ -9,6 +9,7 @@
 
 #include "deviceconstants.h"
 #include "devicestructs.h"
+#include "oceancpu.h"
 #include "renderer.h"
 #include "texture.h"
 
@@ -20,27 +21,24 @@ public:
         Renderer    &renderer,
         const int   N,
         const float L)
-        : mN(N)
-        , mL(L)
-        , mPasses((int)(float(log(float(N))) / float(log(2.0f))))
-        , mOceanDisplacementTexture(N, N, GL_LINEAR_MIPMAP_LINEAR, true, 32, false)
+        : mOceanDisplacementTexture(N, N, GL_LINEAR_MIPMAP_LINEAR, true, 32, false)
         , mOceanH0SpectrumTexture(N, N, GL_NEAREST, false, 32, false)
-        , mOceanHDxSpectrumTexture(N, N, GL_NEAREST, false, 32, false)
-        , mOceanHDySpectrumTexture(N, N, GL_NEAREST, false, 32, false)
+        , mOceanHDxySpectrumTexture(N, N, GL_NEAREST, false, 32, false)
         , mOceanHDzSpectrumTexture(N, N, GL_NEAREST, false, 32, false)
-        , mOceanNoiseTexture(N, N, GL_NEAREST, false, 32, false)
-        , mPingPongTexture(N, N, GL_NEAREST, false, 32, false)
+        , mPingPongXYTexture(N, N, GL_NEAREST, false, 32, false)
+        , mPingPongZTexture(N, N, GL_NEAREST, false, 32, false)
         , mButterFlyTexture((int)(log(float(N)) / log(2.0f)), N, GL_NEAREST, false, 32, false, true, false, nullptr)
+        , mOceanNoiseTexture(N, N, GL_NEAREST, false, 32, false)
         , mButterflyIndicesBuffer(N * sizeof(int))
+        , mN(N)
+        , mL(L)
+        , mPasses((int)(float(log(float(N))) / float(log(2.0f))))
+        , mH0WaveSettings(0.0f)
+        , mH0Valid(false)
     {
-        // upload random numbers
-        std::vector<float> randomNumbers;
-        randomNumbers.resize(N * N * 4);
-        for (int i = 0; i < N * N * 4; ++i)
-        {
-            randomNumbers[i] = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-        }
-        mOceanNoiseTexture.uploadData(&randomNumbers[0]);
+        // upload random numbers, kept so OceanCPU can build the same spectrum
+        mNoise = OceanCPU::randomNoise(N);
+        mOceanNoiseTexture.uploadData(mNoise.data());
 
         // butterfly index texture
         mBitReversedIndices.resize(N);
@@ -62,58 +60,81 @@ public:
 
     void precompute(
         Renderer    &renderer,
-        OceanParams &oceanParams)
+        OceanParams &oceanParams,
+        const bool   stockham)
     {
         oceanParams.mHeightSettings.x = mN;
         oceanParams.mHeightSettings.y = mL;
         renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mHeightSettings), sizeof(glm::ivec4), oceanParams.mHeightSettings);
 
         const int workGroupSize = int(float(mN) / float(PRECOMPUTE_OCEAN_WAVES_LOCAL_SIZE));
-        // pass 1
-        mOceanNoiseTexture.bindTexture(OCEAN_HEIGHTFIELD_NOISE);
-        bindPass1(false);
-        renderer.dispatch(PRECOMP_OCEAN_H0_SHADER, true, workGroupSize, workGroupSize, 1);
+        // pass 1, h0 only depends on N, L, the fixed noise and the wave settings
+        if (!mH0Valid || (oceanParams.mWaveSettings != mH0WaveSettings))
+        {
+            mOceanNoiseTexture.bindTexture(OCEAN_HEIGHTFIELD_NOISE);
+            bindPass1(false);
+            renderer.dispatch(PRECOMP_OCEAN_H0_SHADER, true, workGroupSize, workGroupSize, 1);
+            mH0WaveSettings = oceanParams.mWaveSettings;
+            mH0Valid = true;
+        }
 
         // pass 2
         bindPass2();
         renderer.dispatch(PRECOMP_OCEAN_H_SHADER, true, workGroupSize, workGroupSize, 1);
 
-        for (int texIdx = 0; texIdx < 3; ++texIdx)
-        {
-            mButterFlyTexture.bindImageTexture(BUTTERFLY_INPUT_TEX, GL_READ_ONLY);
-            // 0 = dx, 1 = dy, 2 = dz
-            bindPass3(texIdx);
+        inverseTransform(renderer, oceanParams, stockham);
+        finalize();
+    }
 
-            for (int i = 0; i < passes(); ++i)
+
+    // inverse fft of the packed dx, dy and dz spectra into the displacement map, either with
+    // log2(N) butterfly texture dispatches per direction or one shared memory stockham
+    // dispatch per direction. both leave the result in the spectra for a single inversion
+    void inverseTransform(
+        Renderer    &renderer,
+        OceanParams &oceanParams,
+        const bool   stockham)
+    {
+        const int workGroupSize = int(float(mN) / float(PRECOMPUTE_OCEAN_WAVES_LOCAL_SIZE));
+        if (stockham)
+        {
+            mOceanHDxySpectrumTexture.bindImageTexture(FFT_STOCKHAM_XY_TEX, GL_READ_WRITE);
+            mOceanHDzSpectrumTexture.bindImageTexture(FFT_STOCKHAM_Z_TEX, GL_READ_WRITE);
+            for (int direction = 0; direction < 2; ++direction)
             {
-                oceanParams.mPingPong.y = i;
-                oceanParams.mPingPong.z = 0;
+                oceanParams.mPingPong.z = direction;
                 renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mPingPong), sizeof(glm::ivec4), oceanParams.mPingPong);
-
-                renderer.dispatch(BUTTERFLY_SHADER, true, workGroupSize, workGroupSize, 1);
-
-                oceanParams.mPingPong.x++;
-                oceanParams.mPingPong.x = oceanParams.mPingPong.x % 2;
+                renderer.dispatch(FFT_STOCKHAM_SHADER, true, mN, 1, 1);
             }
 
-            for (int i = 0; i < passes(); ++i)
+            // the inversion reads the spectra, the same textures the butterflies end in
+            oceanParams.mPingPong.x = 0;
+            renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mPingPong), sizeof(glm::ivec4), oceanParams.mPingPong);
+        }
+        else
+        {
+            mButterFlyTexture.bindImageTexture(BUTTERFLY_INPUT_TEX, GL_READ_ONLY);
+            bindPass3();
+
+            for (int direction = 0; direction < 2; ++direction)
             {
-                oceanParams.mPingPong.y = i;
-                oceanParams.mPingPong.z = 1;
-                renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mPingPong), sizeof(glm::ivec4), oceanParams.mPingPong);
+                for (int i = 0; i < passes(); ++i)
+                {
+                    oceanParams.mPingPong.y = i;
+                    oceanParams.mPingPong.z = direction;
+                    renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mPingPong), sizeof(glm::ivec4), oceanParams.mPingPong);
 
-                renderer.dispatch(BUTTERFLY_SHADER, true, workGroupSize, workGroupSize, 1);
+                    renderer.dispatch(BUTTERFLY_SHADER, true, workGroupSize, workGroupSize, 1);
 
-                oceanParams.mPingPong.x++;
-                oceanParams.mPingPong.x = oceanParams.mPingPong.x % 2;
+                    oceanParams.mPingPong.x++;
+                    oceanParams.mPingPong.x = oceanParams.mPingPong.x % 2;
+                }
             }
-
-            oceanParams.mPingPong.w = texIdx;
             renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mPingPong), sizeof(glm::ivec4), oceanParams.mPingPong);
-            bindPass4(texIdx);
-            renderer.dispatch(INVERSION_SHADER, true, workGroupSize, workGroupSize, 1);
         }
-        finalize();
+
+        bindPass4();
+        renderer.dispatch(INVERSION_SHADER, true, workGroupSize, workGroupSize, 1);
     }
 
 
@@ -130,15 +151,10 @@ public:
     }
 
 
-    uint32_t dxTexId() const
-    {
-        return mOceanHDxSpectrumTexture.texId();
-    }
-
-
-    uint32_t dyTexId() const
+    // dx in rg and dy in ba
+    uint32_t dxyTexId() const
     {
-        return mOceanHDySpectrumTexture.texId();
+        return mOceanHDxySpectrumTexture.texId();
     }
 
 
@@ -165,11 +181,34 @@ public:
         return mPasses;
     }
 
+
+    int size() const
+    {
+        return mN;
+    }
+
+
+    // world size the displacement map repeats over
+    float length() const
+    {
+        return mL;
+    }
+
+
+    const std::vector<float>& noise() const
+    {
+        return mNoise;
+    }
+
 private:
 
     void precomputeButterflyIndices(
         Renderer& renderer)
     {
+        // the shader reads N from the ocean params, which still hold whatever cascade was last
+        glm::ivec4 heightSettings(mN, int(mL), 0, 0);
+        renderer.updateUniform(OCEAN_PARAMS, offsetof(OceanParams, mHeightSettings), sizeof(glm::ivec4), heightSettings);
+
         // compute butterfly indices
         mButterflyIndicesBuffer.bind(BUTTERFLY_INDICES);
         mButterFlyTexture.bindImageTexture(PRECOMPUTE_BUTTERFLY_OUTPUT, GL_WRITE_ONLY);
@@ -188,41 +227,27 @@ private:
     void bindPass2()
     {
         mOceanH0SpectrumTexture.bindImageTexture(OCEAN_HEIGHT_FINAL_H0K, GL_READ_ONLY);
-        mOceanHDxSpectrumTexture.bindImageTexture(OCEAN_HEIGHT_FINAL_H_X, GL_WRITE_ONLY);
-        mOceanHDySpectrumTexture.bindImageTexture(OCEAN_HEIGHT_FINAL_H_Y, GL_WRITE_ONLY);
+        mOceanHDxySpectrumTexture.bindImageTexture(OCEAN_HEIGHT_FINAL_H_XY, GL_WRITE_ONLY);
         mOceanHDzSpectrumTexture.bindImageTexture(OCEAN_HEIGHT_FINAL_H_Z, GL_WRITE_ONLY);
     }
 
 
-    void bindPass3(
-        const int differential)
+    void bindPass3()
     {
-        Texture* spectrum = nullptr;
-        switch (differential)
-        {
-        case 0: spectrum = &mOceanHDxSpectrumTexture; break;
-        case 1: spectrum = &mOceanHDySpectrumTexture; break;
-        case 2: spectrum = &mOceanHDzSpectrumTexture; break;
-        }
-
-        spectrum->bindImageTexture(BUTTERFLY_PINGPONG_TEX0, GL_READ_WRITE);
-        mPingPongTexture.bindImageTexture(BUTTERFLY_PINGPONG_TEX1, GL_READ_WRITE);
+        mOceanHDxySpectrumTexture.bindImageTexture(BUTTERFLY_PINGPONG_TEX0, GL_READ_WRITE);
+        mPingPongXYTexture.bindImageTexture(BUTTERFLY_PINGPONG_TEX1, GL_READ_WRITE);
+        mOceanHDzSpectrumTexture.bindImageTexture(BUTTERFLY_PINGPONG_TEX2, GL_READ_WRITE);
+        mPingPongZTexture.bindImageTexture(BUTTERFLY_PINGPONG_TEX3, GL_READ_WRITE);
     }
 
 
-    void bindPass4(
-        const int differential)
+    void bindPass4()
     {
-        Texture* spectrum = nullptr;
-        switch (differential)
-        {
-        case 0: spectrum = &mOceanHDxSpectrumTexture; break;
-        case 1: spectrum = &mOceanHDySpectrumTexture; break;
-        case 2: spectrum = &mOceanHDzSpectrumTexture; break;
-        }
-        spectrum->bindImageTexture(INVERSION_PINGPONG_TEX0, GL_READ_ONLY);
-        mPingPongTexture.bindImageTexture(INVERSION_PINGPONG_TEX1, GL_READ_ONLY);
-        mOceanDisplacementTexture.bindImageTexture(INVERSION_OUTPUT_TEX, GL_READ_WRITE);
+        mOceanHDxySpectrumTexture.bindImageTexture(INVERSION_PINGPONG_TEX0, GL_READ_ONLY);
+        mPingPongXYTexture.bindImageTexture(INVERSION_PINGPONG_TEX1, GL_READ_ONLY);
+        mOceanHDzSpectrumTexture.bindImageTexture(INVERSION_PINGPONG_TEX2, GL_READ_ONLY);
+        mPingPongZTexture.bindImageTexture(INVERSION_PINGPONG_TEX3, GL_READ_ONLY);
+        mOceanDisplacementTexture.bindImageTexture(INVERSION_OUTPUT_TEX, GL_WRITE_ONLY);
     }
 
 
@@ -266,10 +291,10 @@ private:
 
     Texture mOceanDisplacementTexture;
     Texture mOceanH0SpectrumTexture;
-    Texture mOceanHDxSpectrumTexture;
-    Texture mOceanHDySpectrumTexture;
+    Texture mOceanHDxySpectrumTexture;
     Texture mOceanHDzSpectrumTexture;
-    Texture mPingPongTexture;
+    Texture mPingPongXYTexture;
+    Texture mPingPongZTexture;
     Texture mButterFlyTexture;
     Texture mOceanNoiseTexture;
 
@@ -280,4 +305,9 @@ private:
     float mL;
     int mPasses;
     std::vector<int> mBitReversedIndices;
+    std::vector<float> mNoise;
+
+    // amplitude, wind speed and direction the cached h0 spectrum was computed for
+    glm::vec4 mH0WaveSettings;
+    bool mH0Valid;
 };
\ No newline at end of file
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "glew.h"
+#include "glm/glm.hpp"
+
+#include "deviceconstants.h"
+#include "devicestructs.h"
+#include "oceanfft.h"
+
+// number of persistently mapped readback buffers, each holds the three cascades back to back
+#define OCEAN_READBACK_RING_SIZE 3
+
+#define OCEAN_CASCADE_COUNT 3
+
+// cpu side water surface queries. the displacement maps of the three cascades are copied into a
+// fenced, persistently mapped ring of pack buffers every few frames and the queries read the
+// newest copy the gpu has finished, so nothing waits on the pipeline. the result is one or two
+// readbacks behind the rendered water. only use from the render thread
+class OceanQuery
+{
+public:
+    OceanQuery(
+        const OceanFFT* cascades[OCEAN_CASCADE_COUNT])
+        : mFrontSlot(-1)
+        , mWriteSlot(0)
+        , mInterval(1)
+        , mFrame(0)
+        , mLastCapture(0)
+        , mCaptures(0)
+        , mDropped(0)
+    {
+        size_t offset = 0;
+        for (int c = 0; c < OCEAN_CASCADE_COUNT; ++c)
+        {
+            mSizes[c] = cascades[c]->size();
+            mLengths[c] = cascades[c]->length();
+            mOffsets[c] = offset;
+            offset += size_t(mSizes[c]) * mSizes[c];
+        }
+        mSlotSize = offset;
+
+        const GLsizeiptr slotSize = GLsizeiptr(mSlotSize * sizeof(glm::vec4));
+        const GLbitfield mapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(OCEAN_READBACK_RING_SIZE, mPbos);
+        for (int i = 0; i < OCEAN_READBACK_RING_SIZE; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[i]);
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, slotSize, nullptr, mapFlags);
+            mMappedPbos[i] = (const glm::vec4*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slotSize, mapFlags);
+            mFences[i] = nullptr;
+            mSlots[i] = Slot();
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+
+    ~OceanQuery()
+    {
+        for (int i = 0; i < OCEAN_READBACK_RING_SIZE; ++i)
+        {
+            if (mFences[i] != nullptr)
+            {
+                glDeleteSync(mFences[i]);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[i]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(OCEAN_READBACK_RING_SIZE, mPbos);
+    }
+
+
+    // called once per frame after the cascades were computed for time seconds. picks up finished
+    // readbacks and queues a new one every interval() frames
+    void update(
+        const OceanFFT*    cascades[OCEAN_CASCADE_COUNT],
+        const OceanParams &oceanParams,
+        const float        time)
+    {
+        ++mFrame;
+        poll();
+
+        if ((mInterval <= 0) || ((mFrame - mLastCapture) < uint32_t(mInterval)))
+        {
+            return;
+        }
+
+        // the slot being read stays untouched, a slot still in flight is not overwritten either
+        int slot = -1;
+        for (int i = 0; i < OCEAN_READBACK_RING_SIZE; ++i)
+        {
+            const int candidate = (mWriteSlot + i) % OCEAN_READBACK_RING_SIZE;
+            if ((candidate != mFrontSlot) && (mFences[candidate] == nullptr))
+            {
+                slot = candidate;
+                break;
+            }
+        }
+        if (slot < 0)
+        {
+            ++mDropped;
+            return;
+        }
+
+        // the inversion wrote the maps as images
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[slot]);
+        for (int c = 0; c < OCEAN_CASCADE_COUNT; ++c)
+        {
+            const GLsizei size = GLsizei(size_t(mSizes[c]) * mSizes[c] * sizeof(glm::vec4));
+            glGetTextureImage(cascades[c]->displacementTexId(), 0, GL_RGBA, GL_FLOAT, size, (void*)(mOffsets[c] * sizeof(glm::vec4)));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // the same scale and scroll water.vert applies when the maps are sampled
+        Slot& s = mSlots[slot];
+        s.mFrame = mFrame;
+        s.mTime = time;
+        s.mLambda = glm::vec3(oceanParams.mReflection.w, oceanParams.mWaveSettings.x, oceanParams.mReflection.w);
+        s.mScroll = glm::vec2(oceanParams.mWaveSettings.z, oceanParams.mWaveSettings.w) * oceanParams.mWaveSettings.y * time;
+
+        mWriteSlot = (slot + 1) % OCEAN_READBACK_RING_SIZE;
+        mLastCapture = mFrame;
+        ++mCaptures;
+    }
+
+
+    // displacement of the water surface for undisplaced world xz positions, the three cascades
+    // summed the way water.vert does without its camera distance fade. false until the first
+    // readback arrived
+    bool displacements(
+        const std::vector<glm::vec2> &points,
+        std::vector<glm::vec3>       &result) const
+    {
+        if (!ready())
+        {
+            return false;
+        }
+
+        result.resize(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            result[i] = displacement(points[i]);
+        }
+        return true;
+    }
+
+
+    // water height at world xz positions. the surface is displaced sideways as well, so a few
+    // fixed point steps look for the undisplaced position that lands on the query point
+    bool heights(
+        const std::vector<glm::vec2> &points,
+        std::vector<float>           &result,
+        const int                     iterations = 4) const
+    {
+        if (!ready())
+        {
+            return false;
+        }
+
+        result.resize(points.size());
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            glm::vec2 position = points[i];
+            glm::vec3 d = displacement(position);
+            for (int j = 0; j < iterations; ++j)
+            {
+                position = points[i] - glm::vec2(d.x, d.z);
+                d = displacement(position);
+            }
+            result[i] = d.y;
+        }
+        return true;
+    }
+
+
+    bool ready() const
+    {
+        return mFrontSlot >= 0;
+    }
+
+
+    // time in seconds of the displacement the queries answer from
+    float sampleTime() const
+    {
+        return ready() ? mSlots[mFrontSlot].mTime : 0.0f;
+    }
+
+
+    // frames between the newest readback and the current frame
+    uint32_t latency() const
+    {
+        return ready() ? mFrame - mSlots[mFrontSlot].mFrame : 0;
+    }
+
+
+    // frames between two readbacks, 0 stops the readbacks and keeps the last one
+    void setInterval(
+        const int interval)
+    {
+        mInterval = interval;
+    }
+
+
+    int interval() const
+    {
+        return mInterval;
+    }
+
+
+    uint32_t captures() const
+    {
+        return mCaptures;
+    }
+
+
+    // readbacks skipped because every slot was still in flight
+    uint32_t dropped() const
+    {
+        return mDropped;
+    }
+
+private:
+
+    struct Slot
+    {
+        Slot()
+            : mFrame(0)
+            , mTime(0.0f)
+            , mLambda(0.0f)
+            , mScroll(0.0f)
+        {
+        }
+
+        uint32_t  mFrame;
+        float     mTime;
+        glm::vec3 mLambda;
+        glm::vec2 mScroll;
+    };
+
+
+    // makes the newest finished readback the one the queries read
+    void poll()
+    {
+        for (int i = 0; i < OCEAN_READBACK_RING_SIZE; ++i)
+        {
+            if ((mFences[i] == nullptr) || !isSignaled(mFences[i]))
+            {
+                continue;
+            }
+
+            glDeleteSync(mFences[i]);
+            mFences[i] = nullptr;
+            if ((mFrontSlot < 0) || (mSlots[i].mFrame > mSlots[mFrontSlot].mFrame))
+            {
+                mFrontSlot = i;
+            }
+        }
+    }
+
+
+    glm::vec3 displacement(
+        const glm::vec2 position) const
+    {
+        const Slot& s = mSlots[mFrontSlot];
+        glm::vec3 d(0.0f);
+        for (int c = 0; c < OCEAN_CASCADE_COUNT; ++c)
+        {
+            const glm::vec2 uv = (position + s.mScroll) / mLengths[c];
+            d += s.mLambda * sample(mMappedPbos[mFrontSlot] + mOffsets[c], mSizes[c], uv);
+        }
+        return d;
+    }
+
+
+    // bilinear lookup with repeat wrapping like the sampler of the displacement textures at mip 0
+    static glm::vec3 sample(
+        const glm::vec4 *texels,
+        const int        N,
+        const glm::vec2  uv)
+    {
+        const glm::vec2 p = uv * float(N) - 0.5f;
+        const glm::vec2 base = glm::floor(p);
+        const glm::vec2 f = p - base;
+        const int x0 = wrap(int(base.x), N);
+        const int y0 = wrap(int(base.y), N);
+        const int x1 = (x0 + 1) % N;
+        const int y1 = (y0 + 1) % N;
+
+        const glm::vec3 a = glm::mix(glm::vec3(texels[y0 * N + x0]), glm::vec3(texels[y0 * N + x1]), f.x);
+        const glm::vec3 b = glm::mix(glm::vec3(texels[y1 * N + x0]), glm::vec3(texels[y1 * N + x1]), f.x);
+        return glm::mix(a, b, f.y);
+    }
+
+
+    static int wrap(
+        const int x,
+        const int N)
+    {
+        const int r = x % N;
+        return r < 0 ? r + N : r;
+    }
+
+
+    static bool isSignaled(
+        GLsync fence)
+    {
+        const GLenum result = glClientWaitSync(fence, 0, 0);
+        return (result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED);
+    }
+
+
+    GLuint           mPbos[OCEAN_READBACK_RING_SIZE];
+    const glm::vec4* mMappedPbos[OCEAN_READBACK_RING_SIZE];
+    GLsync           mFences[OCEAN_READBACK_RING_SIZE];
+    Slot             mSlots[OCEAN_READBACK_RING_SIZE];
+
+    int      mSizes[OCEAN_CASCADE_COUNT];
+    float    mLengths[OCEAN_CASCADE_COUNT];
+    size_t   mOffsets[OCEAN_CASCADE_COUNT];
+    size_t   mSlotSize;
+
+    int      mFrontSlot;
+    int      mWriteSlot;
+    int      mInterval;
+    uint32_t mFrame;
+    uint32_t mLastCapture;
+    uint32_t mCaptures;
+    uint32_t mDropped;
+};
@@ -11,11 +11,21 @@
 #include "tinyobjloader/tiny_obj_loader.h"
 
 #include "nishita.h"
+#include "nishitabatch.h"
+#include "cloudreference.h"
+#include "noisebatch.h"
 #include "oceanfft.h"
+#include "oceanquery.h"
 
 
 Renderer::Renderer()
-    : mCloudTexture(CLOUD_RESOLUTION, CLOUD_RESOLUTION, CLOUD_RESOLUTION, 32, false)
+    : mCloudTexture(CLOUD_RESOLUTION, CLOUD_RESOLUTION, CLOUD_RESOLUTION, 8, 2, true)
+    , mCloudDetailTexture(CLOUD_RESOLUTION, CLOUD_RESOLUTION, CLOUD_RESOLUTION, 8, 4)
+    , mCloudBrickTexture(CLOUD_BRICK_RESOLUTION, CLOUD_BRICK_RESOLUTION, CLOUD_BRICK_RESOLUTION, 32, 1)
+    , mCloudLightTexture(CLOUD_LIGHT_RESOLUTION_XZ, CLOUD_LIGHT_RESOLUTION_Y, CLOUD_LIGHT_RESOLUTION_XZ, 32, 1)
+    , mWeatherSeed(1)
+    , mCloudScatterAnisotropy(0.0f)
+    , mCloudScatterBakes(0)
     , mOceanFFTHighRes(nullptr)
     , mOceanFFTMidRes(nullptr)
     , mOceanFFTLowRes(nullptr)
@@ -24,6 +34,16 @@ Renderer::Renderer()
     , mIrradianceResolution(IRRADIANCE_RESOLUTION, IRRADIANCE_RESOLUTION)
     , mPrefilterCubemapResolution(PREFILTER_CUBEMAP_RESOLUTION, PREFILTER_CUBEMAP_RESOLUTION)
     , mQuad(GL_TRIANGLE_STRIP, 4)
+    , mHosekOnGPU(false)
+    , mSkyCubemapKeyValid(false)
+    , mNishitaLUTTime(0.0f)
+    , mNishitaBenchmark(0.0f)
+    , mCloudStorageBenchmark(0.0f)
+    , mCloudTileBenchmark(0.0f)
+    , mCloudReferenceResult(0.0f)
+    , mNoiseCPUBenchmark(0.0f)
+    , mNishitaCPUTime(0.0f)
+    , mSkyViewCubemapDirty(true)
     , mClipmap(6)
     , mClipmapLevel(0)
     , mEditingMaterialIdx(0)
@@ -36,15 +56,29 @@ Renderer::Renderer()
     , mPrefilterCubemap(nullptr)
     , mWorleyNoiseRenderTexture(nullptr)
     , mCamera()
+    , mOceanQuery(nullptr)
     , mShowBuffersWindow(false)
     , mShowPropertiesWindow(true)
     , mShowSkyWindow(true)
     , mOceanWireframe(false)
     , mUpdateSky(true)
     , mUpdateIrradiance(true)
+    , mOceanStockham(true)
+    , mOceanFloatObjects(false)
+    , mOceanReadbackInterval(1)
     , mCloudNoiseUpdated(0)
     , mIrradianceSideUpdated(0)
     , mSkySideUpdated(0)
+    , mCloudNoiseDirty(true)
+    , mCloudNoiseFromCache(false)
+    , mCloudNoiseSaveCountdown(0)
+    , mCloudNoiseBakes(0)
+    , mCloudLightUpdates(0)
+    , mSceneDepthEmpty(false)
+    , mCloudOcclusion(true)
+    , mCloudTiled(false)
+    , mCloudStatsSteps(0.0f)
+    , mCloudStatsInfo(0.0f)
     , mRenderWater(true)
     , mDeltaTime(0.0f)
     , mLowResFactor(0.5f)
@@ -57,6 +91,10 @@ Renderer::Renderer()
 {
     mTimeQueries.push_back(std::make_unique<TimeQuery>(SHADER_COUNT));
     mTimeQueries.push_back(std::make_unique<TimeQuery>(SHADER_COUNT));
+    for (int i = 0; i < QUERY_DOUBLE_BUFFER_COUNT; ++i)
+    {
+        mCloudStatsBuffers.push_back(std::make_unique<ShaderBuffer>(sizeof(CloudStats)));
+    }
 
     mShaders[BUTTERFLY_SHADER] = std::make_unique<ShaderProgram>("butterfly", "./spv/butterflyoperation.spv");
     mShaders[INVERSION_SHADER] = std::make_unique<ShaderProgram>("fft", "./spv/inversion.spv");
@@ -77,6 +115,16 @@ Renderer::Renderer()
     mShaders[SCENE_OBJECT_SHADER] = std::make_unique<ShaderProgram>("sceneobject", "./spv/sceneobjvert.spv", "./spv/sceneobjfrag.spv");
     mShaders[PRECOMP_FRESNEL_SHADER] = std::make_unique<ShaderProgram>("fresnel", "./spv/precomputefresnel.spv");
     mShaders[PREFILTER_ENVIRONMENT_SHADER] = std::make_unique<ShaderProgram>("prefilterenvironment", "./spv/vert.spv", "./spv/prefilterenvironmentfrag.spv");
+    mShaders[PRECOMP_HOSEK_SHADER] = std::make_unique<ShaderProgram>("precomputehosek", "./spv/precomputehosek.spv");
+    mShaders[PRECOMP_SKYVIEW_SHADER] = std::make_unique<ShaderProgram>("precomputeskyview", "./spv/precomputeskyview.spv");
+    mShaders[PRECOMP_CLOUD_BRICK_SHADER] = std::make_unique<ShaderProgram>("precomputecloudbrick", "./spv/precomputecloudbrick.spv");
+    mShaders[PRECOMP_CLOUD_LIGHT_SHADER] = std::make_unique<ShaderProgram>("precomputecloudlight", "./spv/precomputecloudlight.spv");
+    mShaders[TEMPORAL_RECONSTRUCT_SHADER] = std::make_unique<ShaderProgram>("reconstruct", "./spv/temporalvert.spv", "./spv/temporalreconstructfrag.spv");
+    mShaders[SCENE_DEPTH_SHADER] = std::make_unique<ShaderProgram>("scenedepth", "./spv/sceneobjvert.spv", "./spv/scenedepthfrag.spv");
+    mShaders[CLOUD_TILE_SHADER] = std::make_unique<ShaderProgram>("cloudtile", "./spv/cloudtile.spv");
+    mShaders[CLOUD_STATS_SHADER] = std::make_unique<ShaderProgram>("cloudstats", "./spv/cloudstats.spv");
+    mShaders[PRECOMP_CLOUD_SCATTER_SHADER] = std::make_unique<ShaderProgram>("precomputecloudscatter", "./spv/precomputecloudscatter.spv");
+    mShaders[FFT_STOCKHAM_SHADER] = std::make_unique<ShaderProgram>("fftstockham", "./spv/fftstockham.spv");
 
     // cloud noise textures
     mCloudNoiseRenderTexture[0] = nullptr;
@@ -106,7 +154,7 @@ Renderer::Renderer()
 
     // initialize sun
     mSkyParams.mSunSetting = glm::vec4(0.0f, 1.0f, 0.0f, 20.0f);
-    mSkyParams.mNishitaSetting = glm::vec4(20.0f, 20.0f, 0.0f, 0.0f);
+    mSkyParams.mNishitaSetting = glm::vec4(20.0f, 20.0f, 1.0f, 0.0f);
     mSkyParams.mFogSettings = glm::vec4(3000.0f, 5000.0f, 0.0f, 0.0f);
     mSkyParams.mPrecomputeSettings.x = 0;
     mSkyParams.mPrecomputeSettings.y = 0;
@@ -122,22 +170,7 @@ Renderer::Renderer()
     addUniform(WORLEY_PARAMS, mWorleyNoiseParams);
 
     // initialize render params
-    mRenderParams.mSettings.x = 0.0f;
-    mRenderParams.mSettings.y = (1600.0f / 900.0f);
-    mRenderParams.mSettings.z = 0;
-    mRenderParams.mCloudSettings.x = 0.0f;
-    mRenderParams.mCloudSettings.y = 0.01f;
-    mRenderParams.mCloudSettings.z = 1.0f;
-    mRenderParams.mCloudSettings.w = 10000.0f;
-    mRenderParams.mCloudMapping.x = 4.0f;
-    mRenderParams.mCloudMapping.y = 4.0f;
-    mRenderParams.mCloudMapping.z = 0.8f;
-    mRenderParams.mCloudAbsorption.x = 1.0f;
-    mRenderParams.mSteps.x = 1024;
-    mRenderParams.mSteps.y = 8;
-    mRenderParams.mScreenSettings.x = 1600;
-    mRenderParams.mScreenSettings.y = 900;
-    mRenderParams.mScreenSettings.z = 0;
+    mRenderParams = defaultRenderParams();
     addUniform(RENDERER_PARAMS, mRenderParams);
 
     // initialize ocean params
@@ -158,6 +191,7 @@ Renderer::Renderer()
     // cubemap environment
     mSkyCubemap = std::make_unique<RenderCubemapTexture>(mEnvironmentResolution.x, false);
     mFinalSkyCubemap = std::make_unique<RenderCubemapTexture>(mEnvironmentResolution.x, false);
+    mSkyReadback = std::make_unique<SkyReadback>(uint32_t(mEnvironmentResolution.x));
     mIrradianceCubemap = std::make_unique<RenderCubemapTexture>(mIrradianceResolution.x, false);
     mPrefilterCubemap = std::make_unique<RenderCubemapTexture>(mPrefilterCubemapResolution.x, true);
 
@@ -165,6 +199,8 @@ Renderer::Renderer()
     mOceanFFTHighRes = std::make_unique<OceanFFT>(*this, OCEAN_RESOLUTION_1, OCEAN_DIMENSIONS_1);
     mOceanFFTMidRes = std::make_unique<OceanFFT>(*this, OCEAN_RESOLUTION_2, OCEAN_DIMENSIONS_2);
     mOceanFFTLowRes = std::make_unique<OceanFFT>(*this, OCEAN_RESOLUTION_3, OCEAN_DIMENSIONS_3);
+    const OceanFFT* cascades[OCEAN_CASCADE_COUNT] = { mOceanFFTHighRes.get(), mOceanFFTMidRes.get(), mOceanFFTLowRes.get() };
+    mOceanQuery = std::make_unique<OceanQuery>(cascades);
 
     // compute water geometry
     //updateWaterGrid();
@@ -185,7 +221,13 @@ Renderer::Renderer()
     mPrecomputeMatrix.mViewMatrix = glm::lookAt(glm::vec3(0, 1, 0), glm::vec3(0, 1, 0) + glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
 
     // hosek
-    mHosekSkyModel = std::make_unique<Hosek>(glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z), 512);
+    mHosekSkyModel = std::make_unique<Hosek>(mThreadPool, glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z), 512);
+    mHosekParamsBuffer = std::make_unique<ShaderBuffer>(sizeof(HosekSkyParams));
+
+    // nishita transmittance lut, the atmosphere is fixed so it is only built once
+    generateNishitaLUT();
+    mSkyViewLUT = std::make_unique<Texture>(SKYVIEW_LUT_WIDTH, SKYVIEW_LUT_HEIGHT, GL_LINEAR, false, 32, false, true, false, nullptr);
+    mCloudScatterLUT = std::make_unique<Texture>(CLOUD_SCATTER_LUT_WIDTH, CLOUD_SCATTER_LUT_HEIGHT, GL_LINEAR, false, 32, false, true, false, nullptr);
 
     // precompute fresnel
     mPrecomputedFresnelTexture = std::make_unique<Texture>(FRESNEL_RESOLUTION, FRESNEL_RESOLUTION, GL_LINEAR, false, 32, false, true, false, nullptr);
@@ -201,6 +243,13 @@ Renderer::Renderer()
     result = result && loadTexture(mBlueNoiseTexture, false, true, "./resources/blueNoise512.png");
     assert(result);
 
+    // an authored weather map replaces the generated one
+    if (!loadWeatherMap("./resources/weathermap.png", mWeatherMap))
+    {
+        mWeatherMap.generate(mWeatherSeed);
+    }
+    uploadWeatherMap();
+
     // load models
     std::string inputfile = "./models/box.obj";
     assert(loadModel(inputfile));
@@ -213,6 +262,36 @@ Renderer::~Renderer()
 }
 
 
+RendererParams Renderer::defaultRenderParams()
+{
+    RendererParams params;
+    memset(&params, 0, sizeof(RendererParams));
+    params.mSettings.x = 0.0f;
+    params.mSettings.y = (1600.0f / 900.0f);
+    params.mSettings.z = 0;
+    params.mCloudSettings.x = 0.0f;
+    params.mCloudSettings.y = 0.01f;
+    params.mCloudSettings.z = 1.0f;
+    params.mCloudSettings.w = 10000.0f;
+    params.mCloudMapping.x = 4.0f;
+    params.mCloudMapping.y = 4.0f;
+    params.mCloudMapping.z = 0.8f;
+    params.mCloudAbsorption.x = 1.0f;
+    params.mSteps.x = 1024;
+    params.mSteps.y = 8;
+    params.mSteps.z = 1;
+    params.mSteps.w = 1;
+    params.mScreenSettings.x = 1600;
+    params.mScreenSettings.y = 900;
+    params.mScreenSettings.z = 0;
+    params.mTemporalSettings = glm::ivec4(1, 0, 0, 0);
+    params.mCloudLod = glm::vec4(0.004f, 0.0f, 30000.0f, 0.0f);
+    params.mCloudStats = glm::ivec4(0);
+    params.mWeather = glm::vec4(1.0f, 0.0f, 1.0f, 0.0f);
+    return params;
+}
+
+
 bool Renderer::loadTexture(
     std::unique_ptr<Texture> &tex,
     const bool               mipmap,
@@ -492,7 +571,9 @@ void Renderer::renderWater(
         switch (mSkyParams.mPrecomputeSettings.y)
         {
             case NISHITA_SKY: 
+            case SKYVIEW_SKY:
             {
+                mSkyViewLUT->bindTexture(WATER_SKYVIEW_TEX);
                 if (precompute)
                 {
                     mSkyCubemap->bindTexture(WATER_ENV_TEX, 0);
@@ -530,8 +611,1025 @@ void Renderer::renderWater(
         }
         mShaders[WATER_SHADER]->disable();
     }
-    glDisable(GL_BLEND);
-    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+}
+
+
+void Renderer::benchmarkHosek()
+{
+    mHosekBenchmark.clear();
+
+    const uint32_t maxThreads = mThreadPool.threadCount();
+    for (uint32_t threadCount = 1; ; threadCount *= 2)
+    {
+        threadCount = std::min(threadCount, maxThreads);
+        const float texelsPerSec = mHosekSkyModel->benchmark(threadCount);
+        mHosekBenchmark.push_back(glm::vec2(threadCount, texelsPerSec));
+        std::cout << "Hosek (" << hosekBatchPath() << ") " << threadCount << " threads: " << texelsPerSec << " texels/sec" << std::endl;
+
+        if (threadCount == maxThreads)
+        {
+            break;
+        }
+    }
+
+    // restore the cubemap contents for the current sun direction
+    mHosekSkyModel->upload();
+}
+
+
+void Renderer::dispatchHosek(
+    const glm::vec3 &sunDir,
+    TextureCubemap  &target)
+{
+    HosekSkyParams params = mHosekSkyModel->prepareGPU(sunDir);
+    mHosekParamsBuffer->upload(&params);
+    mHosekParamsBuffer->bind(HOSEK_SKY_PARAMS);
+
+    const uint32_t groupCount = (mHosekSkyModel->size() + PRECOMPUTE_HOSEK_LOCAL_SIZE - 1) / PRECOMPUTE_HOSEK_LOCAL_SIZE;
+    mShaders[PRECOMP_HOSEK_SHADER]->use();
+    target.bindImageTexture(PRECOMPUTE_HOSEK_SKY_TEX, GL_WRITE_ONLY);
+    mShaders[PRECOMP_HOSEK_SHADER]->dispatch(true, groupCount, groupCount, 6);
+    mShaders[PRECOMP_HOSEK_SHADER]->disable();
+}
+
+
+void Renderer::checkHosekParity()
+{
+    mHosekParity.clear();
+
+    const uint32_t size = mHosekSkyModel->size();
+    const uint32_t faceSize = size * size;
+    TextureCubemap gpuCubemap(size);
+    std::vector<glm::vec4> gpuFaces(faceSize);
+
+    const float elevations[] = { 1.0f, 5.0f, 15.0f, 30.0f, 60.0f, 85.0f };
+    for (int i = 0; i < IM_ARRAYSIZE(elevations); ++i)
+    {
+        const float elevation = glm::radians(elevations[i]);
+        const glm::vec3 sunDir = glm::vec3(glm::cos(elevation), glm::sin(elevation), 0.0f);
+
+        dispatchHosek(sunDir, gpuCubemap);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+        // the double precision arhosek evaluation, not the batched float kernel
+        const std::vector<glm::vec4>& referenceFaces = mHosekSkyModel->computeReference(sunDir);
+        float maxError = 0.0f;
+        for (int s = 0; s < 6; ++s)
+        {
+            gpuCubemap.readback(s, gpuFaces.data());
+            for (uint32_t t = 0; t < faceSize; ++t)
+            {
+                const glm::vec3 diff = glm::abs(glm::vec3(gpuFaces[t]) - glm::vec3(referenceFaces[s * faceSize + t]));
+                maxError = glm::max(maxError, glm::max(diff.x, glm::max(diff.y, diff.z)));
+            }
+        }
+
+        mHosekParity.push_back(glm::vec2(elevations[i], maxError));
+        std::cout << "Hosek parity, elevation " << elevations[i] << ": max error against the double reference " << maxError << (maxError <= HOSEK_PARITY_TOLERANCE ? " (pass)" : " (fail)") << std::endl;
+    }
+
+    // regenerate the sky for the current sun direction
+    mUpdateSky = true;
+}
+
+
+void Renderer::checkHosekBatch()
+{
+    mHosekBatchError.clear();
+
+    const float elevations[] = { 1.0f, 5.0f, 15.0f, 30.0f, 60.0f, 85.0f };
+    for (int i = 0; i < IM_ARRAYSIZE(elevations); ++i)
+    {
+        const float elevation = glm::radians(elevations[i]);
+        const glm::vec3 sunDir = glm::vec3(glm::cos(elevation), glm::sin(elevation), 0.0f);
+        const float maxError = mHosekSkyModel->batchError(sunDir);
+
+        mHosekBatchError.push_back(glm::vec2(elevations[i], maxError));
+        std::cout << "Hosek batch (" << hosekBatchPath() << "), elevation " << elevations[i] << ": max relative error " << maxError;
+        std::cout << (maxError <= HOSEK_BATCH_TOLERANCE ? " (pass)" : " (fail)") << std::endl;
+    }
+
+    // regenerate the sky for the current sun direction
+    mUpdateSky = true;
+}
+
+
+void Renderer::generateNishitaLUT()
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<glm::vec4> data(NISHITA_LUT_WIDTH * NISHITA_LUT_HEIGHT);
+    mThreadPool.parallelFor(NISHITA_LUT_HEIGHT, [&data](uint32_t y)
+    {
+        for (int x = 0; x < NISHITA_LUT_WIDTH; ++x)
+        {
+            glm::vec3 samplePoint, sunDir;
+            nishitaLutParams(x, y, samplePoint, sunDir);
+            data[y * NISHITA_LUT_WIDTH + x] = glm::vec4(nishitaSunDepth(samplePoint, sunDir), 0.0f);
+        }
+    });
+
+    mNishitaLUT = std::make_unique<Texture>(NISHITA_LUT_WIDTH, NISHITA_LUT_HEIGHT, GL_LINEAR, false, 32, false, true, false, data.data());
+
+    const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    mNishitaLUTTime = elapsed.count();
+}
+
+
+void Renderer::renderNishitaSky()
+{
+    glViewport(0, 0, mSkyCubemap->width(), mSkyCubemap->height());
+
+    mNishitaLUT->bindTexture(PRECOMPUTE_SKY_TRANSMITTANCE_TEX);
+    mShaders[PRECOMP_SKY_SHADER]->use();
+    for (int i = 0; i < 6; ++i)
+    {
+        mSkyParams.mPrecomputeSettings.x = i;
+        updateUniform(SKY_PARAMS, offsetof(SkyParams, mPrecomputeSettings), sizeof(mSkyParams.mPrecomputeSettings), mSkyParams.mPrecomputeSettings);
+
+        mSkyCubemap->bind(i);
+        mQuad.draw();
+    }
+    mShaders[PRECOMP_SKY_SHADER]->disable();
+    mSkyCubemap->unbind();
+    mSkyCubemapKeyValid = false;
+}
+
+
+void Renderer::benchmarkNishita()
+{
+    const int iterations = 16;
+    const float useLUT = mSkyParams.mNishitaSetting.z;
+
+    TimeQuery query(2);
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        mSkyParams.mNishitaSetting.z = float(mode);
+        updateUniform(SKY_PARAMS, mSkyParams);
+
+        query.start(mode);
+        for (int i = 0; i < iterations; ++i)
+        {
+            renderNishitaSky();
+        }
+        query.end(mode);
+        mNishitaBenchmark[mode] = query.elapsedTime(mode) / float(iterations);
+    }
+
+    std::cout << "Nishita sky: full integral " << mNishitaBenchmark.x << " ms, transmittance lut " << mNishitaBenchmark.y << " ms per cubemap";
+    std::cout << " (" << (mNishitaBenchmark.x / glm::max(mNishitaBenchmark.y, 1e-6f)) << "x)" << std::endl;
+
+    // restore the setting and the cubemap contents
+    mSkyParams.mNishitaSetting.z = useLUT;
+    updateUniform(SKY_PARAMS, mSkyParams);
+    mUpdateSky = true;
+}
+
+
+void Renderer::renderSkyView()
+{
+    mNishitaLUT->bindTexture(PRECOMPUTE_SKYVIEW_TRANSMITTANCE_TEX);
+    mShaders[PRECOMP_SKYVIEW_SHADER]->use();
+    mSkyViewLUT->bindImageTexture(PRECOMPUTE_SKYVIEW_LUT_TEX, GL_WRITE_ONLY);
+    mShaders[PRECOMP_SKYVIEW_SHADER]->dispatch(true,
+        (SKYVIEW_LUT_WIDTH + PRECOMPUTE_SKYVIEW_LOCAL_SIZE - 1) / PRECOMPUTE_SKYVIEW_LOCAL_SIZE,
+        (SKYVIEW_LUT_HEIGHT + PRECOMPUTE_SKYVIEW_LOCAL_SIZE - 1) / PRECOMPUTE_SKYVIEW_LOCAL_SIZE,
+        1);
+    mShaders[PRECOMP_SKYVIEW_SHADER]->disable();
+
+    mSkyViewCubemapDirty = true;
+}
+
+
+void Renderer::resampleSkyView()
+{
+    glViewport(0, 0, mSkyCubemap->width(), mSkyCubemap->height());
+
+    mSkyViewLUT->bindTexture(PRECOMPUTE_SKY_SKYVIEW_TEX);
+    mShaders[PRECOMP_SKY_SHADER]->use();
+    for (int i = 0; i < 6; ++i)
+    {
+        mSkyParams.mPrecomputeSettings.x = i;
+        updateUniform(SKY_PARAMS, offsetof(SkyParams, mPrecomputeSettings), sizeof(mSkyParams.mPrecomputeSettings), mSkyParams.mPrecomputeSettings);
+
+        mSkyCubemap->bind(i);
+        mQuad.draw();
+    }
+    mShaders[PRECOMP_SKY_SHADER]->disable();
+    mSkyCubemap->unbind();
+    mSkyCubemapKeyValid = false;
+
+    mSkyViewCubemapDirty = false;
+}
+
+
+void Renderer::exportNishitaSky()
+{
+    NishitaBatchParams params;
+    params.mAltitude = 0.001f;
+    params.mRayleighIntensity = mSkyParams.mNishitaSetting.x;
+    params.mMieIntensity = mSkyParams.mNishitaSetting.y;
+    params.mSunDir = glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z);
+    NishitaCPU nishita(mThreadPool, params);
+
+    const int width = 1024;
+    const int height = 512;
+    const std::vector<glm::vec4> latLong = nishita.latLong(width, height);
+    const float latLongTime = nishita.lastTime();
+
+    // faces stacked vertically in gl texel order
+    const int size = mSkyCubemap->width();
+    const std::vector<glm::vec4> faces = nishita.cubemap(size);
+    const float cubemapTime = nishita.lastTime();
+
+    FreeImage_Initialise();
+    bool result = NishitaCPU::save("./nishita_latlong.exr", latLong, width, height);
+    result = NishitaCPU::save("./nishita_latlong.pfm", latLong, width, height) && result;
+    result = NishitaCPU::save("./nishita_cubemap.exr", faces, size, 6 * size) && result;
+    FreeImage_DeInitialise();
+
+    std::cout << "Nishita export (" << simdLanePath() << "): lat/long " << latLongTime << " ms, cubemap " << cubemapTime << " ms";
+    std::cout << (result ? "" : ", failed to write images") << std::endl;
+}
+
+
+void Renderer::checkNishitaGolden()
+{
+    const int width = 128;
+    const int height = 64;
+    const float elevations[] = { 1.0f, 5.0f, 20.0f, 45.0f, 89.0f };
+    const float azimuths[] = { 0.0f, 90.0f, 180.0f, 270.0f };
+
+    mNishitaGolden.clear();
+    mNishitaCPUTime = glm::vec2(0.0f);
+
+    FreeImage_Initialise();
+    for (const float elevation : elevations)
+    {
+        for (const float azimuth : azimuths)
+        {
+            // fixed intensities so the golden images do not depend on the gui state
+            const float e = glm::radians(elevation);
+            const float a = glm::radians(azimuth);
+            NishitaBatchParams params;
+            params.mAltitude = 0.001f;
+            params.mRayleighIntensity = 20.0f;
+            params.mMieIntensity = 20.0f;
+            params.mSunDir = glm::vec3(cos(e) * cos(a), sin(e), cos(e) * sin(a));
+            NishitaCPU nishita(mThreadPool, params);
+
+            const std::vector<glm::vec4> image = nishita.latLong(width, height);
+            mNishitaCPUTime.x += nishita.lastTime();
+            const std::vector<glm::vec4> reference = nishita.latLongReference(width, height);
+            mNishitaCPUTime.y += nishita.lastTime();
+
+            char fileName[256];
+            snprintf(fileName, sizeof(fileName), "%s/nishita_e%02d_a%03d.pfm", NISHITA_GOLDEN_DIRECTORY, int(elevation), int(azimuth));
+
+            // the golden images are committed, a missing one fails the check
+            std::vector<glm::vec4> golden;
+            float goldenError = -1.0f;
+            if (NishitaCPU::load(fileName, golden, width, height))
+            {
+                goldenError = NishitaCPU::maxRelativeError(image, golden);
+            }
+
+            const float referenceError = NishitaCPU::maxRelativeError(image, reference);
+            mNishitaGolden.push_back(glm::vec4(elevation, azimuth, referenceError, goldenError));
+
+            const bool pass = (referenceError <= NISHITA_GOLDEN_TOLERANCE) && (goldenError >= 0.0f) && (goldenError <= NISHITA_GOLDEN_TOLERANCE);
+            std::cout << "Nishita golden, elevation " << elevation << " azimuth " << azimuth << ": reference " << referenceError;
+            std::cout << ", golden " << goldenError << (goldenError < 0.0f ? " (missing " + std::string(fileName) + ", fail)" : (pass ? " (pass)" : " (fail)")) << std::endl;
+        }
+    }
+    FreeImage_DeInitialise();
+
+    const float imageCount = float(mNishitaGolden.size());
+    mNishitaCPUTime /= imageCount;
+    std::cout << "Nishita cpu (" << simdLanePath() << "): " << mNishitaCPUTime.x << " ms batched, " << mNishitaCPUTime.y << " ms nishitaSky() per image" << std::endl;
+}
+
+
+void Renderer::resetCloudHistory()
+{
+    const int blockSize = mRenderParams.mTemporalSettings.x;
+    if (blockSize > 1 && mScreenRenderTextures.size() > 0)
+    {
+        // round up so the blocks cover the whole low res target
+        const int width = (mScreenRenderTextures[0]->width() + blockSize - 1) / blockSize;
+        const int height = (mScreenRenderTextures[0]->height() + blockSize - 1) / blockSize;
+        mCloudSparseRenderTexture = std::make_unique<RenderTexture>(1, width, height);
+    }
+    else
+    {
+        mCloudSparseRenderTexture = nullptr;
+    }
+
+    mRenderParams.mTemporalSettings.y = 0;
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+}
+
+
+void Renderer::bakeCloudNoise()
+{
+    const CloudNoiseKey key = CloudNoiseCache::makeKey(mPerlinNoiseParams);
+
+    std::vector<uint8_t> detail;
+    std::vector<uint8_t> shape;
+    if (CloudNoiseCache::load(key, detail, shape))
+    {
+        mCloudDetailTexture.upload(detail.data(), GL_UNSIGNED_BYTE);
+        mCloudTexture.upload(shape.data(), GL_UNSIGNED_BYTE);
+        mCloudTexture.generateMipmaps();
+        mCloudNoiseFromCache = true;
+        mCloudNoiseSaveCountdown = 0;
+        return;
+    }
+
+    mCloudTexture.bindImageTexture(PRECOMPUTE_CLOUD_CLOUD_TEX, GL_WRITE_ONLY);
+    mCloudDetailTexture.bindImageTexture(PRECOMPUTE_CLOUD_DETAIL_TEX, GL_WRITE_ONLY);
+    const int workGroupSize = int(float(CLOUD_RESOLUTION) / float(PRECOMPUTE_CLOUD_LOCAL_SIZE));
+    mShaders[PRECOMP_CLOUD_SHADER]->dispatch(true, workGroupSize, workGroupSize, workGroupSize);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    mCloudTexture.generateMipmaps();
+
+    mCloudNoiseFromCache = false;
+    mCloudNoiseSaveCountdown = CLOUD_NOISE_CACHE_SAVE_DELAY;
+    ++mCloudNoiseBakes;
+}
+
+
+void Renderer::saveCloudNoise()
+{
+    const CloudNoiseKey key = CloudNoiseCache::makeKey(mPerlinNoiseParams);
+
+    const size_t voxelCount = size_t(CLOUD_RESOLUTION) * CLOUD_RESOLUTION * CLOUD_RESOLUTION;
+    std::vector<uint8_t> detail(voxelCount * 4);
+    std::vector<uint8_t> shape(voxelCount * 2);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    mCloudDetailTexture.download(detail.data(), GL_UNSIGNED_BYTE);
+    mCloudTexture.download(shape.data(), GL_UNSIGNED_BYTE);
+
+    if (CloudNoiseCache::save(key, detail, shape))
+    {
+        std::cout << "Cloud noise written to " << CLOUD_NOISE_CACHE_DIRECTORY << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed to write the cloud noise to " << CLOUD_NOISE_CACHE_DIRECTORY << std::endl;
+    }
+}
+
+
+void Renderer::drawTemporalQuad(
+    RenderTexture &target,
+    Texture3D     &cloudTexture)
+{
+    cloudTexture.bindTexture(QUAD_CLOUD_TEX);
+    mCloudBrickTexture.bindTexture(QUAD_CLOUD_BRICK_TEX);
+    mCloudLightTexture.bindTexture(QUAD_CLOUD_LIGHT_TEX);
+    mWeatherTexture->bindTexture(QUAD_WEATHER_TEX);
+    mWeatherBoundTexture->bindTexture(QUAD_WEATHER_BOUND_TEX);
+    mCloudScatterLUT->bindTexture(QUAD_CLOUD_SCATTER_TEX);
+    mSceneDepthRenderTexture->bindTexture(QUAD_SCENE_DEPTH_TEX, 0);
+    mCloudCostTexture->bindImageTexture(QUAD_CLOUD_COST_TEX, GL_WRITE_ONLY);
+    mBlueNoiseTexture->bindTexture(QUAD_NOISE_TEX);
+    mScreenRenderTextures[(mFrameCount + 1) % SCREEN_BUFFER_COUNT]->bindTexture(QUAD_PREV_SCREEN_TEX, 0);
+    switch (mSkyParams.mPrecomputeSettings.y)
+    {
+    case NISHITA_SKY: mSkyCubemap->bindTexture(QUAD_ENV_TEX, 0); break;
+    case HOSEK_SKY:   mHosekSkyModel->bind(QUAD_ENV_TEX);        break;
+    case SKYVIEW_SKY: mSkyViewLUT->bindTexture(QUAD_SKYVIEW_TEX);  break;
+    }
+
+    if (mCloudTiled)
+    {
+        target.bindImageTexture(CLOUD_TILE_OUTPUT_TEX, 0, GL_WRITE_ONLY);
+        mShaders[CLOUD_TILE_SHADER]->dispatch(true,
+            (target.width() + CLOUD_TILE_SIZE - 1) / CLOUD_TILE_SIZE,
+            (target.height() + CLOUD_TILE_SIZE - 1) / CLOUD_TILE_SIZE,
+            1);
+        return;
+    }
+
+    glViewport(0, 0, target.width(), target.height());
+    target.bind();
+    mShaders[TEMPORAL_QUAD_SHADER]->use();
+    mQuad.draw();
+    mShaders[TEMPORAL_QUAD_SHADER]->disable();
+    target.unbind();
+}
+
+
+void Renderer::benchmarkCloudStorage()
+{
+    if (mScreenRenderTextures.size() == 0)
+    {
+        return;
+    }
+
+    // rgba32f volume holding the same two channels, this is the 16 byte fetch the raymarch used to do
+    const size_t voxelCount = size_t(CLOUD_RESOLUTION) * CLOUD_RESOLUTION * CLOUD_RESOLUTION;
+    std::vector<uint8_t> shape(voxelCount * 2);
+    mCloudTexture.download(shape.data(), GL_UNSIGNED_BYTE);
+    std::vector<float> wide(voxelCount * 4, 0.0f);
+    for (size_t i = 0; i < voxelCount; ++i)
+    {
+        wide[i * 4 + 0] = float(shape[i * 2 + 0]) / 255.0f;
+        wide[i * 4 + 1] = float(shape[i * 2 + 1]) / 255.0f;
+    }
+    Texture3D reference(CLOUD_RESOLUTION, CLOUD_RESOLUTION, CLOUD_RESOLUTION, 32, 4);
+    reference.upload(wide.data());
+
+    // every pixel raymarched, independent of the amortization mode
+    const int blockSize = mRenderParams.mTemporalSettings.x;
+    mRenderParams.mTemporalSettings.x = 1;
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+
+    const int iterations = 16;
+    RenderTexture& target = *mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT];
+    TimeQuery query(2);
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        query.start(mode);
+        for (int i = 0; i < iterations; ++i)
+        {
+            drawTemporalQuad(target, (mode == 0) ? reference : mCloudTexture);
+        }
+        query.end(mode);
+        mCloudStorageBenchmark[mode] = query.elapsedTime(mode) / float(iterations);
+    }
+
+    mRenderParams.mTemporalSettings.x = blockSize;
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+    resetCloudHistory();
+
+    std::cout << "Cloud raymarch: rgba32f " << mCloudStorageBenchmark.x << " ms (" << reference.texelSize() << " bytes per fetch), ";
+    std::cout << "rg8 " << mCloudStorageBenchmark.y << " ms (" << mCloudTexture.texelSize() << " bytes per fetch)" << std::endl;
+}
+
+
+void Renderer::benchmarkCloudTiles()
+{
+    if (mScreenRenderTextures.size() == 0)
+    {
+        return;
+    }
+
+    // every pixel raymarched, independent of the amortization mode
+    const int blockSize = mRenderParams.mTemporalSettings.x;
+    mRenderParams.mTemporalSettings.x = 1;
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+
+    const bool tiled = mCloudTiled;
+    const int iterations = 16;
+    RenderTexture& target = *mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT];
+    TimeQuery query(2);
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        mCloudTiled = (mode == 1);
+        query.start(mode);
+        for (int i = 0; i < iterations; ++i)
+        {
+            drawTemporalQuad(target, mCloudTexture);
+        }
+        query.end(mode);
+        mCloudTileBenchmark[mode] = query.elapsedTime(mode) / float(iterations);
+    }
+    mCloudTiled = tiled;
+
+    mRenderParams.mTemporalSettings.x = blockSize;
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+    resetCloudHistory();
+
+    std::cout << "Cloud raymarch: fragment " << mCloudTileBenchmark.x << " ms, ";
+    std::cout << "tiled compute " << mCloudTileBenchmark.y << " ms" << std::endl;
+}
+
+
+void Renderer::compareCloudReference()
+{
+    if (mScreenRenderTextures.size() == 0)
+    {
+        return;
+    }
+
+    RenderTexture& target = *mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT];
+    const int width = target.width();
+    const int height = target.height();
+    const size_t pixelCount = size_t(width) * height;
+
+    // every pixel raymarched without temporal blending, the reference knows nothing about the scene
+    const RendererParams renderParams = mRenderParams;
+    mRenderParams.mTemporalSettings.x = 1;
+    mRenderParams.mScreenSettings.z = 0;
+    updateUniform(RENDERER_PARAMS, mRenderParams);
+    mSceneDepthRenderTexture->bind();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    mSceneDepthRenderTexture->unbind();
+    mSceneDepthEmpty = true;
+
+    std::vector<glm::vec4> gpu(pixelCount);
+    drawTemporalQuad(target, mCloudTexture);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGetTextureImage(target.getTextureId(0), 0, GL_RGBA, GL_FLOAT, GLsizei(pixelCount * sizeof(glm::vec4)), gpu.data());
+
+    // without density the pass returns the sky the clouds are composited over
+    std::vector<glm::vec4> sky(pixelCount);
+    mRenderParams.mCloudSettings.z = 0.0f;
+    updateUniform(RENDERER_PARAMS, mRenderParams);
+    drawTemporalQuad(target, mCloudTexture);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGetTextureImage(target.getTextureId(0), 0, GL_RGBA, GL_FLOAT, GLsizei(pixelCount * sizeof(glm::vec4)), sky.data());
+
+    mRenderParams = renderParams;
+    updateUniform(RENDERER_PARAMS, mRenderParams);
+    resetCloudHistory();
+
+    std::vector<uint8_t> shape(size_t(CLOUD_RESOLUTION) * CLOUD_RESOLUTION * CLOUD_RESOLUTION * 2);
+    mCloudTexture.download(shape.data(), GL_UNSIGNED_BYTE);
+
+    CloudReference reference(mThreadPool);
+    reference.setShape(shape);
+    reference.setWeather(mWeatherMap);
+
+    CloudReferenceParams params;
+    params.mRenderParams = mRenderParams;
+    params.mInvViewProjection = glm::inverse(mViewProjectionMat.mProjectionMatrix * mViewProjectionMat.mViewMatrix);
+    params.mSunDir = glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z);
+    params.mSunLuminance = mSkyParams.mSunLuminance;
+    params.mStepScale = 1;
+    std::vector<glm::vec4> image = reference.render(params, width, height);
+
+    double squaredError = 0.0;
+    float maxError = 0.0f;
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        image[i] = glm::vec4(CloudReference::composite(glm::vec3(sky[i]), image[i]), 1.0f);
+        const glm::vec3 diff = glm::abs(glm::vec3(gpu[i]) - glm::vec3(image[i]));
+        squaredError += double(glm::dot(diff, diff));
+        maxError = glm::max(maxError, glm::max(diff.x, glm::max(diff.y, diff.z)));
+    }
+
+    mCloudReferenceResult.x = reference.lastTime();
+    mCloudReferenceResult.y = reference.samplesPerSecondPerCore() * 1e-6f;
+    mCloudReferenceResult.z = float(sqrt(squaredError / double(pixelCount * 3)));
+    mCloudReferenceResult.w = maxError;
+
+    FreeImage_Initialise();
+    bool result = CloudReference::save("./cloud_reference.exr", image, width, height);
+    result = CloudReference::save("./cloud_gpu.exr", gpu, width, height) && result;
+    FreeImage_DeInitialise();
+
+    std::cout << "Cloud reference " << width << "x" << height << ": " << mCloudReferenceResult.x << " ms, " << reference.lastSamples() << " samples, ";
+    std::cout << mCloudReferenceResult.y << " M samples/s per core (" << mThreadPool.threadCount() << " threads)" << std::endl;
+    std::cout << "gpu against reference: rms " << mCloudReferenceResult.z << ", max " << mCloudReferenceResult.w;
+    std::cout << (result ? "" : ", failed to write images") << std::endl;
+}
+
+
+void Renderer::benchmarkNoiseCPU()
+{
+    const size_t voxelCount = size_t(CLOUD_RESOLUTION) * CLOUD_RESOLUTION * CLOUD_RESOLUTION;
+    std::vector<uint8_t> gpuDetail(voxelCount * 4);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    mCloudDetailTexture.download(gpuDetail.data(), GL_UNSIGNED_BYTE);
+
+    NoiseCPU noise(mThreadPool);
+    std::vector<uint8_t> detail;
+    std::vector<uint8_t> shape;
+    noise.cloudVolume(mPerlinNoiseParams, detail, shape);
+    const float simdTime = noise.lastTime();
+
+    std::vector<uint8_t> referenceDetail;
+    std::vector<uint8_t> referenceShape;
+    noise.cloudVolume(mPerlinNoiseParams, referenceDetail, referenceShape, true);
+    const float scalarTime = noise.lastTime();
+
+    const glm::vec2 gpuDiff = NoiseCPU::compare(detail, gpuDetail);
+    const glm::vec2 scalarDiff = NoiseCPU::compare(detail, referenceDetail);
+    mNoiseCPUBenchmark.x = float(voxelCount) / (simdTime * 1e3f);
+    mNoiseCPUBenchmark.y = float(voxelCount) / (scalarTime * 1e3f);
+    mNoiseCPUBenchmark.z = gpuDiff.x;
+    mNoiseCPUBenchmark.w = scalarDiff.x;
+
+    // the 2d preview noise at the resolution of the noise windows
+    const int size = int(mPerlinNoiseParams.mSettings.x);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    noise.perlinImage(mPerlinNoiseParams, size, size);
+    const float perlinTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    noise.worleyImage(mPerlinNoiseParams, mWorleyNoiseParams.mInvert, size, size);
+    const float worleyTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Cloud noise cpu (" << simdLanePath() << ", " << mThreadPool.threadCount() << " threads): ";
+    std::cout << simdTime << " ms simd, " << scalarTime << " ms scalar, ";
+    std::cout << mNoiseCPUBenchmark.x << " M voxels/s against " << mNoiseCPUBenchmark.y << " M voxels/s" << std::endl;
+    std::cout << "against the " << (mCloudNoiseFromCache ? "cached" : "gpu") << " volume: max " << gpuDiff.x << " steps, ";
+    std::cout << gpuDiff.y * 100.0f << "% off by more than one, against scalar: max " << scalarDiff.x << " steps" << std::endl;
+    std::cout << "2d noise " << size << "x" << size << ": perlin " << perlinTime << " ms, worley " << worleyTime << " ms" << std::endl;
+}
+
+
+void Renderer::benchmarkOceanFFT()
+{
+    const int sizes[] = { 64, 256, 512, 1024 };
+    const int iterations = 16;
+
+    mOceanFFTBenchmark.clear();
+    OceanParams params = mOceanParams;
+    TimeQuery query(2);
+    for (const int N : sizes)
+    {
+        OceanFFT fft(*this, N, float(OCEAN_DIMENSIONS_1));
+
+        // same spectrum through both paths
+        std::vector<glm::vec4> displacement[2];
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            displacement[mode].resize(size_t(N) * N);
+            fft.precompute(*this, params, mode == 1);
+            glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+            glGetTextureImage(fft.displacementTexId(), 0, GL_RGBA, GL_FLOAT, GLsizei(displacement[mode].size() * sizeof(glm::vec4)), displacement[mode].data());
+        }
+
+        float maxValue = 0.0f;
+        float maxDiff = 0.0f;
+        for (size_t i = 0; i < displacement[0].size(); ++i)
+        {
+            const glm::vec3 a = glm::vec3(displacement[0][i]);
+            const glm::vec3 diff = glm::abs(a - glm::vec3(displacement[1][i]));
+            maxValue = glm::max(maxValue, glm::max(glm::abs(a.x), glm::max(glm::abs(a.y), glm::abs(a.z))));
+            maxDiff = glm::max(maxDiff, glm::max(diff.x, glm::max(diff.y, diff.z)));
+        }
+
+        // only the transforms, they keep running on their own output which costs the same
+        glm::vec4 result(float(N), 0.0f, 0.0f, maxDiff / glm::max(maxValue, 1e-12f));
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            query.start(mode);
+            for (int i = 0; i < iterations; ++i)
+            {
+                fft.inverseTransform(*this, params, mode == 1);
+            }
+            query.end(mode);
+            result[mode + 1] = query.elapsedTime(mode) / float(iterations);
+        }
+        mOceanFFTBenchmark.push_back(result);
+
+        std::cout << "Ocean ifft " << N << "x" << N << ": butterfly " << result.y << " ms (" << 2 * fft.passes() + 1 << " dispatches), ";
+        std::cout << "stockham " << result.z << " ms (3 dispatches), max difference " << result.w << std::endl;
+    }
+}
+
+
+void Renderer::benchmarkOceanCPU()
+{
+    const int sizes[] = { 64, 256, 512, 1024 };
+    const int iterations = 8;
+
+    mOceanCPUBenchmark.clear();
+    OceanParams params = mOceanParams;
+    const float time = mRenderParams.mSettings.x;
+    for (const int N : sizes)
+    {
+        // the gpu displacement for the same noise and time
+        OceanFFT fft(*this, N, float(OCEAN_DIMENSIONS_1));
+        fft.precompute(*this, params, mOceanStockham);
+        std::vector<glm::vec4> gpuDisplacement(size_t(N) * N);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glGetTextureImage(fft.displacementTexId(), 0, GL_RGBA, GL_FLOAT, GLsizei(gpuDisplacement.size() * sizeof(glm::vec4)), gpuDisplacement.data());
+
+        OceanCPU ocean(mThreadPool, N, float(OCEAN_DIMENSIONS_1), fft.noise());
+        ocean.spectrum(params);
+        ocean.update(time);
+
+        float maxValue = 0.0f;
+        float maxDiff = 0.0f;
+        for (size_t i = 0; i < gpuDisplacement.size(); ++i)
+        {
+            const glm::vec3 a = glm::vec3(gpuDisplacement[i]);
+            const glm::vec3 diff = glm::abs(a - glm::vec3(ocean.displacement()[i]));
+            maxValue = glm::max(maxValue, glm::max(glm::abs(a.x), glm::max(glm::abs(a.y), glm::abs(a.z))));
+            maxDiff = glm::max(maxDiff, glm::max(diff.x, glm::max(diff.y, diff.z)));
+        }
+
+        float totalTime = 0.0f;
+        for (int i = 0; i < iterations; ++i)
+        {
+            ocean.update(time + float(i) * 0.016f);
+            totalTime += ocean.lastTime();
+        }
+
+        glm::vec4 result(float(N), totalTime / float(iterations), 0.0f, maxDiff / glm::max(maxValue, 1e-12f));
+        result.z = float(N) * float(N) / (result.y * 1e3f);
+        mOceanCPUBenchmark.push_back(result);
+
+        std::cout << "Ocean cpu " << N << "x" << N << " (" << simdLanePath() << ", " << mThreadPool.threadCount() << " threads): ";
+        std::cout << result.y << " ms, " << result.z << " M texels/s, max difference " << result.w << std::endl;
+    }
+}
+
+
+bool Renderer::renderCloudStill(
+    const std::string &fileName,
+    const int          width,
+    const int          height)
+{
+    ThreadPool threadPool;
+
+    // renderer defaults, overridden by the saved settings
+    CloudReferenceParams params;
+    params.mRenderParams = defaultRenderParams();
+    params.mStepScale = 1;
+
+    glm::vec3 sunDir(0.0f, 1.0f, 0.0f);
+    glm::vec2 nishitaIntensity(20.0f, 20.0f);
+    NoiseParams perlinParams;
+    perlinParams.mSettings = glm::vec4(1.0f, 1.0f, 0.4f, 1.0f);
+    perlinParams.mNoiseOctaves = 7;
+
+    mINI::INIFile file("oglrenderer.ini");
+    mINI::INIStructure ini;
+    if (file.read(ini))
+    {
+        if (ini.has("skyparams"))
+        {
+            sunDir.x = std::stof(ini["skyparams"]["x"]);
+            sunDir.y = std::stof(ini["skyparams"]["y"]);
+            sunDir.z = std::stof(ini["skyparams"]["z"]);
+            nishitaIntensity.x = std::stof(ini["skyparams"]["nishitarayleigh"]);
+            nishitaIntensity.y = std::stof(ini["skyparams"]["nishitamie"]);
+        }
+        if (ini.has("renderparams"))
+        {
+            params.mRenderParams.mCloudSettings.x = std::stof(ini["renderparams"]["anisotropy"]);
+            params.mRenderParams.mCloudSettings.z = std::stof(ini["renderparams"]["density"]);
+            params.mRenderParams.mCloudSettings.w = std::stof(ini["renderparams"]["height"]);
+            params.mRenderParams.mCloudMapping.x = std::stof(ini["renderparams"]["cloudu"]);
+            params.mRenderParams.mCloudMapping.y = std::stof(ini["renderparams"]["cloudv"]);
+            params.mRenderParams.mCloudMapping.z = std::stof(ini["renderparams"]["coverage"]);
+            params.mRenderParams.mSteps.x = std::stoi(ini["renderparams"]["maxsteps"]);
+            params.mRenderParams.mSteps.y = std::stoi(ini["renderparams"]["maxshadowsteps"]);
+            if (ini["renderparams"].has("weathermap"))
+            {
+                params.mRenderParams.mWeather.x = std::stof(ini["renderparams"]["weathermap"]);
+            }
+        }
+        if (ini.has("perlinparams"))
+        {
+            perlinParams.mNoiseOctaves = std::stoi(ini["perlinparams"]["octaves"]);
+            perlinParams.mSettings.z = std::stof(ini["perlinparams"]["frequency"]);
+        }
+    }
+
+    Camera camera;
+    const glm::mat4 projMatrix = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.1f, 10000.0f);
+    params.mInvViewProjection = glm::inverse(projMatrix * camera.getViewMatrix());
+    params.mSunDir = sunDir;
+
+    glm::vec3 rayleigh, mie, sunLuminance;
+    nishitaSky(0.001f, nishitaIntensity.x, nishitaIntensity.y, sunDir, sunDir, rayleigh, mie, sunLuminance);
+    params.mSunLuminance = glm::vec4(sunLuminance, 1.0f);
+
+    FreeImage_Initialise();
+    WeatherMap weatherMap;
+    if (!loadWeatherMap("./resources/weathermap.png", weatherMap))
+    {
+        weatherMap.generate(1);
+    }
+    params.mRenderParams.mWeather.y = weatherMap.lowestBase();
+    params.mRenderParams.mWeather.z = weatherMap.highestTop();
+
+    CloudReference reference(threadPool);
+    reference.setWeather(weatherMap);
+
+    // the noise the gpu baked last time, or the same bake on the cpu. cpu bakes are saved under
+    // their own key so the renderer never loads them in place of the compute shader's
+    const CloudNoiseKey cpuKey = CloudNoiseCache::makeKey(perlinParams, CLOUD_NOISE_CPU);
+    std::vector<uint8_t> detail;
+    std::vector<uint8_t> shape;
+    if (!CloudNoiseCache::load(CloudNoiseCache::makeKey(perlinParams), detail, shape) &&
+        !CloudNoiseCache::load(cpuKey, detail, shape))
+    {
+        NoiseCPU noise(threadPool);
+        noise.cloudVolume(perlinParams, detail, shape);
+        CloudNoiseCache::save(cpuKey, detail, shape);
+        std::cout << "Cloud noise baked on the cpu (" << simdLanePath() << ") in " << noise.lastTime() << " ms" << std::endl;
+    }
+    reference.setShape(shape);
+
+    std::vector<glm::vec4> image = reference.render(params, width, height);
+    threadPool.parallelFor(height, [&](uint32_t y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const Ray r = CloudReference::cameraRay(params.mInvViewProjection, x, y, width, height);
+            glm::vec3 skyRayleigh, skyMie, sky;
+            nishitaSky(0.001f, nishitaIntensity.x, nishitaIntensity.y, sunDir, r.mDir, skyRayleigh, skyMie, sky);
+
+            glm::vec4& pixel = image[size_t(y) * width + x];
+            pixel = glm::vec4(CloudReference::composite(sky, pixel), 1.0f);
+        }
+    });
+
+    const bool result = CloudReference::save(fileName, image, width, height);
+    FreeImage_DeInitialise();
+
+    std::cout << "Cloud still " << width << "x" << height << " (" << fileName << "): " << reference.lastTime() << " ms, ";
+    std::cout << reference.samplesPerSecondPerCore() * 1e-6f << " M samples/s per core (" << threadPool.threadCount() << " threads)";
+    std::cout << (result ? "" : ", failed to write the image") << std::endl;
+    return result;
+}
+
+
+bool Renderer::renderOceanStill(
+    const std::string &fileName,
+    const int          N,
+    const float        time)
+{
+    ThreadPool threadPool;
+
+    // renderer defaults, overridden by the saved settings
+    OceanParams params;
+    memset(&params, 0, sizeof(OceanParams));
+    params.mHeightSettings = glm::ivec4(N, OCEAN_DIMENSIONS_1, 0, 0);
+    params.mWaveSettings = glm::vec4(4.0f, 40.0f, 1.0f, 1.0f);
+
+    mINI::INIFile file("oglrenderer.ini");
+    mINI::INIStructure ini;
+    if (file.read(ini) && ini.has("oceanparams"))
+    {
+        params.mWaveSettings.x = std::stof(ini["oceanparams"]["amplitude"]);
+        params.mWaveSettings.y = std::stof(ini["oceanparams"]["speed"]);
+        params.mWaveSettings.z = std::stof(ini["oceanparams"]["dirX"]);
+        params.mWaveSettings.w = std::stof(ini["oceanparams"]["dirY"]);
+    }
+
+    OceanCPU ocean(threadPool, N, float(OCEAN_DIMENSIONS_1), OceanCPU::randomNoise(N));
+    ocean.spectrum(params);
+    ocean.update(time);
+
+    FreeImage_Initialise();
+    const bool result = CloudReference::save(fileName, ocean.displacement(), N, N);
+    FreeImage_DeInitialise();
+
+    std::cout << "Ocean still " << N << "x" << N << " at " << time << " s (" << fileName << "): " << ocean.lastTime() << " ms (";
+    std::cout << simdLanePath() << ", " << threadPool.threadCount() << " threads)";
+    std::cout << (result ? "" : ", failed to write the image") << std::endl;
+    return result;
+}
+
+
+bool Renderer::queryOceanDisplacement(
+    const std::vector<glm::vec2> &points,
+    std::vector<glm::vec3>       &displacement) const
+{
+    return mOceanQuery && mOceanQuery->displacements(points, displacement);
+}
+
+
+bool Renderer::queryOceanHeight(
+    const std::vector<glm::vec2> &points,
+    std::vector<float>           &heights) const
+{
+    return mOceanQuery && mOceanQuery->heights(points, heights);
+}
+
+
+void Renderer::floatObjects()
+{
+    std::vector<glm::vec2> points;
+    for (const glm::mat4 &matrix : mDrawCallMatrices)
+    {
+        points.push_back(glm::vec2(matrix[3][0], matrix[3][2]));
+    }
+
+    std::vector<float> heights;
+    if (points.empty() || !queryOceanHeight(points, heights))
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < mDrawCallMatrices.size(); ++i)
+    {
+        mDrawCallMatrices[i][3][1] = heights[i];
+    }
+    mModelMatsBuffer->upload(mDrawCallMatrices.data());
+}
+
+
+void Renderer::reduceCloudStats()
+{
+    // the cost image is written by the fragment or compute cloud pass
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    ShaderBuffer& buffer = *mCloudStatsBuffers[mFrameCount % QUERY_DOUBLE_BUFFER_COUNT];
+    buffer.upload(nullptr);
+    buffer.bind(CLOUD_STATS_BUFFER);
+    mCloudCostTexture->bindImageTexture(CLOUD_STATS_COST_TEX, GL_READ_ONLY);
+    mCloudHeatmapTexture->bindImageTexture(CLOUD_STATS_HEATMAP_TEX, GL_WRITE_ONLY);
+    mShaders[CLOUD_STATS_SHADER]->dispatch(true,
+        (mCloudCostTexture->width() + CLOUD_STATS_LOCAL_SIZE - 1) / CLOUD_STATS_LOCAL_SIZE,
+        (mCloudCostTexture->height() + CLOUD_STATS_LOCAL_SIZE - 1) / CLOUD_STATS_LOCAL_SIZE,
+        1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // read the previous frame's reduction so the map does not wait on this one
+    CloudStats stats;
+    mCloudStatsBuffers[(mFrameCount + 1) % QUERY_DOUBLE_BUFFER_COUNT]->download(&stats);
+    if (stats.mPixels == 0)
+    {
+        return;
+    }
+
+    const uint32_t p95Count = uint32_t(std::ceil(float(stats.mPixels) * 0.95f));
+    uint32_t p95 = 0;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < CLOUD_STATS_BINS; ++i)
+    {
+        count += stats.mHistogram[i];
+        if (count >= p95Count)
+        {
+            p95 = i;
+            break;
+        }
+    }
+
+    const double primarySteps = double((uint64_t(stats.mPrimaryStepsHi) << 32) | stats.mPrimaryStepsLo);
+    const double shadowSteps = double((uint64_t(stats.mShadowStepsHi) << 32) | stats.mShadowStepsLo);
+    mCloudStatsSteps.x = float(primarySteps / double(stats.mPixels));
+    mCloudStatsSteps.y = float(p95);
+    mCloudStatsSteps.z = float(stats.mMaxSteps);
+    mCloudStatsSteps.w = float(shadowSteps / double(stats.mPixels));
+    mCloudStatsInfo.x = float(stats.mMaxShadowSteps);
+    mCloudStatsInfo.y = float(stats.mEarlyExits) / float(stats.mPixels);
+    mCloudStatsInfo.z = float(stats.mPixels);
+}
+
+
+bool Renderer::loadWeatherMap(
+    const std::string &fileName,
+    WeatherMap        &weatherMap)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    fclose(file);
+
+    FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(fileName.c_str(), 0);
+    if (fif == FIF_UNKNOWN)
+    {
+        fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+    }
+    if ((fif == FIF_UNKNOWN) || !FreeImage_FIFSupportsReading(fif))
+    {
+        return false;
+    }
+
+    FIBITMAP* dib = FreeImage_Load(fif, fileName.c_str());
+    if (!dib)
+    {
+        return false;
+    }
+
+    // rgba8 at the weather map resolution, whatever the file holds
+    FIBITMAP* converted = FreeImage_ConvertTo32Bits(dib);
+    FreeImage_Unload(dib);
+    if ((FreeImage_GetWidth(converted) != WEATHER_MAP_RESOLUTION) || (FreeImage_GetHeight(converted) != WEATHER_MAP_RESOLUTION))
+    {
+        FIBITMAP* rescaled = FreeImage_Rescale(converted, WEATHER_MAP_RESOLUTION, WEATHER_MAP_RESOLUTION, FILTER_BILINEAR);
+        FreeImage_Unload(converted);
+        converted = rescaled;
+    }
+
+    std::vector<uint8_t> bgra(WEATHER_MAP_RESOLUTION * WEATHER_MAP_RESOLUTION * 4);
+    for (int y = 0; y < WEATHER_MAP_RESOLUTION; ++y)
+    {
+        memcpy(&bgra[y * WEATHER_MAP_RESOLUTION * 4], FreeImage_GetScanLine(converted, y), WEATHER_MAP_RESOLUTION * 4);
+    }
+    FreeImage_Unload(converted);
+
+    weatherMap.load(bgra.data());
+    std::cout << "Weather map loaded from " << fileName << std::endl;
+    return true;
+}
+
+
+void Renderer::uploadWeatherMap()
+{
+    mWeatherTexture = std::make_unique<Texture>(WEATHER_MAP_RESOLUTION, WEATHER_MAP_RESOLUTION, GL_LINEAR, false, 8, false, true, false, mWeatherMap.texels());
+    const std::vector<uint8_t> bound = mWeatherMap.bound();
+    mWeatherBoundTexture = std::make_unique<Texture>(WEATHER_MAP_RESOLUTION, WEATHER_MAP_RESOLUTION, GL_NEAREST, false, 8, false, true, false, bound.data());
+
+    mRenderParams.mWeather.y = mWeatherMap.lowestBase();
+    mRenderParams.mWeather.z = mWeatherMap.highestTop();
+    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mWeather), sizeof(glm::vec4), mRenderParams.mWeather);
 }
 
 
@@ -554,6 +1652,12 @@ void Renderer::resize(
         {
             mScreenRenderTextures[i] = std::make_unique<RenderTexture>(1, width * mLowResFactor, height * mLowResFactor);
         }
+        resetCloudHistory();
+        // one distance per cloud pixel, only filled while mCloudOcclusion is on
+        mSceneDepthRenderTexture = std::make_unique<RenderTexture>(1, width * mLowResFactor, height * mLowResFactor, GL_R32F);
+        mSceneDepthEmpty = false;
+        mCloudCostTexture = std::make_unique<Texture>(width * mLowResFactor, height * mLowResFactor, GL_NEAREST, false, 32, false);
+        mCloudHeatmapTexture = std::make_unique<Texture>(width * mLowResFactor, height * mLowResFactor, GL_NEAREST, false, 32, false);
         mCloudNoiseRenderTexture[0] = std::make_unique<RenderTexture>(1, 100, 100);
         mCloudNoiseRenderTexture[1] = std::make_unique<RenderTexture>(1, 100, 100);
         mCloudNoiseRenderTexture[2] = std::make_unique<RenderTexture>(1, 100, 100);
@@ -585,13 +1689,54 @@ void Renderer::preRender()
 
     mRenderStartTime = std::chrono::high_resolution_clock::now();
 
-    // precompute cloud's noise textures (perlin worley and worley fbm)
+    // precompute cloud's noise textures (perlin worley and worley fbm), only baked when the noise parameters change
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(PRECOMP_CLOUD_SHADER);
+    const bool cloudNoiseBaked = mCloudNoiseDirty;
     {
-        mCloudTexture.bindImageTexture(PRECOMPUTE_CLOUD_CLOUD_TEX, GL_READ_WRITE);
-        const int workGroupSize = int(float(CLOUD_RESOLUTION) / float(PRECOMPUTE_CLOUD_LOCAL_SIZE));
-        mShaders[PRECOMP_CLOUD_SHADER]->dispatch(true, workGroupSize, workGroupSize, workGroupSize);
-        mCloudNoiseUpdated |= (1 << (mFrameCount % 4));
+        const bool cloudChanged = (mCloudNoiseUpdated != 0xF);
+        if (mCloudNoiseDirty)
+        {
+            bakeCloudNoise();
+            mCloudNoiseDirty = false;
+
+            // coarse bound of the cloud density for the empty space skipping in raymarchCloud
+            mCloudTexture.bindImageTexture(PRECOMPUTE_CLOUD_BRICK_CLOUD_TEX, GL_READ_ONLY);
+            mCloudBrickTexture.bindImageTexture(PRECOMPUTE_CLOUD_BRICK_TEX, GL_WRITE_ONLY);
+            const int brickGroupSize = (CLOUD_BRICK_RESOLUTION + PRECOMPUTE_CLOUD_BRICK_LOCAL_SIZE - 1) / PRECOMPUTE_CLOUD_BRICK_LOCAL_SIZE;
+            mShaders[PRECOMP_CLOUD_BRICK_SHADER]->dispatch(true, brickGroupSize, brickGroupSize, brickGroupSize);
+        }
+        mCloudNoiseUpdated = 0xF;
+
+        // phase and multi scattering lut of the cloud shading, the first frame always bakes it
+        if ((mCloudScatterBakes == 0) || (mCloudScatterAnisotropy != mRenderParams.mCloudSettings.x))
+        {
+            mCloudScatterLUT->bindImageTexture(PRECOMPUTE_CLOUD_SCATTER_TEX, GL_WRITE_ONLY);
+            mShaders[PRECOMP_CLOUD_SCATTER_SHADER]->dispatch(true,
+                (CLOUD_SCATTER_LUT_WIDTH + PRECOMPUTE_CLOUD_SCATTER_LOCAL_SIZE - 1) / PRECOMPUTE_CLOUD_SCATTER_LOCAL_SIZE,
+                (CLOUD_SCATTER_LUT_HEIGHT + PRECOMPUTE_CLOUD_SCATTER_LOCAL_SIZE - 1) / PRECOMPUTE_CLOUD_SCATTER_LOCAL_SIZE,
+                1);
+            mCloudScatterAnisotropy = mRenderParams.mCloudSettings.x;
+            ++mCloudScatterBakes;
+        }
+
+        // write the bake to disk once the parameters settled
+        if ((mCloudNoiseSaveCountdown > 0) && (--mCloudNoiseSaveCountdown == 0))
+        {
+            saveCloudNoise();
+        }
+
+        // sun transmittance volume, only when the sun, the cloud settings or the noise changed. it is
+        // not read with the weather map on, toggling the map counts as a cloud change
+        const bool lightVolumeUsed = (mRenderParams.mSteps.w != 0) && (mRenderParams.mWeather.x == 0.0f);
+        if (lightVolumeUsed && (mUpdateSky || cloudChanged || cloudNoiseBaked))
+        {
+            mCloudTexture.bindTexture(PRECOMPUTE_CLOUD_LIGHT_CLOUD_TEX);
+            mCloudLightTexture.bindImageTexture(PRECOMPUTE_CLOUD_LIGHT_TEX, GL_WRITE_ONLY);
+            const int lightGroupSizeXZ = (CLOUD_LIGHT_RESOLUTION_XZ + PRECOMPUTE_CLOUD_LIGHT_LOCAL_SIZE - 1) / PRECOMPUTE_CLOUD_LIGHT_LOCAL_SIZE;
+            const int lightGroupSizeY = (CLOUD_LIGHT_RESOLUTION_Y + PRECOMPUTE_CLOUD_LIGHT_LOCAL_SIZE - 1) / PRECOMPUTE_CLOUD_LIGHT_LOCAL_SIZE;
+            mShaders[PRECOMP_CLOUD_LIGHT_SHADER]->dispatch(true, lightGroupSizeXZ, lightGroupSizeY, lightGroupSizeXZ);
+            ++mCloudLightUpdates;
+        }
     }
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(PRECOMP_CLOUD_SHADER);
 
@@ -619,12 +1764,12 @@ void Renderer::preRender()
         mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(WORLEY_NOISE_SHADER);
 
         mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(CLOUD_NOISE_SHADER);
-        for (int i = 0; i < 4; ++i)
+        for (int i = 0; (i < 4) && cloudNoiseBaked; ++i)
         {
             mWorleyNoiseParams.mTextureIdx = i;
             updateUniform(WORLEY_PARAMS, mWorleyNoiseParams);
 
-            mCloudTexture.bindTexture(CLOUD_NOISE_CLOUD_TEX);
+            mCloudDetailTexture.bindTexture(CLOUD_NOISE_CLOUD_TEX);
             mCloudNoiseRenderTexture[i]->bind();
             mShaders[CLOUD_NOISE_SHADER]->use();
             mQuad.draw();
@@ -638,9 +1783,18 @@ void Renderer::preRender()
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(PRECOMP_OCEAN_H0_SHADER);
     if (mRenderWater)
     {
-        mOceanFFTHighRes->precompute(*this, mOceanParams);
-        mOceanFFTMidRes->precompute(*this, mOceanParams);
-        mOceanFFTLowRes->precompute(*this, mOceanParams);
+        mOceanFFTHighRes->precompute(*this, mOceanParams, mOceanStockham);
+        mOceanFFTMidRes->precompute(*this, mOceanParams, mOceanStockham);
+        mOceanFFTLowRes->precompute(*this, mOceanParams, mOceanStockham);
+
+        // async readback for the cpu queries, the maps were computed for the time in the uniform
+        const OceanFFT* cascades[OCEAN_CASCADE_COUNT] = { mOceanFFTHighRes.get(), mOceanFFTMidRes.get(), mOceanFFTLowRes.get() };
+        mOceanQuery->setInterval(mOceanReadbackInterval);
+        mOceanQuery->update(cascades, mOceanParams, mRenderParams.mSettings.x);
+        if (mOceanFloatObjects)
+        {
+            floatObjects();
+        }
     }
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(PRECOMP_OCEAN_H0_SHADER);
 
@@ -650,7 +1804,8 @@ void Renderer::preRender()
     {
         glViewport(0, 0, int(mEnvironmentResolution.x), int(mEnvironmentResolution.y));
 
-        if (mSkyParams.mPrecomputeSettings.y == NISHITA_SKY)
+        const glm::vec3 sunDir = glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z);
+        if ((mSkyParams.mPrecomputeSettings.y == NISHITA_SKY) || (mSkyParams.mPrecomputeSettings.y == SKYVIEW_SKY))
         {
             glm::vec3 rayleigh, mie, sky;
             nishitaSky(
@@ -664,26 +1819,79 @@ void Renderer::preRender()
                 sky);
             mSkyParams.mSunLuminance = glm::vec4(sky.x, sky.y, sky.z, 1.0f);
             updateUniform(SKY_PARAMS, mSkyParams);
-            mShaders[PRECOMP_SKY_SHADER]->use();
-            for (int i = 0; i < 6; ++i)
+        }
+
+        if (mSkyParams.mPrecomputeSettings.y == SKYVIEW_SKY)
+        {
+            // a single small dispatch, cheaper than a cache lookup. the cubemap follows lazily
+            renderSkyView();
+        }
+        else if ((mSkyParams.mPrecomputeSettings.y == NISHITA_SKY) && (mSkyParams.mNishitaSetting.z > 0.5f))
+        {
+            // with the transmittance lut the render is cheaper than a readback or an upload
+            renderNishitaSky();
+        }
+        else if (mSkyParams.mPrecomputeSettings.y == NISHITA_SKY)
+        {
+            const uint32_t faceSize = mSkyCubemap->width() * mSkyCubemap->height();
+            const SkyCacheKey key = SkyCache::makeKey(NISHITA_SKY, mSkyCubemap->width(), sunDir, mSkyParams.mNishitaSetting.x, mSkyParams.mNishitaSetting.y, mSkyParams.mNishitaSetting.z);
+            if (!mSkyCubemapKeyValid || !(mSkyCubemapKey == key))
             {
-                mSkyParams.mPrecomputeSettings.x = i;
-                updateUniform(SKY_PARAMS, offsetof(SkyParams, mPrecomputeSettings), sizeof(mSkyParams.mPrecomputeSettings), mSkyParams.mPrecomputeSettings);
+                SkyCache::Faces faces = mSkyCache.find(key);
+                if (faces != nullptr)
+                {
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        mSkyCubemap->upload(i, &(*faces)[i * faceSize]);
+                    }
+                }
+                else
+                {
+                    renderNishitaSky();
+
+                    // keep the result around for the next time this sun direction comes up, the faces
+                    // reach the cache once the copy finished
+                    mSkyReadback->queue(key, *mSkyCubemap);
+                }
 
-                mSkyCubemap->bind(i);
-                mQuad.draw();
+                // the cubemap holds this entry until another sky is rendered into it
+                mSkyCubemapKey = key;
+                mSkyCubemapKeyValid = true;
             }
-            mShaders[PRECOMP_SKY_SHADER]->disable();
-            mSkyCubemap->unbind();
         }
         else if(mSkyParams.mPrecomputeSettings.y == HOSEK_SKY)
         {
             mSkyParams.mSunLuminance = glm::vec4(1.0f);
             updateUniform(SKY_PARAMS, mSkyParams);
-            mHosekSkyModel->update(glm::vec3(mSkyParams.mSunSetting.x, mSkyParams.mSunSetting.y, mSkyParams.mSunSetting.z));
+
+            // a hit only streams the cached faces, a miss evaluates the model on the background job
+            // or directly into the cubemap with the compute shader
+            const SkyCacheKey key = SkyCache::makeKey(HOSEK_SKY, mHosekSkyModel->size(), sunDir);
+            SkyCache::Faces faces = mSkyCache.find(key);
+            if (mHosekOnGPU && (faces == nullptr))
+            {
+                dispatchHosek(sunDir, mHosekSkyModel->cubemap());
+            }
+            else
+            {
+                mHosekSkyModel->update(sunDir, faces);
+            }
         }
         mUpdateSky = false;
     }
+
+    mSkyReadback->poll(mSkyCache);
+
+    // stream a finished background hosek regeneration, if any
+    mHosekSkyModel->poll();
+    {
+        glm::vec3 hosekSunDir;
+        SkyCache::Faces faces = mHosekSkyModel->fetchComputed(hosekSunDir);
+        if (faces != nullptr)
+        {
+            mSkyCache.insert(SkyCache::makeKey(HOSEK_SKY, mHosekSkyModel->size(), hosekSunDir), faces);
+        }
+    }
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(PRECOMP_SKY_SHADER);
 
     // bind fbo for the following
@@ -694,6 +1902,14 @@ void Renderer::preRender()
     mTimeQueries.at(mFrameCount% QUERY_DOUBLE_BUFFER_COUNT)->start(PRECOMP_ENV_SHADER);
     if(mCloudNoiseUpdated == 0xF)
     {
+        // the sky-view model only fills the cubemap once the environment pass actually runs
+        if ((mSkyParams.mPrecomputeSettings.y == SKYVIEW_SKY) && mSkyViewCubemapDirty)
+        {
+            resampleSkyView();
+            mSkyParams.mPrecomputeSettings.x = mFrameCount % 6;
+            updateUniform(SKY_PARAMS, offsetof(SkyParams, mPrecomputeSettings), sizeof(mSkyParams.mPrecomputeSettings), mSkyParams.mPrecomputeSettings);
+        }
+
         mFinalSkyCubemap->bind(mSkyParams.mPrecomputeSettings.x);
         glViewport(0, 0, int(mEnvironmentResolution.x), int(mEnvironmentResolution.y));
 
@@ -702,6 +1918,11 @@ void Renderer::preRender()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         mCloudTexture.bindTexture(PRECOMPUTE_ENVIRONMENT_CLOUD_TEX);
+        mCloudBrickTexture.bindTexture(PRECOMPUTE_ENVIRONMENT_BRICK_TEX);
+        mCloudLightTexture.bindTexture(PRECOMPUTE_ENVIRONMENT_LIGHT_TEX);
+        mWeatherTexture->bindTexture(PRECOMPUTE_ENVIRONMENT_WEATHER_TEX);
+        mWeatherBoundTexture->bindTexture(PRECOMPUTE_ENVIRONMENT_WEATHER_BOUND_TEX);
+        mCloudScatterLUT->bindTexture(PRECOMPUTE_ENVIRONMENT_SCATTER_TEX);
         mBlueNoiseTexture->bindTexture(PRECOMPUTE_ENVIRONMENT_NOISE_TEX);
         mSkyCubemap->bindTexture(PRECOMPUTE_ENVIRONMENT_SKY_TEX, 0);
         mShaders[PRECOMP_ENV_SHADER]->use();
@@ -844,25 +2065,103 @@ void Renderer::render()
     glClearColor(0, 0, 0, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // render quarter sized render texture
-    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(TEMPORAL_QUAD_SHADER);
+    // camera distance of the scene objects at cloud resolution so the cloud pass can skip or
+    // shorten covered rays, water is below the horizon and already skipped by the cloud pass.
+    // the objects are drawn into the default framebuffer after the clouds, so their depth is
+    // not around yet. with the occlusion off the target is cleared once and left alone
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(SCENE_DEPTH_SHADER);
+    if (mCloudOcclusion || !mSceneDepthEmpty)
     {
-        glViewport(0, 0, mResolution.x * mLowResFactor, mResolution.y * mLowResFactor);
-        mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT]->bind();
-        mCloudTexture.bindTexture(QUAD_CLOUD_TEX);
-        mBlueNoiseTexture->bindTexture(QUAD_NOISE_TEX);
-        mScreenRenderTextures[(mFrameCount + 1) % SCREEN_BUFFER_COUNT]->bindTexture(QUAD_PREV_SCREEN_TEX, 0);
-        switch (mSkyParams.mPrecomputeSettings.y)
+        glViewport(0, 0, mSceneDepthRenderTexture->width(), mSceneDepthRenderTexture->height());
+        mSceneDepthRenderTexture->bind();
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        mSceneDepthEmpty = !mCloudOcclusion;
+        if (mCloudOcclusion)
+        {
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_BACK);
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+
+            mShaders[SCENE_DEPTH_SHADER]->use();
+            mModelMatsBuffer->bind(SCENE_MODEL_MATRIX);
+            for (int i = 0; i < mDrawCalls.size(); ++i)
+            {
+                mSceneObjectParams.mIndices.x = i;
+                updateUniform(SCENE_OBJECT_PARAMS, mSceneObjectParams);
+                mDrawCalls[i]->draw();
+            }
+            mShaders[SCENE_DEPTH_SHADER]->disable();
+
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+        }
+        mSceneDepthRenderTexture->unbind();
+    }
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(SCENE_DEPTH_SHADER);
+
+    // pick the pixel of each bayer block that is raymarched this frame
+    static const int bayer2[4] = { 0, 2, 3, 1 };
+    static const int bayer4[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+    const int blockSize = mCloudSparseRenderTexture ? mRenderParams.mTemporalSettings.x : 1;
+    if (blockSize > 1)
+    {
+        const int* bayer = (blockSize == 2) ? bayer2 : bayer4;
+        const int rank = mFrameCount % (blockSize * blockSize);
+        for (int i = 0; i < blockSize * blockSize; ++i)
         {
-        case NISHITA_SKY: mSkyCubemap->bindTexture(QUAD_ENV_TEX, 0); break;
-        case HOSEK_SKY:   mHosekSkyModel->bind(QUAD_ENV_TEX);        break;
+            if (bayer[i] == rank)
+            {
+                mRenderParams.mTemporalSettings.z = i % blockSize;
+                mRenderParams.mTemporalSettings.w = i / blockSize;
+            }
         }
-        mShaders[TEMPORAL_QUAD_SHADER]->use();
+        updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mTemporalSettings), sizeof(glm::ivec4), mRenderParams.mTemporalSettings);
+    }
+
+    // render quarter sized render texture, or only one pixel per bayer block in the amortized mode.
+    // timed in the slot of whichever path ran so both show up in the gpu time list
+    const int cloudShader = mCloudTiled ? CLOUD_TILE_SHADER : TEMPORAL_QUAD_SHADER;
+    if (mRenderParams.mCloudStats.x != 0)
+    {
+        glClearTexImage(mCloudCostTexture->texId(), 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(cloudShader);
+    {
+        RenderTexture& cloudTarget = (blockSize > 1) ? *mCloudSparseRenderTexture : *mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT];
+        drawTemporalQuad(cloudTarget, mCloudTexture);
+    }
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(cloudShader);
+
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(CLOUD_STATS_SHADER);
+    if (mRenderParams.mCloudStats.x != 0)
+    {
+        reduceCloudStats();
+    }
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(CLOUD_STATS_SHADER);
+
+    // fill in the pixels that were not raymarched from the reprojected history
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(TEMPORAL_RECONSTRUCT_SHADER);
+    if (blockSize > 1)
+    {
+        glViewport(0, 0, mResolution.x * mLowResFactor, mResolution.y * mLowResFactor);
+        mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT]->bind();
+        mCloudSparseRenderTexture->bindTexture(RECONSTRUCT_SPARSE_TEX, 0);
+        mScreenRenderTextures[(mFrameCount + 1) % SCREEN_BUFFER_COUNT]->bindTexture(RECONSTRUCT_PREV_SCREEN_TEX, 0);
+        mShaders[TEMPORAL_RECONSTRUCT_SHADER]->use();
         mQuad.draw();
-        mShaders[TEMPORAL_QUAD_SHADER]->disable();
+        mShaders[TEMPORAL_RECONSTRUCT_SHADER]->disable();
         mScreenRenderTextures[mFrameCount % SCREEN_BUFFER_COUNT]->unbind();
+
+        ++mRenderParams.mTemporalSettings.y;
+        if (mRenderParams.mTemporalSettings.y >= 1000000)
+        {
+            mRenderParams.mTemporalSettings.y = blockSize * blockSize;
+        }
     }
-    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(TEMPORAL_QUAD_SHADER);
+    mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->end(TEMPORAL_RECONSTRUCT_SHADER);
 
     // render final quad
     mTimeQueries.at(mFrameCount % QUERY_DOUBLE_BUFFER_COUNT)->start(TEXTURED_QUAD_SHADER);
@@ -898,6 +2197,7 @@ void Renderer::render()
     mPrefilterCubemap->bindTexture(SCENE_OBJECT_PREFILTER_ENV, 0);
     mPrecomputedFresnelTexture->bindTexture(SCENE_OBJECT_PRECOMPUTED_GGX);
     mFinalSkyCubemap->bindTexture(SCENE_OBJECT_SKY, 0);
+    mSkyViewLUT->bindTexture(SCENE_OBJECT_SKYVIEW);
     for (int i = 0; i < mDrawCalls.size(); ++i)
     {
         // set model matrix index
@@ -1001,6 +2301,54 @@ void Renderer::renderGUI()
             {
                 mShowBuffersWindow = !mShowBuffersWindow;
             }
+            if (ImGui::MenuItem("Benchmark Hosek"))
+            {
+                benchmarkHosek();
+            }
+            if (ImGui::MenuItem("Hosek CPU/GPU parity"))
+            {
+                checkHosekParity();
+            }
+            if (ImGui::MenuItem("Hosek batch accuracy"))
+            {
+                checkHosekBatch();
+            }
+            if (ImGui::MenuItem("Benchmark Nishita"))
+            {
+                benchmarkNishita();
+            }
+            if (ImGui::MenuItem("Export Nishita sky"))
+            {
+                exportNishitaSky();
+            }
+            if (ImGui::MenuItem("Nishita golden images"))
+            {
+                checkNishitaGolden();
+            }
+            if (ImGui::MenuItem("Benchmark cloud storage"))
+            {
+                benchmarkCloudStorage();
+            }
+            if (ImGui::MenuItem("Benchmark tiled clouds"))
+            {
+                benchmarkCloudTiles();
+            }
+            if (ImGui::MenuItem("CPU cloud reference"))
+            {
+                compareCloudReference();
+            }
+            if (ImGui::MenuItem("CPU noise bake"))
+            {
+                benchmarkNoiseCPU();
+            }
+            if (ImGui::MenuItem("Benchmark ocean FFT"))
+            {
+                benchmarkOceanFFT();
+            }
+            if (ImGui::MenuItem("CPU ocean FFT"))
+            {
+                benchmarkOceanCPU();
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
@@ -1013,7 +2361,7 @@ void Renderer::renderGUI()
         {
             if (ImGui::BeginTabItem("Sky"))
             {
-                const static char* items[] = { "Nishita", "Hosek" };
+                const static char* items[] = { "Nishita", "Hosek", "Sky-view LUT" };
                 const char* comboLabel = items[mSkyParams.mPrecomputeSettings.y];  // Label to preview before opening the combo (technically it could be anything)
                 if (ImGui::BeginCombo("Sky model", comboLabel))
                 {
@@ -1095,6 +2443,29 @@ void Renderer::renderGUI()
                     updateUniform(SKY_PARAMS, mSkyParams);
                 }
 
+                if (mSkyParams.mPrecomputeSettings.y == HOSEK_SKY)
+                {
+                    if (ImGui::Checkbox("Evaluate on GPU", &mHosekOnGPU))
+                    {
+                        mUpdateSky = true;
+                    }
+                }
+                else if (mSkyParams.mPrecomputeSettings.y == NISHITA_SKY)
+                {
+                    bool useLUT = mSkyParams.mNishitaSetting.z > 0.5f;
+                    if (ImGui::Checkbox("Transmittance LUT", &useLUT))
+                    {
+                        mSkyParams.mNishitaSetting.z = useLUT ? 1.0f : 0.0f;
+                        mUpdateSky = true;
+                    }
+                }
+
+                bool useDiskCache = mSkyCache.useDisk();
+                if (ImGui::Checkbox("Cache sky on disk", &useDiskCache))
+                {
+                    mSkyCache.setUseDisk(useDiskCache);
+                }
+
                 ImGui::EndTabItem();
             }
             if (ImGui::BeginTabItem("Cloud"))
@@ -1164,6 +2535,7 @@ void Renderer::renderGUI()
                     mIrradianceSideUpdated = 0;
                     mSkySideUpdated = 0;
                     mCloudNoiseUpdated = 0;
+                    mCloudNoiseDirty = true;
                 }
 
                 if (ImGui::SliderFloat("Perlin freq", &mPerlinNoiseParams.mSettings.z, 0.0f, 100.0f, " %.3f", ImGuiSliderFlags_Logarithmic))
@@ -1173,6 +2545,7 @@ void Renderer::renderGUI()
                     mIrradianceSideUpdated = 0;
                     mSkySideUpdated = 0;
                     mCloudNoiseUpdated = 0;
+                    mCloudNoiseDirty = true;
                 }
                 if (ImGui::SliderFloat("Absorption", &mRenderParams.mCloudAbsorption.x, 0.0f, 1.0f))
                 {
@@ -1254,6 +2627,94 @@ void Renderer::renderGUI()
                     mSkySideUpdated = 0;
                     mCloudNoiseUpdated = 0;
                 }
+                bool skipEmpty = mRenderParams.mSteps.z != 0;
+                if (ImGui::Checkbox("Empty space skipping", &skipEmpty))
+                {
+                    mRenderParams.mSteps.z = skipEmpty ? 1 : 0;
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                }
+                bool lightVolume = mRenderParams.mSteps.w != 0;
+                if (ImGui::Checkbox("Cached light volume (no weather map)", &lightVolume))
+                {
+                    mRenderParams.mSteps.w = lightVolume ? 1 : 0;
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+
+                bool weatherMap = mRenderParams.mWeather.x != 0.0f;
+                if (ImGui::Checkbox("Weather map", &weatherMap))
+                {
+                    mRenderParams.mWeather.x = weatherMap ? 1.0f : 0.0f;
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Regenerate weather"))
+                {
+                    mWeatherMap.generate(++mWeatherSeed);
+                    uploadWeatherMap();
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+
+                if (ImGui::SliderFloat("LOD cone angle", &mRenderParams.mCloudLod.x, 0.0f, 0.02f, "%.4f"))
+                {
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+                if (ImGui::SliderFloat("LOD bias", &mRenderParams.mCloudLod.y, -2.0f, 4.0f))
+                {
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+                if (ImGui::SliderFloat("No erosion beyond", &mRenderParams.mCloudLod.z, 0.0f, 200000.0f))
+                {
+                    updateUniform(RENDERER_PARAMS, mRenderParams);
+                    mUpdateIrradiance = true;
+                    mIrradianceSideUpdated = 0;
+                    mSkySideUpdated = 0;
+                    mCloudNoiseUpdated = 0;
+                }
+
+                ImGui::Checkbox("Skip occluded clouds", &mCloudOcclusion);
+                ImGui::Checkbox("Tiled compute clouds", &mCloudTiled);
+
+                // raymarch 1 in blockSize^2 pixels per frame and reconstruct the rest
+                const static char* amortizeItems[] = { "Off", "1 in 4 (2x2 bayer)", "1 in 16 (4x4 bayer)" };
+                const static int amortizeBlockSizes[] = { 1, 2, 4 };
+                const int amortizeIndex = (mRenderParams.mTemporalSettings.x == 4) ? 2 : ((mRenderParams.mTemporalSettings.x == 2) ? 1 : 0);
+                if (ImGui::BeginCombo("Cloud amortization", amortizeItems[amortizeIndex]))
+                {
+                    for (int n = 0; n < IM_ARRAYSIZE(amortizeItems); n++)
+                    {
+                        const bool selected = (amortizeIndex == n);
+                        if (ImGui::Selectable(amortizeItems[n], selected))
+                        {
+                            mRenderParams.mTemporalSettings.x = amortizeBlockSizes[n];
+                            resetCloudHistory();
+                        }
+
+                        if (selected)
+                        {
+                            ImGui::SetItemDefaultFocus();
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
                 ImGui::EndTabItem();
             }
             if (ImGui::BeginTabItem("Ocean"))
@@ -1305,6 +2766,12 @@ void Renderer::renderGUI()
                     updateUniform(OCEAN_PARAMS, mOceanParams);
                 }
                 ImGui::Checkbox("Wireframe", &mOceanWireframe);
+                ImGui::Checkbox("Shared memory FFT", &mOceanStockham);
+                ImGui::SliderInt("Readback interval", &mOceanReadbackInterval, 0, 16);
+                if (mOceanQuery->ready())
+                {
+                    ImGui::Text("Readback: %.2f s, %u frames behind, %u dropped", mOceanQuery->sampleTime(), mOceanQuery->latency(), mOceanQuery->dropped());
+                }
 
                 if (mRenderWater)
                 {
@@ -1322,29 +2789,17 @@ void Renderer::renderGUI()
                         ImGui::Image(oceanSpectrumTexId, ImVec2(textureWidth, textureHeight), minUV, maxUV, tint, border);
                     }
 
-                    ImTextureID oceanHDxSpectrumTexId = (ImTextureID)mOceanFFTHighRes->dxTexId();
-                    {
-                        ImVec2 pos = ImGui::GetCursorScreenPos();
-                        ImVec2 minUV = ImVec2(0.0f, 0.0f);              // Top-left
-                        ImVec2 maxUV = ImVec2(1.0f, 1.0f);              // Lower-right
-                        ImVec4 tint = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);   // No tint
-                        ImVec4 border = ImVec4(1.0f, 1.0f, 1.0f, 0.5f); // 50% opaque white
-                        ImGui::Image(oceanHDxSpectrumTexId, ImVec2(textureWidth, textureHeight), minUV, maxUV, tint, border);
-                    }
-                    ImGui::SameLine();
-
-                    ImTextureID oceanHDySpectrumTexId = (ImTextureID)mOceanFFTHighRes->dyTexId();
+                    ImTextureID oceanHDxySpectrumTexId = (ImTextureID)mOceanFFTHighRes->dxyTexId();
                     {
                         ImVec2 pos = ImGui::GetCursorScreenPos();
                         ImVec2 minUV = ImVec2(0.0f, 0.0f);              // Top-left
                         ImVec2 maxUV = ImVec2(1.0f, 1.0f);              // Lower-right
                         ImVec4 tint = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);   // No tint
                         ImVec4 border = ImVec4(1.0f, 1.0f, 1.0f, 0.5f); // 50% opaque white
-                        ImGui::Image(oceanHDySpectrumTexId, ImVec2(textureWidth, textureHeight), minUV, maxUV, tint, border);
+                        ImGui::Image(oceanHDxySpectrumTexId, ImVec2(textureWidth, textureHeight), minUV, maxUV, tint, border);
                     }
                     ImGui::SameLine();
 
-
                     ImTextureID oceanHDzSpectrumTexId = (ImTextureID)mOceanFFTHighRes->dzTexId();
                     {
                         ImVec2 pos = ImGui::GetCursorScreenPos();
@@ -1443,6 +2898,7 @@ void Renderer::renderGUI()
                             sizeof(glm::mat4),
                             &mDrawCallMatrices[mEditingMaterialIdx]);
                     }
+                    ImGui::Checkbox("Float on water", &mOceanFloatObjects);
                 }
                 ImGui::EndTabItem();
             }
@@ -1545,6 +3001,121 @@ void Renderer::renderGUI()
                     }
                 }
 
+                ImGui::NewLine();
+                ImGui::Text("Sky cache");
+                const uint32_t skyLookups = mSkyCache.hits() + mSkyCache.diskHits() + mSkyCache.misses();
+                const float skyHitRate = skyLookups > 0 ? float(mSkyCache.hits() + mSkyCache.diskHits()) / float(skyLookups) : 0.0f;
+                ImGui::Text("hits: %d (disk: %d) misses: %d", mSkyCache.hits(), mSkyCache.diskHits(), mSkyCache.misses());
+                ImGui::Text("hit rate: %.1f%%", skyHitRate * 100.0f);
+                ImGui::Text("entries: %d (%.1f MB)", mSkyCache.entryCount(), float(mSkyCache.sizeInBytes()) / (1024.0f * 1024.0f));
+                ImGui::Text("readbacks dropped: %u", mSkyReadback->dropped());
+
+                ImGui::NewLine();
+                ImGui::Text("Cloud noise: %s, %d bakes", mCloudNoiseFromCache ? "disk cache" : "baked", mCloudNoiseBakes);
+                ImGui::Text("Cloud light volume updates: %d", mCloudLightUpdates);
+                ImGui::Text("Cloud scattering lut bakes: %d", mCloudScatterBakes);
+                if (mCloudStorageBenchmark.x > 0.0f)
+                {
+                    ImGui::Text("Cloud storage: rgba32f %.2f ms, rg8 %.2f ms (%.1fx)", mCloudStorageBenchmark.x, mCloudStorageBenchmark.y, mCloudStorageBenchmark.x / glm::max(mCloudStorageBenchmark.y, 1e-6f));
+                    ImGui::Text("bytes per fetch: 16 -> %d, volume: %.1f MB -> %.1f MB", mCloudTexture.texelSize(),
+                        float(CLOUD_RESOLUTION * CLOUD_RESOLUTION * CLOUD_RESOLUTION * 16) / (1024.0f * 1024.0f),
+                        float(CLOUD_RESOLUTION * CLOUD_RESOLUTION * CLOUD_RESOLUTION * mCloudTexture.texelSize()) / (1024.0f * 1024.0f));
+                }
+                if (mCloudTileBenchmark.x > 0.0f)
+                {
+                    ImGui::Text("Cloud pass: fragment %.2f ms, tiled compute %.2f ms", mCloudTileBenchmark.x, mCloudTileBenchmark.y);
+                }
+                if (mCloudReferenceResult.x > 0.0f)
+                {
+                    ImGui::Text("CPU cloud reference: %.0f ms, %.2f M samples/s per core", mCloudReferenceResult.x, mCloudReferenceResult.y);
+                    ImGui::Text("gpu error: rms %.4f, max %.4f", mCloudReferenceResult.z, mCloudReferenceResult.w);
+                }
+                if (mNoiseCPUBenchmark.x > 0.0f)
+                {
+                    ImGui::Text("CPU noise bake (%s): %.2f M voxels/s, scalar %.2f M voxels/s", simdLanePath(), mNoiseCPUBenchmark.x, mNoiseCPUBenchmark.y);
+                    ImGui::Text("max difference: gpu %.0f, scalar %.0f unorm8 steps", mNoiseCPUBenchmark.z, mNoiseCPUBenchmark.w);
+                }
+                for (const glm::vec4 &result : mOceanFFTBenchmark)
+                {
+                    ImGui::Text("Ocean ifft %.0f: butterfly %.3f ms, stockham %.3f ms, difference %.2e", result.x, result.y, result.z, result.w);
+                }
+                for (const glm::vec4 &result : mOceanCPUBenchmark)
+                {
+                    ImGui::Text("Ocean cpu %.0f (%s): %.3f ms, %.2f M texels/s, difference %.2e", result.x, simdLanePath(), result.y, result.z, result.w);
+                }
+
+                ImGui::NewLine();
+                bool cloudStats = mRenderParams.mCloudStats.x != 0;
+                if (ImGui::Checkbox("Cloud cost statistics", &cloudStats))
+                {
+                    mRenderParams.mCloudStats.x = cloudStats ? 1 : 0;
+                    updateUniform(RENDERER_PARAMS, offsetof(RendererParams, mCloudStats), sizeof(glm::ivec4), mRenderParams.mCloudStats);
+                    mCloudStatsSteps = glm::vec4(0.0f);
+                    mCloudStatsInfo = glm::vec3(0.0f);
+                }
+                if (cloudStats)
+                {
+                    ImGui::Text("primary steps: mean %.1f, p95 %.0f, max %.0f", mCloudStatsSteps.x, mCloudStatsSteps.y, mCloudStatsSteps.z);
+                    ImGui::Text("shadow steps: mean %.1f, max %.0f", mCloudStatsSteps.w, mCloudStatsInfo.x);
+                    ImGui::Text("early terminated: %.1f%% of %.0f pixels", mCloudStatsInfo.y * 100.0f, mCloudStatsInfo.z);
+
+                    // black to red over [0, max steps], flipped to top-down
+                    const float textureWidth = 256;
+                    const float textureHeight = textureWidth * float(mCloudHeatmapTexture->height()) / float(mCloudHeatmapTexture->width());
+                    ImTextureID heatmapId = (ImTextureID)mCloudHeatmapTexture->texId();
+                    ImGui::Image(heatmapId, ImVec2(textureWidth, textureHeight), ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+                }
+
+                ImGui::NewLine();
+                ImGui::Text("Nishita transmittance LUT: %.2f ms (cpu)", mNishitaLUTTime);
+                if (mNishitaBenchmark.x > 0.0f)
+                {
+                    ImGui::Text("sky precompute: %.2f ms full, %.2f ms lut (%.1fx)", mNishitaBenchmark.x, mNishitaBenchmark.y, mNishitaBenchmark.x / glm::max(mNishitaBenchmark.y, 1e-6f));
+                }
+
+                if (mNishitaGolden.size() > 0)
+                {
+                    ImGui::NewLine();
+                    ImGui::Text("Nishita cpu (%s): %.2f ms batched, %.2f ms reference", simdLanePath(), mNishitaCPUTime.x, mNishitaCPUTime.y);
+                    ImGui::Text("golden images (tolerance %.0e)", NISHITA_GOLDEN_TOLERANCE);
+                    for (size_t i = 0; i < mNishitaGolden.size(); ++i)
+                    {
+                        const glm::vec4& golden = mNishitaGolden[i];
+                        const bool pass = (golden.z <= NISHITA_GOLDEN_TOLERANCE) && (golden.w >= 0.0f) && (golden.w <= NISHITA_GOLDEN_TOLERANCE);
+                        ImGui::Text("%.0f/%.0f deg: %.2e %.2e %s", golden.x, golden.y, golden.z, golden.w, golden.w < 0.0f ? "missing" : (pass ? "pass" : "fail"));
+                    }
+                }
+
+                if (mHosekParity.size() > 0)
+                {
+                    ImGui::NewLine();
+                    ImGui::Text("Hosek GPU against double reference (tolerance %.0e)", HOSEK_PARITY_TOLERANCE);
+                    for (size_t i = 0; i < mHosekParity.size(); ++i)
+                    {
+                        ImGui::Text("%.0f deg: %.2e %s", mHosekParity[i].x, mHosekParity[i].y, mHosekParity[i].y <= HOSEK_PARITY_TOLERANCE ? "pass" : "fail");
+                    }
+                }
+
+                if (mHosekBatchError.size() > 0)
+                {
+                    ImGui::NewLine();
+                    ImGui::Text("Hosek batch (%s) against double (tolerance %.0e)", hosekBatchPath(), HOSEK_BATCH_TOLERANCE);
+                    for (const glm::vec2 &result : mHosekBatchError)
+                    {
+                        ImGui::Text("%.0f deg: %.2e %s", result.x, result.y, result.y <= HOSEK_BATCH_TOLERANCE ? "pass" : "fail");
+                    }
+                }
+
+                if (mHosekBenchmark.size() > 0)
+                {
+                    ImGui::NewLine();
+                    ImGui::Text("Hosek precompute (%s)", hosekBatchPath());
+                    for (size_t i = 0; i < mHosekBenchmark.size(); ++i)
+                    {
+                        ImGui::Text("%d threads: %.2f Mtexels/sec", int(mHosekBenchmark[i].x), mHosekBenchmark[i].y * 1e-6f);
+                    }
+                }
+
                 ImGui::EndTabItem();
             }
 
@@ -1631,6 +3202,8 @@ void Renderer::saveStates()
     ini["skyparams"]["fogmin"] = std::to_string(mSkyParams.mFogSettings.x);
     ini["skyparams"]["fogmax"] = std::to_string(mSkyParams.mFogSettings.y);
 
+    ini["skycache"]["disk"] = std::to_string(mSkyCache.useDisk() ? 1 : 0);
+
     ini["renderparams"]["anisotropy"] = std::to_string(mRenderParams.mCloudSettings.x);
     ini["renderparams"]["speed"] = std::to_string(mRenderParams.mCloudSettings.y);
     ini["renderparams"]["density"] = std::to_string(mRenderParams.mCloudSettings.z);
@@ -1640,6 +3213,15 @@ void Renderer::saveStates()
     ini["renderparams"]["coverage"] = std::to_string(mRenderParams.mCloudMapping.z);
     ini["renderparams"]["maxsteps"] = std::to_string(mRenderParams.mSteps.x);
     ini["renderparams"]["maxshadowsteps"] = std::to_string(mRenderParams.mSteps.y);
+    ini["renderparams"]["skipempty"] = std::to_string(mRenderParams.mSteps.z);
+    ini["renderparams"]["lightvolume"] = std::to_string(mRenderParams.mSteps.w);
+    ini["renderparams"]["weathermap"] = std::to_string(mRenderParams.mWeather.x);
+    ini["renderparams"]["amortize"] = std::to_string(mRenderParams.mTemporalSettings.x);
+    ini["renderparams"]["lodcone"] = std::to_string(mRenderParams.mCloudLod.x);
+    ini["renderparams"]["cloudocclusion"] = std::to_string(mCloudOcclusion);
+    ini["renderparams"]["cloudtiled"] = std::to_string(mCloudTiled);
+    ini["renderparams"]["lodbias"] = std::to_string(mRenderParams.mCloudLod.y);
+    ini["renderparams"]["lodfar"] = std::to_string(mRenderParams.mCloudLod.z);
 
     ini["perlinparams"]["frequency"] = std::to_string(mPerlinNoiseParams.mSettings.z);
     ini["perlinparams"]["octaves"] = std::to_string(mPerlinNoiseParams.mNoiseOctaves);
@@ -1695,6 +3277,11 @@ void Renderer::loadStates()
             mSkyParams.mFogSettings.y = std::stof(ini["skyparams"]["fogmax"]);
         }
 
+        if (ini.has("skycache"))
+        {
+            mSkyCache.setUseDisk(std::stoi(ini["skycache"]["disk"]) != 0);
+        }
+
         updateUniform(SKY_PARAMS, mSkyParams);
 
         if (ini.has("renderparams"))
@@ -1709,9 +3296,41 @@ void Renderer::loadStates()
 
             mRenderParams.mSteps.x = std::stoi(ini["renderparams"]["maxsteps"]);
             mRenderParams.mSteps.y = std::stoi(ini["renderparams"]["maxshadowsteps"]);
+            if (ini["renderparams"].has("skipempty"))
+            {
+                mRenderParams.mSteps.z = std::stoi(ini["renderparams"]["skipempty"]);
+            }
+            if (ini["renderparams"].has("lightvolume"))
+            {
+                mRenderParams.mSteps.w = std::stoi(ini["renderparams"]["lightvolume"]);
+            }
+            if (ini["renderparams"].has("weathermap"))
+            {
+                mRenderParams.mWeather.x = std::stof(ini["renderparams"]["weathermap"]);
+            }
+            if (ini["renderparams"].has("amortize"))
+            {
+                const int blockSize = std::stoi(ini["renderparams"]["amortize"]);
+                mRenderParams.mTemporalSettings.x = (blockSize == 2 || blockSize == 4) ? blockSize : 1;
+            }
+            if (ini["renderparams"].has("cloudtiled"))
+            {
+                mCloudTiled = bool(std::stoi(ini["renderparams"]["cloudtiled"]));
+            }
+            if (ini["renderparams"].has("cloudocclusion"))
+            {
+                mCloudOcclusion = bool(std::stoi(ini["renderparams"]["cloudocclusion"]));
+            }
+            if (ini["renderparams"].has("lodcone"))
+            {
+                mRenderParams.mCloudLod.x = std::stof(ini["renderparams"]["lodcone"]);
+                mRenderParams.mCloudLod.y = std::stof(ini["renderparams"]["lodbias"]);
+                mRenderParams.mCloudLod.z = std::stof(ini["renderparams"]["lodfar"]);
+            }
         }
 
         updateUniform(RENDERER_PARAMS, mRenderParams);
+        resetCloudHistory();
 
         if (ini.has("worleyparams"))
         {
@@ -1727,6 +3346,7 @@ void Renderer::loadStates()
         }
 
         updateUniform(PERLIN_PARAMS, mPerlinNoiseParams);
+        mCloudNoiseDirty = true;
 
         if(ini.has("oceanparams"))
         {
@@ -9,6 +9,7 @@
 
 #include "camera.h"
 #include "clipmap.h"
+#include "cloudnoisecache.h"
 #include "deviceconstants.h" 
 #include "devicestructs.h"
 #include "hosek.h"
@@ -17,11 +18,16 @@
 #include "shader.h"
 #include "shaderbuffer.h"
 #include "shaderprogram.h"
+#include "skycache.h"
+#include "skyreadback.h"
 #include "texture.h"
+#include "threadpool.h"
 #include "timequery.h"
 #include "vertexbuffer.h"
+#include "weathermap.h"
 
 class OceanFFT;
+class OceanQuery;
 class Renderer
 {
 public:
@@ -38,6 +44,31 @@ public:
     void resize(int width, 
                 int height);
 
+    // cpu reference clouds over the cpu nishita sky for the saved settings and the default
+    // camera, written as an exr. needs no gl context
+    static bool renderCloudStill(
+        const std::string &fileName,
+        const int          width,
+        const int          height);
+
+    // cpu displacement of one ocean cascade at time seconds for the saved wave settings,
+    // written as an exr with dx, dy and dz in rgb. needs no gl context
+    static bool renderOceanStill(
+        const std::string &fileName,
+        const int          N,
+        const float        time);
+
+    // water surface at world xz positions for cpu side simulation like buoyancy, answered from
+    // the ocean readback ring one or two frames behind the rendered water so nothing stalls.
+    // false until the first readback arrived
+    bool queryOceanDisplacement(
+        const std::vector<glm::vec2> &points,
+        std::vector<glm::vec3>       &displacement) const;
+
+    bool queryOceanHeight(
+        const std::vector<glm::vec2> &points,
+        std::vector<float>           &heights) const;
+
     void dispatch(
         const uint32_t shaderIdx,
         const bool     insertImageBarrier,
@@ -69,6 +100,9 @@ public:
 
 private:
 
+    // render params of a fresh start, shared by the gui and the headless stills
+    static RendererParams defaultRenderParams();
+
     template<class UniformType>
     void addUniform(
         uint32_t    bindingPt,
@@ -92,18 +126,116 @@ private:
         const bool               alpha,
         const std::string        &fileName);
 
+    // replace weatherMap with an image, false when the file is missing or unreadable
+    static bool loadWeatherMap(
+        const std::string &fileName,
+        WeatherMap        &weatherMap);
+
+    // create the weather textures from mWeatherMap and update the layer height range
+    void uploadWeatherMap();
+
     bool loadModel(
         const std::string& fileName);
 
     // initialize uniform white noise [0, 1]
     void renderWater(const bool precompute);
 
+    // measure cpu hosek precompute throughput for 1, 2, 4, ... threads
+    void benchmarkHosek();
+
+    // evaluate the hosek model with PRECOMP_HOSEK_SHADER into the given cubemap
+    void dispatchHosek(
+        const glm::vec3 &sunDir,
+        TextureCubemap  &target);
+
+    // compare the gpu hosek evaluation against the double precision arhosek reference for a few sun elevations
+    void checkHosekParity();
+
+    // compare the batched float hosek kernel against the double precision arhosek evaluation
+    void checkHosekBatch();
+
+    // build the nishita transmittance lut on the cpu with the shared nishita.h code
+    void generateNishitaLUT();
+
+    // draw the six faces of the nishita sky into mSkyCubemap
+    void renderNishitaSky();
+
+    // time the nishita precompute with the full sun ray integral and with the lut
+    void benchmarkNishita();
+
+    // render the hillaire sky-view lut with PRECOMP_SKYVIEW_SHADER in a single dispatch
+    void renderSkyView();
+
+    // resample the sky-view lut into mSkyCubemap, only done when the image based lighting needs it
+    void resampleSkyView();
+
+    // write the current nishita sky as lat/long and cubemap images evaluated on the cpu
+    void exportNishitaSky();
+
+    // compare the cpu nishita evaluator against nishitaSky() and the golden images over a grid of sun angles
+    void checkNishitaGolden();
+
+    // reallocate the sparse cloud target for the current bayer block size and invalidate the history
+    void resetCloudHistory();
+
+    // fill mCloudTexture for the current noise parameters, from the disk cache or with PRECOMP_CLOUD_SHADER
+    void bakeCloudNoise();
+
+    // read back mCloudTexture and store it in the disk cache
+    void saveCloudNoise();
+
+    // bind the temporal quad inputs and raymarch the clouds into target, with
+    // CLOUD_TILE_SHADER when mCloudTiled is set
+    void drawTemporalQuad(
+        RenderTexture &target,
+        Texture3D     &cloudTexture);
+
+    // time the cloud raymarch with the rg8 base shape against the same data in rgba32f
+    void benchmarkCloudStorage();
+
+    // time the fragment cloud pass against the tiled compute pass
+    void benchmarkCloudTiles();
+
+    // render the clouds with the cpu reference and compare against a full rate gpu cloud pass
+    void compareCloudReference();
+
+    // time the simd cpu noise bake against the scalar glsl port and compare both with the gpu bake
+    void benchmarkNoiseCPU();
+
+    // time the butterfly texture ifft against the shared memory stockham ifft per resolution
+    void benchmarkOceanFFT();
+
+    // time the simd cpu ocean fft per resolution and compare it with the gpu displacement
+    void benchmarkOceanCPU();
+
+    // heatmap and histogram reduction of this frame's cloud cost image,
+    // mCloudStatsSteps is filled from the previous frame's reduction
+    void reduceCloudStats();
+
+    // puts the scene objects on the water height under their origin
+    void floatObjects();
+
     // methods for saving/loading settings
     void saveStates();
     void loadStates();
 
     // textures
+    // base shape (perlin worley, worley fbm) sampled by the raymarch, with mips
     Texture3D                mCloudTexture;
+    // raw noise channels, only for the previews and the disk cache
+    Texture3D                mCloudDetailTexture;
+    // per brick max of cloudDensityBound over mCloudTexture, for empty space skipping
+    Texture3D                mCloudBrickTexture;
+    Texture3D                mCloudLightTexture;
+    // coverage, cloud type, base and top per column and its conservative 3x3 bound for skipping
+    WeatherMap               mWeatherMap;
+    uint32_t                 mWeatherSeed;
+    std::unique_ptr<Texture> mWeatherTexture;
+    std::unique_ptr<Texture> mWeatherBoundTexture;
+    // cloudMultiScatter by cos theta and optical depth, rebaked when the anisotropy changes
+    std::unique_ptr<Texture> mCloudScatterLUT;
+    float                    mCloudScatterAnisotropy;
+    uint32_t                 mCloudScatterBakes;
 
     // shaders
     std::unordered_map<uint32_t, std::unique_ptr<ShaderProgram>> mShaders;
@@ -124,11 +256,22 @@ private:
     bool          mUpdateSky;
     bool          mUpdateIrradiance;
     bool          mOceanWireframe;
+    // shared memory stockham ifft instead of the butterfly texture chain
+    bool          mOceanStockham;
+    // scene objects ride on the water height from the readback ring
+    bool          mOceanFloatObjects;
+    // frames between two ocean readbacks, 0 stops them
+    int           mOceanReadbackInterval;
 
     // bit flags to represent what sides of the cube are updated
     uint32_t      mIrradianceSideUpdated;
     uint32_t      mSkySideUpdated;
     uint32_t      mCloudNoiseUpdated;
+    bool          mCloudNoiseDirty;
+    bool          mCloudNoiseFromCache;
+    int           mCloudNoiseSaveCountdown;
+    uint32_t      mCloudNoiseBakes;
+    uint32_t      mCloudLightUpdates;
 
     std::vector<std::unique_ptr<TimeQuery>> mTimeQueries;
     float         mShaderTimestamps[SHADER_COUNT];
@@ -136,6 +279,22 @@ private:
 
     // 2D textures to display
     std::vector<std::unique_ptr<RenderTexture>> mScreenRenderTextures;
+    std::unique_ptr<RenderTexture> mCloudSparseRenderTexture;
+    // camera distance of the scene objects at cloud resolution, zero where nothing was drawn
+    std::unique_ptr<RenderTexture> mSceneDepthRenderTexture;
+    // the scene depth is cleared and nothing was drawn into it since
+    bool          mSceneDepthEmpty;
+    bool          mCloudOcclusion;
+    // raymarch the clouds with CLOUD_TILE_SHADER instead of the temporal quad
+    bool          mCloudTiled;
+    // per pixel cloud cost (primary steps, shadow steps, early exit, written) and its heatmap
+    std::unique_ptr<Texture> mCloudCostTexture;
+    std::unique_ptr<Texture> mCloudHeatmapTexture;
+    std::vector<std::unique_ptr<ShaderBuffer>> mCloudStatsBuffers;
+    // x: mean y: p95 z: max primary steps w: mean shadow steps per pixel
+    glm::vec4     mCloudStatsSteps;
+    // x: max shadow steps y: early terminated fraction z: pixels
+    glm::vec3     mCloudStatsInfo;
     std::unique_ptr<RenderTexture> mWorleyNoiseRenderTexture;
     std::unique_ptr<RenderTexture> mPerlinNoiseRenderTexture;
     std::unique_ptr<RenderTexture> mCloudNoiseRenderTexture[4];
@@ -177,6 +336,7 @@ private:
     std::unique_ptr<OceanFFT> mOceanFFTHighRes;
     std::unique_ptr<OceanFFT> mOceanFFTMidRes;
     std::unique_ptr<OceanFFT> mOceanFFTLowRes;
+    std::unique_ptr<OceanQuery> mOceanQuery;
 
     // gui
     bool mShowPropertiesWindow;
@@ -212,8 +372,59 @@ private:
     // all uniform buffers
     std::map<uint32_t, std::unique_ptr<UniformBuffer>> mUniforms;
 
+    // cpu worker threads, must outlive everything that dispatches to it
+    ThreadPool mThreadPool;
+
     // hosek sky model
     std::unique_ptr<Hosek> mHosekSkyModel;
+    std::vector<glm::vec2> mHosekBenchmark;
+    std::unique_ptr<ShaderBuffer> mHosekParamsBuffer;
+    bool mHosekOnGPU;
+    // x: sun elevation in degrees y: max abs error
+    std::vector<glm::vec2> mHosekParity;
+    // x: sun elevation in degrees y: max relative error of the batched kernel
+    std::vector<glm::vec2> mHosekBatchError;
+
+    // finished sky cubemaps keyed by sun direction
+    SkyCache mSkyCache;
+    // nishita renders on their way into the cache
+    std::unique_ptr<SkyReadback> mSkyReadback;
+    // cache entry mSkyCubemap currently holds, a repeated lookup of it does nothing
+    SkyCacheKey mSkyCubemapKey;
+    bool mSkyCubemapKeyValid;
+
+    // nishita sun optical depth (x: rayleigh, y: mie, z: sun visible) by altitude and sun zenith
+    std::unique_ptr<Texture> mNishitaLUT;
+    float mNishitaLUTTime;
+    // x: full integral y: lut, in ms per cubemap
+    glm::vec2 mNishitaBenchmark;
+
+    // x: rgba32f y: rg8 base shape, in ms per full rate cloud raymarch
+    glm::vec2 mCloudStorageBenchmark;
+    // x: fragment y: tiled compute, in ms per full rate cloud raymarch
+    glm::vec2 mCloudTileBenchmark;
+    // x: cpu reference in ms y: million samples per second per core
+    // z: rms and w: max error of the gpu cloud pass against the reference
+    glm::vec4 mCloudReferenceResult;
+    // x: simd y: scalar bake in million voxels per second, z: max difference of the simd
+    // bake against the gpu volume and w: against the scalar bake, in unorm8 steps
+    glm::vec4 mNoiseCPUBenchmark;
+    // x: N y: butterfly z: stockham in ms per dx, dy and dz ifft, w: max difference relative
+    // to the largest displacement
+    std::vector<glm::vec4> mOceanFFTBenchmark;
+    // x: N y: cpu displacement update in ms z: million texels per second, w: max difference
+    // to the gpu displacement relative to the largest displacement
+    std::vector<glm::vec4> mOceanCPUBenchmark;
+
+    // x: sun elevation y: sun azimuth in degrees z: max error against nishitaSky()
+    // w: max error against the golden image, negative when the golden image is missing
+    std::vector<glm::vec4> mNishitaGolden;
+    // x: batched y: scalar reference, in ms per lat/long image
+    glm::vec2 mNishitaCPUTime;
+
+    // nishita sky radiance by azimuth and elevation, replaces the cubemap for direct sky lookups
+    std::unique_ptr<Texture> mSkyViewLUT;
+    bool mSkyViewCubemapDirty;
 
     // clipmap for water plane
     Clipmap mClipmap;
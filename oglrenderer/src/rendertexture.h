@@ -10,11 +10,13 @@ class RenderTexture
 public:
 
     RenderTexture(
-        int count,
-        int width,
-        int height)
+        int          count,
+        int          width,
+        int          height,
+        const GLenum internalFormat = GL_RGBA32F)
         : mWidth(width)
         , mHeight(height)
+        , mInternalFormat(internalFormat)
         , mCount(count)
     {
         mTex.resize(count);
@@ -30,7 +32,7 @@ public:
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
             
             // TODO: make something else other than 32bit floating point textures
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, mWidth, mHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glTexImage2D(GL_TEXTURE_2D, 0, mInternalFormat, mWidth, mHeight, 0, GL_RGBA, GL_FLOAT, nullptr);
         }
         glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -86,6 +88,15 @@ public:
     }
 
 
+    void bindImageTexture(
+        const uint32_t texUnit,
+        const uint32_t slot,
+        const GLenum   readWriteState) const
+    {
+        glBindImageTexture(texUnit, mTex[slot], 0, GL_FALSE, 0, readWriteState, mInternalFormat);
+    }
+
+
     GLuint getTextureId(
         const uint32_t slot) const
     {
@@ -128,6 +139,7 @@ protected:
 
     int mWidth;
     int mHeight;
+    GLenum mInternalFormat;
 
 private:
     int mCount;
@@ -146,6 +158,7 @@ public:
         mMipmap = mipmap;
         mWidth = dimension;
         mHeight = dimension;
+        mInternalFormat = GL_RGBA32F;
         mTex.resize(1);
 
         GLenum t = glGetError();
@@ -234,6 +247,27 @@ public:
     }
 
 
+    // copies RGBA32F texels of one face back to the cpu, stalls until the face is rendered
+    void readback(
+        const uint32_t face,
+        void           *data)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, mTex[0]);
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, GL_FLOAT, data);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+
+    void upload(
+        const uint32_t face,
+        const void     *data)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, mTex[0]);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, mWidth, mHeight, GL_RGBA, GL_FLOAT, data);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+
     void generateMipmap()
     {
         if (mMipmap)
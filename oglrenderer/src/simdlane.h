@@ -0,0 +1,285 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define SIMD_LANE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define SIMD_LANE_SSE2
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// lane wrappers, every path runs the exact same instruction sequence so
+// the scalar, sse and avx2 results only differ by rounding in the hardware.
+// comparisons return a mask in the same type which is only meant to be
+// consumed by select, any and the bitwise and. the Int companions hold
+// 32 bit unsigned integers with wrapping multiply and xor, as glsl uint
+
+struct SimdLane1i
+{
+    uint32_t v;
+
+    static SimdLane1i set(const uint32_t i)                 { return { i }; }
+    friend SimdLane1i operator*(SimdLane1i a, SimdLane1i b) { return { a.v * b.v }; }
+    friend SimdLane1i operator^(SimdLane1i a, SimdLane1i b) { return { a.v ^ b.v }; }
+};
+
+
+struct SimdLane1
+{
+    typedef SimdLane1i Int;
+    static const int Width = 1;
+    float v;
+
+    static SimdLane1 load(const float *p)             { return { *p }; }
+    static SimdLane1 set(const float f)               { return { f }; }
+    void store(float *p) const                         { *p = v; }
+
+    friend SimdLane1 operator+(SimdLane1 a, SimdLane1 b) { return { a.v + b.v }; }
+    friend SimdLane1 operator-(SimdLane1 a, SimdLane1 b) { return { a.v - b.v }; }
+    friend SimdLane1 operator*(SimdLane1 a, SimdLane1 b) { return { a.v * b.v }; }
+    friend SimdLane1 operator/(SimdLane1 a, SimdLane1 b) { return { a.v / b.v }; }
+    friend SimdLane1 operator&(SimdLane1 a, SimdLane1 b) { return { (a.v != 0.0f && b.v != 0.0f) ? 1.0f : 0.0f }; }
+
+    static SimdLane1 min(SimdLane1 a, SimdLane1 b)  { return { a.v < b.v ? a.v : b.v }; }
+    static SimdLane1 max(SimdLane1 a, SimdLane1 b)  { return { a.v > b.v ? a.v : b.v }; }
+    static SimdLane1 sqrt(SimdLane1 a)              { return { sqrtf(a.v) }; }
+    static SimdLane1 floor(SimdLane1 a)             { return { floorf(a.v) }; }
+
+    static SimdLane1 less(SimdLane1 a, SimdLane1 b)         { return { a.v < b.v ? 1.0f : 0.0f }; }
+    static SimdLane1 lessEqual(SimdLane1 a, SimdLane1 b)    { return { a.v <= b.v ? 1.0f : 0.0f }; }
+    static SimdLane1 select(SimdLane1 m, SimdLane1 a, SimdLane1 b) { return { m.v != 0.0f ? a.v : b.v }; }
+    static bool any(SimdLane1 m)                            { return m.v != 0.0f; }
+
+    // 2^n for integral n stored as float
+    static SimdLane1 exp2i(SimdLane1 n)
+    {
+        int bits = (int(n.v) + 127) << 23;
+        float f;
+        memcpy(&f, &bits, sizeof(float));
+        return { f };
+    }
+
+    // uint(int(a)) and float(a) of glsl
+    static SimdLane1i toInt(SimdLane1 a)    { return { uint32_t(int32_t(a.v)) }; }
+    static SimdLane1 toFloat(SimdLane1i a)  { return { float(a.v) }; }
+};
+
+
+#if defined(SIMD_LANE_SSE2) || defined(SIMD_LANE_AVX2)
+struct SimdLane4i
+{
+    __m128i v;
+
+    static SimdLane4i set(const uint32_t i)                 { return { _mm_set1_epi32(int(i)) }; }
+    friend SimdLane4i operator^(SimdLane4i a, SimdLane4i b) { return { _mm_xor_si128(a.v, b.v) }; }
+
+    // sse2 only multiplies the even lanes into 64 bit, do the odd ones shifted down and interleave the low words
+    friend SimdLane4i operator*(SimdLane4i a, SimdLane4i b)
+    {
+        const __m128i even = _mm_mul_epu32(a.v, b.v);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a.v, 4), _mm_srli_si128(b.v, 4));
+        return { _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))) };
+    }
+};
+
+
+struct SimdLane4
+{
+    typedef SimdLane4i Int;
+    static const int Width = 4;
+    __m128 v;
+
+    static SimdLane4 load(const float *p)             { return { _mm_loadu_ps(p) }; }
+    static SimdLane4 set(const float f)               { return { _mm_set1_ps(f) }; }
+    void store(float *p) const                         { _mm_storeu_ps(p, v); }
+
+    friend SimdLane4 operator+(SimdLane4 a, SimdLane4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend SimdLane4 operator-(SimdLane4 a, SimdLane4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend SimdLane4 operator*(SimdLane4 a, SimdLane4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend SimdLane4 operator/(SimdLane4 a, SimdLane4 b) { return { _mm_div_ps(a.v, b.v) }; }
+    friend SimdLane4 operator&(SimdLane4 a, SimdLane4 b) { return { _mm_and_ps(a.v, b.v) }; }
+
+    static SimdLane4 min(SimdLane4 a, SimdLane4 b)  { return { _mm_min_ps(a.v, b.v) }; }
+    static SimdLane4 max(SimdLane4 a, SimdLane4 b)  { return { _mm_max_ps(a.v, b.v) }; }
+    static SimdLane4 sqrt(SimdLane4 a)              { return { _mm_sqrt_ps(a.v) }; }
+
+    static SimdLane4 less(SimdLane4 a, SimdLane4 b)         { return { _mm_cmplt_ps(a.v, b.v) }; }
+    static SimdLane4 lessEqual(SimdLane4 a, SimdLane4 b)    { return { _mm_cmple_ps(a.v, b.v) }; }
+    static SimdLane4 select(SimdLane4 m, SimdLane4 a, SimdLane4 b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+    static bool any(SimdLane4 m)                            { return _mm_movemask_ps(m.v) != 0; }
+
+    // sse2 has no floor, truncate and fix up negative values
+    static SimdLane4 floor(SimdLane4 a)
+    {
+        const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        const __m128 fix = _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f));
+        return { _mm_sub_ps(t, fix) };
+    }
+
+    static SimdLane4 exp2i(SimdLane4 n)
+    {
+        const __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127)), 23);
+        return { _mm_castsi128_ps(bits) };
+    }
+
+    static SimdLane4i toInt(SimdLane4 a)    { return { _mm_cvttps_epi32(a.v) }; }
+
+    // the conversion is signed, both 16 bit halves convert exactly and the sum rounds once
+    static SimdLane4 toFloat(SimdLane4i a)
+    {
+        const __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(a.v, 16));
+        const __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(a.v, _mm_set1_epi32(0xffff)));
+        return { _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo) };
+    }
+};
+#endif
+
+
+#if defined(SIMD_LANE_AVX2)
+struct SimdLane8i
+{
+    __m256i v;
+
+    static SimdLane8i set(const uint32_t i)                 { return { _mm256_set1_epi32(int(i)) }; }
+    friend SimdLane8i operator*(SimdLane8i a, SimdLane8i b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+    friend SimdLane8i operator^(SimdLane8i a, SimdLane8i b) { return { _mm256_xor_si256(a.v, b.v) }; }
+};
+
+
+struct SimdLane8
+{
+    typedef SimdLane8i Int;
+    static const int Width = 8;
+    __m256 v;
+
+    static SimdLane8 load(const float *p)             { return { _mm256_loadu_ps(p) }; }
+    static SimdLane8 set(const float f)               { return { _mm256_set1_ps(f) }; }
+    void store(float *p) const                         { _mm256_storeu_ps(p, v); }
+
+    friend SimdLane8 operator+(SimdLane8 a, SimdLane8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend SimdLane8 operator-(SimdLane8 a, SimdLane8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend SimdLane8 operator*(SimdLane8 a, SimdLane8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend SimdLane8 operator/(SimdLane8 a, SimdLane8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+    friend SimdLane8 operator&(SimdLane8 a, SimdLane8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+
+    static SimdLane8 min(SimdLane8 a, SimdLane8 b)  { return { _mm256_min_ps(a.v, b.v) }; }
+    static SimdLane8 max(SimdLane8 a, SimdLane8 b)  { return { _mm256_max_ps(a.v, b.v) }; }
+    static SimdLane8 sqrt(SimdLane8 a)              { return { _mm256_sqrt_ps(a.v) }; }
+    static SimdLane8 floor(SimdLane8 a)             { return { _mm256_floor_ps(a.v) }; }
+
+    static SimdLane8 less(SimdLane8 a, SimdLane8 b)         { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    static SimdLane8 lessEqual(SimdLane8 a, SimdLane8 b)    { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    static SimdLane8 select(SimdLane8 m, SimdLane8 a, SimdLane8 b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+    static bool any(SimdLane8 m)                            { return _mm256_movemask_ps(m.v) != 0; }
+
+    static SimdLane8 exp2i(SimdLane8 n)
+    {
+        const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127)), 23);
+        return { _mm256_castsi256_ps(bits) };
+    }
+
+    static SimdLane8i toInt(SimdLane8 a)    { return { _mm256_cvttps_epi32(a.v) }; }
+
+    static SimdLane8 toFloat(SimdLane8i a)
+    {
+        const __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(a.v, 16));
+        const __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(a.v, _mm256_set1_epi32(0xffff)));
+        return { _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo) };
+    }
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+
+// cephes style expf, ~1 ulp over the clamped range
+template<class Lane>
+inline Lane simdExp(
+    Lane x)
+{
+    x = Lane::min(Lane::max(x, Lane::set(-87.0f)), Lane::set(88.0f));
+
+    const Lane fx = Lane::floor(x * Lane::set(1.44269504088896341f) + Lane::set(0.5f));
+    x = x - fx * Lane::set(0.693359375f) - fx * Lane::set(-2.12194440e-4f);
+
+    Lane y = Lane::set(1.9875691500e-4f);
+    y = y * x + Lane::set(1.3981999507e-3f);
+    y = y * x + Lane::set(8.3334519073e-3f);
+    y = y * x + Lane::set(4.1665795894e-2f);
+    y = y * x + Lane::set(1.6666665459e-1f);
+    y = y * x + Lane::set(5.0000001201e-1f);
+    y = y * x * x + x + Lane::set(1.0f);
+    return y * Lane::exp2i(fx);
+}
+
+
+// cephes style sinf and cosf, three constant pi/2 reduction and the sin and cos polynomials
+// on [-pi/4, pi/4] picked by quadrant. ~1 ulp while |x| stays below 8192, the glsl hashes
+// scale sin by 43758 so anything coarser shows up in the noise
+template<class Lane>
+inline void simdSinCos(
+    Lane  x,
+    Lane &sinX,
+    Lane &cosX)
+{
+    const Lane j = Lane::floor(x * Lane::set(0.636619772f) + Lane::set(0.5f));
+    x = x - j * Lane::set(1.5703125f) - j * Lane::set(4.837512969970703125e-4f) - j * Lane::set(7.54978995489188216e-8f);
+
+    // quadrant of j, odd quadrants swap the polynomials. sin flips its sign in quadrants 2 and 3, cos in 1 and 2
+    const Lane odd = Lane::less(Lane::set(0.5f), j - Lane::set(2.0f) * Lane::floor(j * Lane::set(0.5f)));
+    const Lane quadrant = j - Lane::set(4.0f) * Lane::floor(j * Lane::set(0.25f));
+
+    const Lane x2 = x * x;
+    Lane s = Lane::set(-1.9515295891e-4f);
+    s = s * x2 + Lane::set(8.3321608736e-3f);
+    s = s * x2 + Lane::set(-1.6666654611e-1f);
+    s = s * x2 * x + x;
+
+    Lane c = Lane::set(2.443315711809948e-5f);
+    c = c * x2 + Lane::set(-1.388731625493765e-3f);
+    c = c * x2 + Lane::set(4.166664568298827e-2f);
+    c = c * x2 * x2 - Lane::set(0.5f) * x2 + Lane::set(1.0f);
+
+    const Lane zero = Lane::set(0.0f);
+    sinX = Lane::select(odd, c, s);
+    sinX = Lane::select(Lane::less(Lane::set(1.5f), quadrant), zero - sinX, sinX);
+    cosX = Lane::select(odd, s, c);
+    const Lane cosNegative = Lane::less(Lane::set(0.5f), quadrant) & Lane::less(quadrant, Lane::set(2.5f));
+    cosX = Lane::select(cosNegative, zero - cosX, cosX);
+}
+
+
+template<class Lane>
+inline Lane simdSin(
+    const Lane x)
+{
+    Lane sinX, cosX;
+    simdSinCos(x, sinX, cosX);
+    return sinX;
+}
+
+
+// widest lane type available in this build, full batches run on it and the rest on SimdLane1
+#if defined(SIMD_LANE_AVX2)
+typedef SimdLane8 SimdLaneWide;
+#elif defined(SIMD_LANE_SSE2)
+typedef SimdLane4 SimdLaneWide;
+#else
+typedef SimdLane1 SimdLaneWide;
+#endif
+
+
+inline const char* simdLanePath()
+{
+#if defined(SIMD_LANE_AVX2)
+    return "avx2";
+#elif defined(SIMD_LANE_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
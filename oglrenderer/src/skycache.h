@@ -0,0 +1,376 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+# include <direct.h>
+# define SKY_CACHE_MKDIR(path) _mkdir(path)
+#else
+# include <sys/stat.h>
+# define SKY_CACHE_MKDIR(path) mkdir(path, 0755)
+#endif
+
+#include "glm/glm.hpp"
+
+// sun direction is stored in steps of 1/SKY_CACHE_SUN_STEPS per component, about 0.1 degrees,
+// so a slow sun sweep stays on one entry for a few frames instead of missing every frame
+#define SKY_CACHE_SUN_STEPS  512
+#define SKY_CACHE_BUDGET_MB  512
+// evicted face buffers kept around for the next insert
+#define SKY_CACHE_SPARE_COUNT 2
+#define SKY_CACHE_DIRECTORY  "./resources/skycache"
+#define SKY_CACHE_MAGIC      0x43594B53
+#define SKY_CACHE_VERSION    2
+
+struct SkyCacheKey
+{
+    uint32_t mModel;
+    uint32_t mSize;
+    int32_t  mSunDir[3];
+    // bit patterns of the model settings that affect the sky, zero when unused
+    uint32_t mSettings[3];
+
+    bool operator==(const SkyCacheKey &rhs) const
+    {
+        return memcmp(this, &rhs, sizeof(SkyCacheKey)) == 0;
+    }
+};
+
+
+struct SkyCacheKeyHash
+{
+    size_t operator()(const SkyCacheKey &key) const
+    {
+        // fnv-1a over the raw key
+        const uint8_t* bytes = (const uint8_t*)&key;
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(SkyCacheKey); ++i)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return size_t(hash);
+    }
+};
+
+
+// finished cubemap faces (RGBA32F, faces back to back) keyed by model, resolution and
+// quantized sun direction. least recently used entries are evicted once the budget is
+// exceeded, entries can optionally be persisted to disk on a writer thread
+class SkyCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<glm::vec4>> Faces;
+
+    SkyCache()
+        : mBudget(size_t(SKY_CACHE_BUDGET_MB) * 1024 * 1024)
+        , mSize(0)
+        , mUseDisk(false)
+        , mHits(0)
+        , mDiskHits(0)
+        , mMisses(0)
+        , mStopWriter(false)
+    {
+        mWriter = std::thread(&SkyCache::writerLoop, this);
+    }
+
+
+    ~SkyCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWriterMutex);
+            mStopWriter = true;
+        }
+        mWriterWake.notify_all();
+        mWriter.join();
+    }
+
+
+    static SkyCacheKey makeKey(
+        const uint32_t  model,
+        const uint32_t  size,
+        const glm::vec3 &sunDir,
+        const float     setting0 = 0.0f,
+        const float     setting1 = 0.0f,
+        const float     setting2 = 0.0f)
+    {
+        SkyCacheKey key;
+        memset(&key, 0, sizeof(SkyCacheKey));
+        key.mModel = model;
+        key.mSize = size;
+
+        const glm::vec3 dir = glm::length(sunDir) > 0.0f ? glm::normalize(sunDir) : glm::vec3(0.0f, 1.0f, 0.0f);
+        for (int i = 0; i < 3; ++i)
+        {
+            key.mSunDir[i] = int32_t(glm::round(dir[i] * float(SKY_CACHE_SUN_STEPS)));
+        }
+
+        memcpy(&key.mSettings[0], &setting0, sizeof(float));
+        memcpy(&key.mSettings[1], &setting1, sizeof(float));
+        memcpy(&key.mSettings[2], &setting2, sizeof(float));
+        return key;
+    }
+
+
+    // looks up memory first and then the disk store, returns nullptr on a miss
+    Faces find(
+        const SkyCacheKey &key)
+    {
+        auto it = mLookup.find(key);
+        if (it != mLookup.end())
+        {
+            mEntries.splice(mEntries.begin(), mEntries, it->second);
+            ++mHits;
+            return it->second->mFaces;
+        }
+
+        if (mUseDisk)
+        {
+            Faces faces = readFromDisk(key);
+            if (faces != nullptr)
+            {
+                insertEntry(key, faces);
+                ++mDiskHits;
+                return faces;
+            }
+        }
+
+        ++mMisses;
+        return nullptr;
+    }
+
+
+    void insert(
+        const SkyCacheKey &key,
+        const Faces       &faces)
+    {
+        if (mLookup.find(key) != mLookup.end())
+        {
+            return;
+        }
+
+        insertEntry(key, faces);
+
+        if (mUseDisk)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mWriterMutex);
+                mWriteQueue.push_back(Entry{ key, faces });
+            }
+            mWriterWake.notify_one();
+        }
+    }
+
+
+    // storage for a new entry, an evicted buffer nobody references anymore when there is one
+    std::shared_ptr<std::vector<glm::vec4>> allocate(
+        const size_t count)
+    {
+        for (size_t i = 0; i < mSpares.size(); ++i)
+        {
+            if (mSpares[i]->size() == count)
+            {
+                std::shared_ptr<std::vector<glm::vec4>> faces = mSpares[i];
+                mSpares.erase(mSpares.begin() + i);
+                return faces;
+            }
+        }
+        return std::make_shared<std::vector<glm::vec4>>(count);
+    }
+
+
+    void clear()
+    {
+        mEntries.clear();
+        mLookup.clear();
+        mSpares.clear();
+        mSize = 0;
+    }
+
+
+    void setUseDisk(
+        const bool useDisk)
+    {
+        if (useDisk && !mUseDisk)
+        {
+            SKY_CACHE_MKDIR(SKY_CACHE_DIRECTORY);
+        }
+        mUseDisk = useDisk;
+    }
+
+
+    bool useDisk() const
+    {
+        return mUseDisk;
+    }
+
+
+    uint32_t hits() const
+    {
+        return mHits;
+    }
+
+
+    uint32_t diskHits() const
+    {
+        return mDiskHits;
+    }
+
+
+    uint32_t misses() const
+    {
+        return mMisses;
+    }
+
+
+    uint32_t entryCount() const
+    {
+        return uint32_t(mEntries.size());
+    }
+
+
+    size_t sizeInBytes() const
+    {
+        return mSize;
+    }
+
+private:
+
+    struct Entry
+    {
+        SkyCacheKey mKey;
+        Faces       mFaces;
+    };
+
+
+    void insertEntry(
+        const SkyCacheKey &key,
+        const Faces       &faces)
+    {
+        mEntries.push_front(Entry{ key, faces });
+        mLookup[key] = mEntries.begin();
+        mSize += faces->size() * sizeof(glm::vec4);
+
+        // evict least recently used, always keep the newest entry
+        while ((mSize > mBudget) && (mEntries.size() > 1))
+        {
+            const Entry &last = mEntries.back();
+            mSize -= last.mFaces->size() * sizeof(glm::vec4);
+            if ((last.mFaces.use_count() == 1) && (mSpares.size() < SKY_CACHE_SPARE_COUNT))
+            {
+                // every buffer comes from allocate() or make_shared, none of them is const itself
+                mSpares.push_back(std::const_pointer_cast<std::vector<glm::vec4>>(last.mFaces));
+            }
+            mLookup.erase(last.mKey);
+            mEntries.pop_back();
+        }
+    }
+
+
+    static std::string fileName(
+        const SkyCacheKey &key)
+    {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s/%u_%u_%d_%d_%d_%08x_%08x_%08x.sky", SKY_CACHE_DIRECTORY,
+            key.mModel, key.mSize, key.mSunDir[0], key.mSunDir[1], key.mSunDir[2], key.mSettings[0], key.mSettings[1], key.mSettings[2]);
+        return std::string(buf);
+    }
+
+
+    static Faces readFromDisk(
+        const SkyCacheKey &key)
+    {
+        FILE* file = fopen(fileName(key).c_str(), "rb");
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+
+        uint32_t header[3] = { 0, 0, 0 };
+        SkyCacheKey storedKey;
+        bool valid = (fread(header, sizeof(header), 1, file) == 1) &&
+                     (fread(&storedKey, sizeof(SkyCacheKey), 1, file) == 1) &&
+                     (header[0] == SKY_CACHE_MAGIC) &&
+                     (header[1] == SKY_CACHE_VERSION) &&
+                     (header[2] == 6 * key.mSize * key.mSize) &&
+                     (storedKey == key);
+
+        std::shared_ptr<std::vector<glm::vec4>> faces;
+        if (valid)
+        {
+            faces = std::make_shared<std::vector<glm::vec4>>(header[2]);
+            valid = fread(faces->data(), sizeof(glm::vec4), faces->size(), file) == faces->size();
+        }
+        fclose(file);
+
+        return valid ? faces : nullptr;
+    }
+
+
+    static void writeToDisk(
+        const Entry &entry)
+    {
+        FILE* file = fopen(fileName(entry.mKey).c_str(), "wb");
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        const uint32_t header[3] = { SKY_CACHE_MAGIC, SKY_CACHE_VERSION, uint32_t(entry.mFaces->size()) };
+        fwrite(header, sizeof(header), 1, file);
+        fwrite(&entry.mKey, sizeof(SkyCacheKey), 1, file);
+        fwrite(entry.mFaces->data(), sizeof(glm::vec4), entry.mFaces->size(), file);
+        fclose(file);
+    }
+
+
+    void writerLoop()
+    {
+        while (true)
+        {
+            Entry entry;
+            {
+                std::unique_lock<std::mutex> lock(mWriterMutex);
+                mWriterWake.wait(lock, [this]() { return mStopWriter || !mWriteQueue.empty(); });
+                if (mWriteQueue.empty())
+                {
+                    return;
+                }
+                entry = mWriteQueue.front();
+                mWriteQueue.pop_front();
+            }
+
+            writeToDisk(entry);
+        }
+    }
+
+
+    // lru list, most recently used at the front
+    std::list<Entry> mEntries;
+    std::unordered_map<SkyCacheKey, std::list<Entry>::iterator, SkyCacheKeyHash> mLookup;
+    std::vector<std::shared_ptr<std::vector<glm::vec4>>> mSpares;
+    size_t mBudget;
+    size_t mSize;
+    bool mUseDisk;
+
+    // statistics
+    uint32_t mHits;
+    uint32_t mDiskHits;
+    uint32_t mMisses;
+
+    // disk writer
+    std::thread mWriter;
+    std::mutex mWriterMutex;
+    std::condition_variable mWriterWake;
+    std::deque<Entry> mWriteQueue;
+    bool mStopWriter;
+};
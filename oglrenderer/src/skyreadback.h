@@ -0,0 +1,144 @@
+#pragma once
+
+#include <memory>
+#include <string.h>
+#include <vector>
+
+#include "glew.h"
+#include "glm/glm.hpp"
+
+#include "rendertexture.h"
+#include "skycache.h"
+
+// number of persistently mapped readback buffers, each holds all six faces
+#define SKY_READBACK_RING_SIZE 3
+
+// frames between two queued readbacks, a sun sweep misses the cache on most frames and every
+// readback costs a full copy of the faces
+#define SKY_READBACK_INTERVAL 8
+
+// gets freshly rendered cubemaps into the SkyCache without stalling. the faces are copied into a
+// fenced pack buffer and only inserted once the fence signaled, one or more frames later
+class SkyReadback
+{
+public:
+    SkyReadback(
+        const uint32_t textureSize)
+        : mTexSize(textureSize)
+        , mSlotSize(6 * size_t(textureSize) * textureSize)
+        , mFramesSinceQueue(SKY_READBACK_INTERVAL)
+        , mDropped(0)
+    {
+        const GLsizeiptr slotSize = GLsizeiptr(mSlotSize * sizeof(glm::vec4));
+        const GLbitfield mapFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(SKY_READBACK_RING_SIZE, mPbos);
+        for (int i = 0; i < SKY_READBACK_RING_SIZE; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[i]);
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, slotSize, nullptr, mapFlags);
+            mMappedPbos[i] = (const glm::vec4*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slotSize, mapFlags);
+            mFences[i] = nullptr;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+
+    ~SkyReadback()
+    {
+        for (int i = 0; i < SKY_READBACK_RING_SIZE; ++i)
+        {
+            if (mFences[i] != nullptr)
+            {
+                glDeleteSync(mFences[i]);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[i]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(SKY_READBACK_RING_SIZE, mPbos);
+    }
+
+
+    // queues the copy of the six faces, the result is only cached when a slot is free and
+    // the last readback is SKY_READBACK_INTERVAL frames ago
+    void queue(
+        const SkyCacheKey    &key,
+        RenderCubemapTexture &cubemap)
+    {
+        int slot = -1;
+        for (int i = 0; i < SKY_READBACK_RING_SIZE; ++i)
+        {
+            if (mFences[i] == nullptr)
+            {
+                slot = i;
+                break;
+            }
+        }
+        if ((slot < 0) || (mFramesSinceQueue < SKY_READBACK_INTERVAL) || (uint32_t(cubemap.width()) != mTexSize))
+        {
+            ++mDropped;
+            return;
+        }
+        mFramesSinceQueue = 0;
+
+        const size_t faceSize = size_t(mTexSize) * mTexSize * sizeof(glm::vec4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, mPbos[slot]);
+        for (uint32_t s = 0; s < 6; ++s)
+        {
+            cubemap.readback(s, (void*)(s * faceSize));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mKeys[slot] = key;
+    }
+
+
+    // called once per frame, inserts every finished copy into the cache
+    void poll(
+        SkyCache &cache)
+    {
+        ++mFramesSinceQueue;
+        for (int i = 0; i < SKY_READBACK_RING_SIZE; ++i)
+        {
+            if ((mFences[i] == nullptr) || !isSignaled(mFences[i]))
+            {
+                continue;
+            }
+
+            std::shared_ptr<std::vector<glm::vec4>> faces = cache.allocate(mSlotSize);
+            memcpy(faces->data(), mMappedPbos[i], mSlotSize * sizeof(glm::vec4));
+            cache.insert(mKeys[i], faces);
+
+            glDeleteSync(mFences[i]);
+            mFences[i] = nullptr;
+        }
+    }
+
+
+    // renders that were not cached, every slot was still in flight or the interval not over
+    uint32_t dropped() const
+    {
+        return mDropped;
+    }
+
+private:
+
+    static bool isSignaled(
+        GLsync fence)
+    {
+        const GLenum result = glClientWaitSync(fence, 0, 0);
+        return (result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED);
+    }
+
+
+    GLuint           mPbos[SKY_READBACK_RING_SIZE];
+    const glm::vec4* mMappedPbos[SKY_READBACK_RING_SIZE];
+    GLsync           mFences[SKY_READBACK_RING_SIZE];
+    SkyCacheKey      mKeys[SKY_READBACK_RING_SIZE];
+
+    uint32_t mTexSize;
+    size_t   mSlotSize;
+    uint32_t mFramesSinceQueue;
+    uint32_t mDropped;
+};
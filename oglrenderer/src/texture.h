@@ -135,6 +135,18 @@ public:
     }
 
 
+    int width() const
+    {
+        return mWidth;
+    }
+
+
+    int height() const
+    {
+        return mHeight;
+    }
+
+
     int channelCount()
     {
         switch (mInternalFormat)
@@ -213,31 +225,47 @@ public:
         int          height,
         int          depth,
         const int    bitsPerChannel = 8,
-        const bool   greyScale = false)
+        const int    channels = 4,
+        const bool   mipmap = false)
     {
         mWidth          = width;
         mHeight         = height;
         mDepth          = depth;
+        mChannels       = channels;
+        mLevels         = 1;
         mInternalFormat = GL_RGBA8;
 
+        if (mipmap)
+        {
+            while ((glm::max(width, glm::max(height, depth)) >> mLevels) > 0)
+            {
+                ++mLevels;
+            }
+        }
+
         glGenTextures(1, &mTex);
         glBindTexture(GL_TEXTURE_3D, mTex);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, mLevels - 1);
 
         assert(bitsPerChannel == 8 || bitsPerChannel == 32);
+        assert(channels == 1 || channels == 2 || channels == 4);
 
         switch (bitsPerChannel)
         {
-        case 8:  mInternalFormat = greyScale ? GL_R8 : GL_RGBA8; break;
-        case 32: mInternalFormat = greyScale ? GL_R32F : GL_RGBA32F; break;
+        case 8:  mInternalFormat = (channels == 1) ? GL_R8 : ((channels == 2) ? GL_RG8 : GL_RGBA8); break;
+        case 32: mInternalFormat = (channels == 1) ? GL_R32F : ((channels == 2) ? GL_RG32F : GL_RGBA32F); break;
         default: assert(false);
         }
 
-        glTexImage3D(GL_TEXTURE_3D, 0, mInternalFormat, width, height, depth, 0, greyScale ? GL_R : GL_RGBA, GL_FLOAT, 0);
+        for (int i = 0; i < mLevels; ++i)
+        {
+            glTexImage3D(GL_TEXTURE_3D, i, mInternalFormat, glm::max(width >> i, 1), glm::max(height >> i, 1), glm::max(depth >> i, 1), 0, format(), GL_FLOAT, 0);
+        }
         glBindTexture(GL_TEXTURE_3D, 0);
     }
 
@@ -262,8 +290,65 @@ public:
         glBindImageTexture(texUnit, mTex, 0, GL_TRUE, 0, readWriteState, mInternalFormat);
     }
 
+
+    int depth() const
+    {
+        return mDepth;
+    }
+
+
+    int channelCount() const
+    {
+        return mChannels;
+    }
+
+
+    // bytes of one texel in the top level
+    int texelSize() const
+    {
+        const bool isFloat = (mInternalFormat == GL_R32F) || (mInternalFormat == GL_RG32F) || (mInternalFormat == GL_RGBA32F);
+        return mChannels * (isFloat ? 4 : 1);
+    }
+
+
+    // replace the top level, data holds width * height * depth * channelCount() values of the given type
+    void upload(
+        const void*  data,
+        const GLenum type = GL_FLOAT)
+    {
+        glTextureSubImage3D(mTex, 0, 0, 0, 0, mWidth, mHeight, mDepth, format(), type, data);
+    }
+
+
+    // read back the top level, data needs room for width * height * depth * channelCount() values of the given type
+    void download(
+        void*        data,
+        const GLenum type = GL_FLOAT)
+    {
+        const GLsizei size = GLsizei(type == GL_FLOAT ? sizeof(float) : sizeof(uint8_t)) * mWidth * mHeight * mDepth * mChannels;
+        glGetTextureImage(mTex, 0, format(), type, size, data);
+    }
+
+
+    // rebuild the lower levels from the top level, no-op without mipmaps
+    void generateMipmaps()
+    {
+        if (mLevels > 1)
+        {
+            glGenerateTextureMipmap(mTex);
+        }
+    }
+
 private:
+
+    GLenum format() const
+    {
+        return (mChannels == 1) ? GL_RED : ((mChannels == 2) ? GL_RG : GL_RGBA);
+    }
+
     int mDepth;
+    int mChannels;
+    int mLevels;
 };
 
 
@@ -316,6 +401,37 @@ public:
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
     }
 
+
+    // all six faces are bound as a layered image
+    void bindImageTexture(
+        const uint32_t texUnit,
+        const uint32_t readWriteState) override
+    {
+        glBindImageTexture(texUnit, mTex, 0, GL_TRUE, 0, readWriteState, GL_RGBA32F);
+    }
+
+
+    void readback(
+        int  side,
+        void *data)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, mTex);
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, 0, GL_RGBA, GL_FLOAT, data);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+
+    // updates an existing face without reallocating it, data is an offset when
+    // a GL_PIXEL_UNPACK_BUFFER is bound
+    void uploadSubImage(
+        int        side,
+        const void *data)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, mTex);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, 0, 0, 0, mWidth, mHeight, GL_RGBA, GL_FLOAT, data);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+
 private:
 
 };
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent worker pool used for cpu side precomputation
+class ThreadPool
+{
+public:
+    ThreadPool(
+        const uint32_t threadCount = 0)
+        : mStop(false)
+        , mGeneration(0)
+        , mActiveWorkers(0)
+        , mRunningWorkers(0)
+        , mJobCount(0)
+        , mNextJob(0)
+        , mFinishedJobs(0)
+        , mJob(nullptr)
+    {
+        uint32_t count = threadCount > 0 ? threadCount : std::thread::hardware_concurrency();
+        count = count > 0 ? count : 1;
+
+        // the calling thread participates as well, so spawn one less worker
+        for (uint32_t i = 0; i + 1 < count; ++i)
+        {
+            mWorkers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWake.notify_all();
+
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+        {
+            mWorkers[i].join();
+        }
+    }
+
+
+    // runs job(i) for i in [0, jobCount), blocks until every job is finished
+    // maxThreads = 0 uses every thread in the pool (including the caller)
+    void parallelFor(
+        const uint32_t                       jobCount,
+        const std::function<void(uint32_t)> &job,
+        const uint32_t                       maxThreads = 0)
+    {
+        if (jobCount == 0)
+        {
+            return;
+        }
+
+        // only one parallel loop can be in flight at a time
+        std::lock_guard<std::mutex> dispatchLock(mDispatchMutex);
+
+        const uint32_t threadCount = (maxThreads == 0 || maxThreads > this->threadCount()) ? this->threadCount() : maxThreads;
+        uint32_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJob = &job;
+            mJobCount = jobCount;
+            mFinishedJobs = 0;
+            mActiveWorkers = threadCount - 1;
+            ++mGeneration;
+            generation = uint32_t(mGeneration);
+            mNextJob = uint64_t(generation) << 32;
+        }
+        mWake.notify_all();
+
+        runJobs(generation, jobCount, &job);
+
+        // wait for the workers to drain the queue and leave the job function
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this]() { return (mFinishedJobs == mJobCount) && (mRunningWorkers == 0); });
+        mJob = nullptr;
+    }
+
+
+    uint32_t threadCount() const
+    {
+        return uint32_t(mWorkers.size()) + 1;
+    }
+
+private:
+
+    void workerLoop(
+        const uint32_t workerIdx)
+    {
+        uint64_t seenGeneration = 0;
+        while (true)
+        {
+            uint32_t jobCount = 0;
+            const std::function<void(uint32_t)>* job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWake.wait(lock, [&]() { return mStop || (mGeneration != seenGeneration); });
+                if (mStop)
+                {
+                    return;
+                }
+
+                seenGeneration = mGeneration;
+                if (workerIdx >= mActiveWorkers)
+                {
+                    continue;
+                }
+                ++mRunningWorkers;
+                jobCount = mJobCount;
+                job = mJob;
+            }
+
+            runJobs(uint32_t(seenGeneration), jobCount, job);
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                --mRunningWorkers;
+            }
+            mDone.notify_all();
+        }
+    }
+
+
+    // claims carry the generation in the upper 32 bits, so a worker that is late for one loop
+    // cannot take jobs of the next one past its maxThreads
+    void runJobs(
+        const uint32_t                       generation,
+        const uint32_t                       jobCount,
+        const std::function<void(uint32_t)>* job)
+    {
+        uint64_t claim = mNextJob.load();
+        while ((uint32_t(claim >> 32) == generation) && (uint32_t(claim) < jobCount))
+        {
+            if (!mNextJob.compare_exchange_weak(claim, claim + 1))
+            {
+                continue;
+            }
+
+            (*job)(uint32_t(claim));
+            if (mFinishedJobs.fetch_add(1) + 1 == jobCount)
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mDone.notify_all();
+            }
+            claim = mNextJob.load();
+        }
+    }
+
+
+    std::vector<std::thread> mWorkers;
+    std::mutex               mMutex;
+    std::mutex               mDispatchMutex;
+    std::condition_variable  mWake;
+    std::condition_variable  mDone;
+
+    bool                     mStop;
+    uint64_t                 mGeneration;
+    uint32_t                 mActiveWorkers;
+    uint32_t                 mRunningWorkers;
+
+    std::atomic<uint32_t>    mJobCount;
+    std::atomic<uint64_t>    mNextJob;
+    std::atomic<uint32_t>    mFinishedJobs;
+    const std::function<void(uint32_t)>* mJob;
+};
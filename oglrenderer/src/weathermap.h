@@ -0,0 +1,203 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "deviceconstants.h"
+
+// 2d weather map spanning the cloud layer, rgba8 per column. r: coverage, g: cloud type
+// (0 stratus, 1 cumulus), b: cloud base and a: cloud top as fractions of the layer height
+class WeatherMap
+{
+public:
+
+    WeatherMap()
+        : mTexels(WEATHER_MAP_RESOLUTION * WEATHER_MAP_RESOLUTION * 4, 0)
+        , mLowestBase(0.0f)
+        , mHighestTop(1.0f)
+    {
+    }
+
+
+    // low frequency value noise, large areas end up with zero coverage
+    void generate(
+        const uint32_t seed)
+    {
+        for (int y = 0; y < WEATHER_MAP_RESOLUTION; ++y)
+        {
+            for (int x = 0; x < WEATHER_MAP_RESOLUTION; ++x)
+            {
+                const glm::vec2 p = glm::vec2(float(x), float(y)) / float(WEATHER_MAP_RESOLUTION);
+
+                const float coverage = glm::smoothstep(0.4f, 0.65f, fbm(p * 6.0f, seed));
+                const float type = glm::smoothstep(0.3f, 0.7f, fbm(p * 3.0f + 17.0f, seed));
+
+                // cumulus sit low and tower, stratus stay in a thin sheet higher up
+                const float base = glm::mix(0.3f, 0.05f, type);
+                const float thickness = glm::mix(0.15f, 0.9f, type) * glm::mix(0.6f, 1.0f, fbm(p * 12.0f + 41.0f, seed));
+                const float top = glm::min(base + thickness, 1.0f);
+
+                uint8_t* texel = &mTexels[(y * WEATHER_MAP_RESOLUTION + x) * 4];
+                texel[0] = toByte(coverage);
+                texel[1] = toByte(type);
+                texel[2] = toByte(base);
+                texel[3] = toByte(top);
+            }
+        }
+        updateHeightRange();
+    }
+
+
+    // bgra8 rows of WEATHER_MAP_RESOLUTION texels as FreeImage loads them
+    void load(
+        const uint8_t* bgra)
+    {
+        for (int i = 0; i < WEATHER_MAP_RESOLUTION * WEATHER_MAP_RESOLUTION; ++i)
+        {
+            mTexels[i * 4 + 0] = bgra[i * 4 + 2];
+            mTexels[i * 4 + 1] = bgra[i * 4 + 1];
+            mTexels[i * 4 + 2] = bgra[i * 4 + 0];
+            mTexels[i * 4 + 3] = bgra[i * 4 + 3];
+        }
+        updateHeightRange();
+    }
+
+
+    const uint8_t* texels() const
+    {
+        return mTexels.data();
+    }
+
+
+    // max coverage, min base and max top over the 3x3 neighborhood of every texel. bilinear
+    // lookups inside a texel only reach its neighbors, so a zero coverage here or a height
+    // outside [base, top] means zero density for every sample taken in that texel
+    std::vector<uint8_t> bound() const
+    {
+        std::vector<uint8_t> result(mTexels.size(), 0);
+        for (int y = 0; y < WEATHER_MAP_RESOLUTION; ++y)
+        {
+            for (int x = 0; x < WEATHER_MAP_RESOLUTION; ++x)
+            {
+                uint8_t coverage = 0;
+                uint8_t base = 255;
+                uint8_t top = 0;
+                for (int j = -1; j <= 1; ++j)
+                {
+                    for (int i = -1; i <= 1; ++i)
+                    {
+                        // the texture repeats, so do the neighbors
+                        const int nx = (x + i + WEATHER_MAP_RESOLUTION) % WEATHER_MAP_RESOLUTION;
+                        const int ny = (y + j + WEATHER_MAP_RESOLUTION) % WEATHER_MAP_RESOLUTION;
+                        const uint8_t* texel = &mTexels[(ny * WEATHER_MAP_RESOLUTION + nx) * 4];
+                        coverage = glm::max(coverage, texel[0]);
+                        base = glm::min(base, texel[2]);
+                        top = glm::max(top, texel[3]);
+                    }
+                }
+
+                uint8_t* texel = &result[(y * WEATHER_MAP_RESOLUTION + x) * 4];
+                texel[0] = coverage;
+                texel[1] = base;
+                texel[2] = top;
+                texel[3] = 255;
+            }
+        }
+        return result;
+    }
+
+
+    // lowest cloud base and highest cloud top over the whole map
+    float lowestBase() const
+    {
+        return mLowestBase;
+    }
+
+
+    float highestTop() const
+    {
+        return mHighestTop;
+    }
+
+private:
+
+    static uint8_t toByte(
+        const float x)
+    {
+        return uint8_t(glm::clamp(x, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+
+    static float hash(
+        const int      x,
+        const int      y,
+        const uint32_t seed)
+    {
+        uint32_t n = uint32_t(x) * 1597334673u ^ uint32_t(y) * 3812015801u ^ seed * 2654435761u;
+        n = (n ^ (n >> 16)) * 2246822519u;
+        n = n ^ (n >> 13);
+        return float(n) / float(0xffffffffu);
+    }
+
+
+    static float valueNoise(
+        const glm::vec2 &p,
+        const uint32_t  seed)
+    {
+        const glm::vec2 i = glm::floor(p);
+        const glm::vec2 f = p - i;
+        const glm::vec2 u = f * f * (3.0f - 2.0f * f);
+        const int x = int(i.x);
+        const int y = int(i.y);
+        return glm::mix(
+            glm::mix(hash(x, y, seed), hash(x + 1, y, seed), u.x),
+            glm::mix(hash(x, y + 1, seed), hash(x + 1, y + 1, seed), u.x),
+            u.y);
+    }
+
+
+    static float fbm(
+        glm::vec2      p,
+        const uint32_t seed)
+    {
+        float noise = 0.0f;
+        float amp = 0.5f;
+        for (int i = 0; i < 4; ++i)
+        {
+            noise += amp * valueNoise(p, seed);
+            p *= 2.0f;
+            amp *= 0.5f;
+        }
+        return noise / 0.9375f;
+    }
+
+
+    void updateHeightRange()
+    {
+        mLowestBase = 1.0f;
+        mHighestTop = 0.0f;
+        for (int i = 0; i < WEATHER_MAP_RESOLUTION * WEATHER_MAP_RESOLUTION; ++i)
+        {
+            if (mTexels[i * 4 + 0] > 0)
+            {
+                mLowestBase = glm::min(mLowestBase, float(mTexels[i * 4 + 2]) / 255.0f);
+                mHighestTop = glm::max(mHighestTop, float(mTexels[i * 4 + 3]) / 255.0f);
+            }
+        }
+
+        // no clouds anywhere, keep an empty range
+        if (mHighestTop < mLowestBase)
+        {
+            mLowestBase = 0.0f;
+            mHighestTop = 0.0f;
+        }
+    }
+
+
+    std::vector<uint8_t> mTexels;
+    float mLowestBase;
+    float mHighestTop;
+};